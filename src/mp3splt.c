@@ -21,15 +21,25 @@
  *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111, USA.
  */
 
+//for sync_file_range
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
 #include <sys/stat.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <ctype.h>
+#include <math.h>
 #include <getopt.h>
 #include <locale.h>
+#include <time.h>
 
 #ifdef ENABLE_NLS
 #  include <libintl.h>
@@ -38,6 +48,7 @@
 #ifdef __WIN32__
 #include <windows.h>
 #include <shlwapi.h>
+#include <io.h>
 #endif
 
 #include <libmp3splt/mp3splt.h>
@@ -49,12 +60,110 @@
 #define PACKAGE_NAME "mp3splt"
 #endif
 
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+#endif
+
+#ifndef __WIN32__
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#endif
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#endif
+
+#include <dirent.h>
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
 #define MP3SPLT_DATE "27/09/10"
 #define MP3SPLT_AUTHOR1 "Matteo Trotta"
 #define MP3SPLT_AUTHOR2 "Alexandru Munteanu"
 #define MP3SPLT_EMAIL1 "<mtrotta AT users.sourceforge.net>"
 #define MP3SPLT_EMAIL2 "<io_fx AT yahoo.fr>"
 #define MP3SPLT_CDDBFILE "query.cddb"
+#define MP3SPLT_CANCEL_LOGFILE "mp3splt_cancel.log"
+#define MP3SPLT_SILENCE_LOGFILE "mp3splt.log"
+#define MP3SPLT_CANCELLED_EXIT_CODE 2
+#ifdef __WIN32__
+#define MP3SPLT_NULL_DEVICE "NUL"
+#else
+#define MP3SPLT_NULL_DEVICE "/dev/null"
+#endif
+//header of the binary splitpoints files, followed by 32 bits little endian
+//values in hundredths of seconds (0xFFFFFFFF for EOF)
+#define MP3SPLT_SPLITPOINTS_MAGIC "MP3SPLTP"
+//first line of the split plans
+#define MP3SPLT_PLAN_HEADER "# mp3splt plan 1"
+#define MP3SPLT_PLAN_LINE_SIZE 16384
+
+//I/O scheduling classes and priority encoding of ioprio_set(2)
+#define MP3SPLT_IOPRIO_WHO_PROCESS 1
+#define MP3SPLT_IOPRIO_CLASS_BE 2
+#define MP3SPLT_IOPRIO_CLASS_IDLE 3
+#define MP3SPLT_IOPRIO_CLASS_SHIFT 13
+//seconds between two samples of the I/O of the process (--io-limit)
+#define MP3SPLT_IO_LIMIT_INTERVAL 0.1
+#define MP3SPLT_DIR_CACHE_BUCKETS 1024
+//maximum length of a line of the cue file rewritten with --concat
+#define MP3SPLT_CONCAT_LINE_SIZE 4096
+//--follow: bytes read at once, seconds without growth before stopping,
+//default minimum silence length in seconds and level of the frames
+//without coded values
+#define MP3SPLT_FOLLOW_BUFFER 65536
+#define MP3SPLT_FOLLOW_TIMEOUT 60
+#define MP3SPLT_FOLLOW_MIN_SILENCE 1.0
+#define MP3SPLT_FOLLOW_SILENT_LEVEL -96.0
+//-c discid: maximum number of tracks of a cd, lead-in in frames (1/75 s),
+//maximum length of the lines of the server and timeout in seconds
+#define MP3SPLT_CDDB_MAX_TRACKS 99
+#define MP3SPLT_CDDB_LEAD_IN 150
+#define MP3SPLT_CDDB_LINE_SIZE 4096
+#define MP3SPLT_CDDB_TIMEOUT 30
+//freedb search and get type of the local cddb indexes, the files of an
+//index, the maximum length of an indexed word and of the results
+#define MP3SPLT_LOCAL_CDDB_TYPE 100
+#define MP3SPLT_LOCAL_CDDB_DISCS "discs"
+#define MP3SPLT_LOCAL_CDDB_WORDS "words"
+#define MP3SPLT_LOCAL_CDDB_DISCIDS "discids"
+#define MP3SPLT_LOCAL_CDDB_HEADER "# mp3splt cddb index 1"
+#define MP3SPLT_LOCAL_CDDB_WORD_SIZE 64
+#define MP3SPLT_LOCAL_CDDB_LINE_SIZE 4096
+#define MP3SPLT_LOCAL_CDDB_MAX_RESULTS 500
+//-a: maximum number of processes adjusting the splitpoints by default
+#define MP3SPLT_ADJUST_MAX_JOBS 16
+//bytes of inotify events read at once by --watch
+#define MP3SPLT_WATCH_EVENTS_SIZE 4096
+//bytes of the start, middle and end of the files compared by --dedupe
+#define MP3SPLT_DEDUPE_SAMPLE 65536
+//bytes of the input file read ahead with --drop-cache
+#define MP3SPLT_READAHEAD_WINDOW (8 * 1024 * 1024)
+//maximum bytes of each next input file read ahead with --prefetch
+#define MP3SPLT_PREFETCH_SIZE (64 * 1024 * 1024)
+//level blocks of 100 ms and gating windows of 400 ms (--loudness)
+#define MP3SPLT_LOUDNESS_BLOCK 10
+#define MP3SPLT_LOUDNESS_WINDOW 4
+//genre of the tags without genre (--retag)
+#define MP3SPLT_UNDEFINED_GENRE 0xFF
+//padding of the ID3v2 tags created by --retag, for the next updates
+#define MP3SPLT_ID3V2_PADDING 2048
+//waveform resolution and sample rate if unknown
+#define MP3SPLT_WAVEFORM_SAMPLES_PER_PIXEL 256
+#define MP3SPLT_WAVEFORM_SAMPLE_RATE 44100
+#define MP3SPLT_FNV_OFFSET 14695981039346656037ULL
 
 #ifdef ENABLE_NLS
 #  define MP3SPLT_GETTEXT_DOMAIN "mp3splt"
@@ -63,11 +172,23 @@
 #  define _(STR) ((const char *)STR)
 #endif
 
-//in case of STDIN/STDOUT usage, we change the console file handle
-//-yeah indeed, global variables might suck
-FILE *console_out = NULL;
-FILE *console_err = NULL;
-FILE *console_progress = NULL;
+//several runs of the frontend can be done at once, one per thread (see
+//run_mp3splt): the state of a run is in its main struct, and only the
+//run executed by a thread is global, for the library callbacks
+#ifdef __GNUC__
+#define MP3SPLT_THREAD_LOCAL __thread
+#else
+#define MP3SPLT_THREAD_LOCAL
+#endif
+
+//getopt has global state: the runs parse their options one at a time
+#ifdef HAVE_PTHREAD_H
+pthread_mutex_t getopt_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t temporary_files_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+//number of the temporary files named by the runs of the process
+unsigned long number_of_temporary_files = 0;
 
 typedef struct {
   //force id3v1 tags, force id3v2 tags or both
@@ -123,16 +244,364 @@ typedef struct {
   char freedb_arg_search_string[2048];
   //the chosen result passed in parameter: -c query{my artist}[
   int freedb_arg_result_option;
+  //--splitpoints: the file (or '-' for stdin) to read splitpoints from
+  char *splitpoints_file_arg;
+  //--plan: the split plan written with -P
+  char *plan_arg;
+  //--execute-plan: the split plan to execute
+  char *execute_plan_arg;
+  //--manifest: the manifest of the created files
+  char *manifest_arg;
+  //--loudness option
+  short loudness_option;
+  //--waveform: 'dat' or 'json'
+  char *waveform_arg;
+  //--retag option
+  short retag_option;
+  //--drop-cache option
+  short drop_cache_option;
+  //--prefetch: number of next input files read ahead
+  int prefetch;
+  //--concat option
+  short concat_option;
+  //--order: 'size' or 'location'
+  char *order_arg;
+  //--dedupe: 'link' or 'copy'
+  char *dedupe_arg;
+  //--follow option
+  short follow_option;
+  //--watch option, number of splits at once (--watch-jobs) and the
+  //directories of the split (--done-dir) and failed (--error-dir) files
+  short watch_option;
+  int watch_jobs;
+  char *done_dir_arg;
+  char *error_dir_arg;
+  //--trace: the timeline of the run
+  char *trace_arg;
+  //--build-cddb-index: the index directory
+  char *cddb_index_arg;
+  //--adjust-jobs: processes adjusting the splitpoints (-a), -1 for one
+  //per processor
+  int adjust_jobs;
+  //--io-limit: maximum number of bytes read and written per second
+  short io_limit_option;
+  double io_limit;
+  //--io-priority: I/O scheduling class and priority in the class
+  short io_priority_option;
+  int io_priority_class;
+  int io_priority_level;
 } options;
 
+//long options without a short option
+enum {
+  OPTION_IO_LIMIT = 256,
+  OPTION_IO_PRIORITY,
+  OPTION_SPLITPOINTS,
+  OPTION_PLAN,
+  OPTION_EXECUTE_PLAN,
+  OPTION_MANIFEST,
+  OPTION_LOUDNESS,
+  OPTION_WAVEFORM,
+  OPTION_WAVEFORM_RESOLUTION,
+  OPTION_RETAG,
+  OPTION_DROP_CACHE,
+  OPTION_PREFETCH,
+  OPTION_CONCAT,
+  OPTION_ORDER,
+  OPTION_DEDUPE,
+  OPTION_FOLLOW,
+  OPTION_WATCH,
+  OPTION_WATCH_JOBS,
+  OPTION_DONE_DIR,
+  OPTION_ERROR_DIR,
+  OPTION_TRACE,
+  OPTION_BUILD_CDDB_INDEX,
+  OPTION_ADJUST_JOBS
+};
+
+struct option long_options[] = {
+  { "io-limit", required_argument, NULL, OPTION_IO_LIMIT },
+  { "io-priority", required_argument, NULL, OPTION_IO_PRIORITY },
+  { "splitpoints", required_argument, NULL, OPTION_SPLITPOINTS },
+  { "plan", required_argument, NULL, OPTION_PLAN },
+  { "execute-plan", required_argument, NULL, OPTION_EXECUTE_PLAN },
+  { "manifest", required_argument, NULL, OPTION_MANIFEST },
+  { "loudness", no_argument, NULL, OPTION_LOUDNESS },
+  { "waveform", required_argument, NULL, OPTION_WAVEFORM },
+  { "waveform-resolution", required_argument, NULL, OPTION_WAVEFORM_RESOLUTION },
+  { "retag", no_argument, NULL, OPTION_RETAG },
+  { "drop-cache", no_argument, NULL, OPTION_DROP_CACHE },
+  { "prefetch", required_argument, NULL, OPTION_PREFETCH },
+  { "concat", no_argument, NULL, OPTION_CONCAT },
+  { "order", required_argument, NULL, OPTION_ORDER },
+  { "dedupe", required_argument, NULL, OPTION_DEDUPE },
+  { "follow", no_argument, NULL, OPTION_FOLLOW },
+  { "watch", no_argument, NULL, OPTION_WATCH },
+  { "watch-jobs", required_argument, NULL, OPTION_WATCH_JOBS },
+  { "done-dir", required_argument, NULL, OPTION_DONE_DIR },
+  { "error-dir", required_argument, NULL, OPTION_ERROR_DIR },
+  { "trace", required_argument, NULL, OPTION_TRACE },
+  { "build-cddb-index", required_argument, NULL, OPTION_BUILD_CDDB_INDEX },
+  { "adjust-jobs", required_argument, NULL, OPTION_ADJUST_JOBS },
+  { NULL, 0, NULL, 0 }
+};
+
+//energy of the levels of 100 ms (--loudness)
+typedef struct
+{
+  double energy;
+  float peak;
+  unsigned long number_of_levels;
+} loudness_block;
+
 typedef struct
 {
   double level_sum;
   unsigned long number_of_levels;
   //if set to FALSE, don't show the average silence level
   int print_silence_level;
+  //SPLT_TRUE if we keep the levels for the loudness
+  int keep_levels;
+  loudness_block *blocks;
+  long number_of_blocks;
+  long blocks_capacity;
+  //SPLT_TRUE if we keep the waveform peaks (--waveform)
+  int keep_peaks;
+  float *peaks;
+  long number_of_peaks;
+  long peaks_capacity;
+  long sample_rate;
+  long samples_per_pixel;
+  //--waveform-resolution before it is limited to the levels of the file,
+  //or 0 for one pixel per level
+  long requested_samples_per_pixel;
 } silence_level;
 
+//one directory already created (or found) for the output files
+typedef struct created_dir {
+  char *path;
+  struct created_dir *next;
+} created_dir;
+
+//directories created for the output files, so that we don't check
+//and create the same directory for every output file
+typedef struct
+{
+  created_dir *buckets[MP3SPLT_DIR_CACHE_BUCKETS];
+  int number_of_dirs;
+} directory_cache;
+
+//splitpoints and tags read from the cue, cddb or audacity file for the
+//first input file; we set them again for the next input files instead of
+//reading and parsing the file again
+typedef struct
+{
+  splt_point *points;
+  int number_of_points;
+  splt_tags *tags;
+  int number_of_tags;
+  //SPLT_TRUE when the cache is filled
+  int loaded;
+} splitpoints_cache;
+
+//token bucket limiting the bytes read and written by the process
+typedef struct
+{
+  //maximum bytes per second; 0 if no limit
+  double bytes_per_second;
+  //available bytes
+  double tokens;
+  double last_time;
+  unsigned long long last_io_bytes;
+  //for the effective rate of the current input file
+  double start_time;
+  unsigned long long start_io_bytes;
+  double effective_rate;
+  //bytes of the limiter reading /proc/self/io and of the progress
+  //messages, not counted as split I/O
+  unsigned long long own_bytes;
+} io_limiter;
+
+//page cache hints on the current input file (--drop-cache)
+typedef struct
+{
+  int fd;
+  long long size;
+  //end of the range read ahead
+  long long advised;
+  //end of the range dropped
+  long long dropped;
+  //bytes of the output files created from the input file: the split
+  //copies the frames, so the input is read at least up to there
+  long long finished;
+  //index of the next input file to read ahead (--prefetch)
+  int next_prefetch;
+} cache_hints;
+
+//an input file with the same content as a previous one (--dedupe)
+typedef struct
+{
+  //index of the identical input file split before, -1 if none
+  int original;
+  //the files created from this input when it has identical copies
+  short has_copies;
+  char **outputs;
+  int number_of_outputs;
+} input_duplicate;
+
+//a split running in a child process (--watch)
+typedef struct
+{
+  pid_t pid;
+  char *filename;
+} watch_job;
+
+//the files waiting to be split and the running splits (--watch)
+typedef struct
+{
+  int inotify_fd;
+  char **files;
+  int number_of_files;
+  watch_job *jobs;
+  int number_of_jobs;
+} watch_queue;
+
+//the results of a search in a local cddb index
+typedef struct
+{
+  splt_freedb_results results;
+  //the xmcd file of each result
+  char **files;
+} local_cddb_results;
+
+//a connection to a cddb server for the disc id lookup (-c discid)
+typedef struct
+{
+  //SPLT_TRUE for cddb_cgi (one http request per command), else
+  //cddb_protocol
+  int http;
+  char host[256];
+  char path[256];
+  int port;
+  int fd;
+} cddb_connection;
+
+//the silence nearest to a splitpoint in its window (-a); times in
+//hundredths of seconds from the start of the window
+typedef struct
+{
+  float threshold;
+  float offset;
+  long min_length;
+  long point;
+  //the current silence, -1 if none
+  long silence_begin;
+  long silence_end;
+  //-1 until a silence is found
+  long adjusted;
+} adjust_scan;
+
+//the part of the followed file given to the library in frame mode
+//(--follow -f), so that it does not read the previous segments again;
+//offsets in bytes from the start of the file
+typedef struct
+{
+  //second handle on the followed file
+  FILE *input;
+  //length of the ID3v2 tag, copied at the start of the window
+  unsigned long tag_end;
+  //first frame of the window and its time in seconds
+  unsigned long begin;
+  double time;
+  //end of the last frame of the window, 0 for the end of the file
+  unsigned long end;
+} follow_window;
+
+//a word or disc id of a cd and the offset of the cd in the discs file
+//(--build-cddb-index)
+typedef struct
+{
+  char *key;
+  long offset;
+} local_cddb_posting;
+
+//the local cddb index being built (--build-cddb-index)
+typedef struct
+{
+  FILE *discs;
+  local_cddb_posting *words;
+  int number_of_words;
+  int words_capacity;
+  local_cddb_posting *discids;
+  int number_of_discids;
+  int discids_capacity;
+  int number_of_discs;
+  int number_of_files;
+} local_cddb_builder;
+
+//a span of the timeline (--trace)
+typedef struct
+{
+  //static name of the span and the file it is about, or NULL
+  const char *name;
+  char *file;
+  //start and duration in microseconds
+  double start;
+  double duration;
+  long thread;
+  //bytes of the file, -1 if unknown
+  long long bytes;
+} trace_span;
+
+//the spans recorded by a run (--trace)
+typedef struct
+{
+  trace_span *spans;
+  int number_of_spans;
+  int capacity;
+  //the file being split and the start of its silence scan and of its
+  //next output file, 0 if none
+  const char *current_file;
+  double scan_start;
+  double segment_start;
+} trace_buffer;
+
+//an m3u file of the batch, kept in memory (-m)
+typedef struct
+{
+  char *filename;
+  char *content;
+  size_t length;
+  size_t capacity;
+  //SPLT_TRUE if it must be written
+  int modified;
+} m3u_file;
+
+//growing array of bytes; when memory is missing, 'failed' is set and the
+//next appends are ignored, so that the buffer is checked once at the end
+typedef struct
+{
+  unsigned char *bytes;
+  size_t length;
+  size_t capacity;
+  int failed;
+} byte_buffer;
+
+//a created file in the manifest (--manifest)
+typedef struct {
+  char *path;
+  unsigned long long size;
+  char sha256[65];
+  unsigned long long fnv1a;
+  long frames;
+  double duration;
+  long anomalies;
+  //--loudness: estimates from the levels of the silence detection
+  int has_level_estimate;
+  double estimated_level_db;
+  double estimated_peak_db;
+} manifest_entry;
+
 typedef struct
 {
   //command line options
@@ -141,21 +610,105 @@ typedef struct
   splt_state *state;
   //for computing the average silence level
   silence_level *sl;
+  //the directories we have already created with -o
+  directory_cache *dir_cache;
+  //the I/O bandwidth limiter (--io-limit)
+  io_limiter *io;
+  //the page cache hints (--drop-cache)
+  cache_hints *cache;
+  //the process writing the input files to the pipe (--concat)
+  pid_t concat_pid;
+  //the rewritten cue file (--concat)
+  char *concat_cue;
+  //the window file written by the library for the auto-adjust (-a)
+  char *adjust_window;
+  //the name of the next segment of --follow in frame mode
+  char *follow_name;
+  //the input files identical to a previous one (--dedupe)
+  input_duplicate *duplicates;
+  int number_of_duplicates;
+  //the timeline (--trace), until we know if it is needed
+  trace_buffer *trace;
+  //the results of the local freedb search
+  local_cddb_results *local_cddb;
+  //the splitpoints and tags from -c or -A
+  splitpoints_cache *sp_cache;
   //the filenames parsed from the arguments
   char **filenames;
   int number_of_filenames;
   //the splitpoints parsed from the arguments
   long *splitpoints;
   int number_of_splitpoints;
+  //allocated size of 'splitpoints'
+  int splitpoints_capacity;
+  //the output files created from the current input file
+  char **split_files;
+  int number_of_split_files;
+  //the index of the current input file
+  int current_file_index;
+  //SPLT_TRUE if we stopped the split after a cancel request
+  int split_cancelled;
+  //the output file being created when the split was stopped, as named by
+  //the progress bar: it is never removed, the library did not report it
+  char interrupted_file[512];
+  //error of a library callback, reported once the split returns
+  char callback_error[1024];
+  //the status returned by run_mp3splt
+  int exit_status;
+  //the messages, the errors and the progress bar; in case of STDIN/STDOUT
+  //usage, we change the console file handle
+  FILE *console_out;
+  FILE *console_err;
+  FILE *console_progress;
+  //SPLT_TRUE if the output sinks are the standard output and error
+  short standard_sinks;
+  //the sink of the -Q option when the sinks are not the standard ones
+  FILE *console_null;
+  //set by cancel_run, on SIGINT or SIGTERM for the command line:
+  //1 means finish the segment being created, then stop;
+  //2 (second signal) means stop as soon as possible
+  volatile sig_atomic_t cancel_requested;
+  //the files written in the working directory (see set_run_directory)
+  char *silence_log_file;
+  char *cancel_log_file;
+  char *cddb_file;
+  //SPLT_TRUE if we print the progress bar
+  int show_progress;
+  //SPLT_TRUE when the plugins have been searched
+  int plugins_found;
+  //the split plan we write (--plan), in a temporary file until complete
+  FILE *plan;
+  char *plan_temporary;
+  //the m3u files (-m)
+  m3u_file *m3u_files;
+  int number_of_m3u_files;
+  //the silence log written by the library before being renamed
+  char *silence_log_temporary;
+  //the created files, for the manifest (--manifest)
+  manifest_entry *manifest;
+  int number_of_manifest_entries;
+  //first entry of the current input file
+  int first_manifest_entry;
+  int manifest_capacity;
   //command line arguments: on windows, we need to
   //keep the ones transformed to utf8 and free them later
   char **argv;
   int argc;
+  //the command line with the options (--watch) and the arguments left
+  //out of the command line of the splits
+  char **original_argv;
+  int number_of_original_args;
+  char **watch_arguments;
+  int number_of_watch_arguments;
 } main_data;
 
-//we make a global variable, we use it in
-//sigint_handler
-splt_state *state;
+//SPLT_TRUE in the child process of a split of the watch mode: a split
+//that creates no file has failed
+int watch_job_process = SPLT_FALSE;
+
+//the run executed by this thread: we make a global variable, we use it
+//in the library callbacks (they have no user data)
+MP3SPLT_THREAD_LOCAL main_data *callbacks_data = NULL;
 
 //free the option struct
 void free_options(options **opt)
@@ -211,1467 +764,10051 @@ void free_options(options **opt)
         free((*opt)->output_format);
         (*opt)->output_format = NULL;
       }
+
+      if ((*opt)->splitpoints_file_arg)
+      {
+        free((*opt)->splitpoints_file_arg);
+        (*opt)->splitpoints_file_arg = NULL;
+      }
+
+      if ((*opt)->plan_arg)
+      {
+        free((*opt)->plan_arg);
+        (*opt)->plan_arg = NULL;
+      }
+
+      if ((*opt)->execute_plan_arg)
+      {
+        free((*opt)->execute_plan_arg);
+        (*opt)->execute_plan_arg = NULL;
+      }
+
+      if ((*opt)->order_arg)
+      {
+        free((*opt)->order_arg);
+        (*opt)->order_arg = NULL;
+      }
+
+      if ((*opt)->dedupe_arg)
+      {
+        free((*opt)->dedupe_arg);
+        (*opt)->dedupe_arg = NULL;
+      }
+
+      if ((*opt)->done_dir_arg)
+      {
+        free((*opt)->done_dir_arg);
+        (*opt)->done_dir_arg = NULL;
+      }
+
+      if ((*opt)->error_dir_arg)
+      {
+        free((*opt)->error_dir_arg);
+        (*opt)->error_dir_arg = NULL;
+      }
+
+      if ((*opt)->trace_arg)
+      {
+        free((*opt)->trace_arg);
+        (*opt)->trace_arg = NULL;
+      }
+
+      if ((*opt)->cddb_index_arg)
+      {
+        free((*opt)->cddb_index_arg);
+        (*opt)->cddb_index_arg = NULL;
+      }
+
+      if ((*opt)->manifest_arg)
+      {
+        free((*opt)->manifest_arg);
+        (*opt)->manifest_arg = NULL;
+      }
+
+      if ((*opt)->waveform_arg)
+      {
+        free((*opt)->waveform_arg);
+        (*opt)->waveform_arg = NULL;
+      }
       free(*opt);
       *opt = NULL;
     }
   }
 }
 
-void free_main_struct(main_data **d)
+void free_directory_cache(directory_cache **cache)
 {
-  if (d)
+  if (cache)
   {
-    main_data *data = *d;
-    if (data)
+    if (*cache)
     {
-      //try to stop the split
-      mp3splt_stop_split(data->state, NULL);
-      //free options
-      free_options(&data->opt);
-
-      //free silence level
-      if (data->sl)
+      int i = 0;
+      for (i = 0; i < MP3SPLT_DIR_CACHE_BUCKETS; i++)
       {
-        free(data->sl);
-        data->sl = NULL;
+        created_dir *dir = (*cache)->buckets[i];
+        while (dir)
+        {
+          created_dir *next = dir->next;
+          free(dir->path);
+          free(dir);
+          dir = next;
+        }
+        (*cache)->buckets[i] = NULL;
       }
+      free(*cache);
+      *cache = NULL;
+    }
+  }
+}
 
-      //free filenames & splitpoints
-      if (data->filenames)
+//free the output files of the current input file
+void free_split_files(main_data *data)
+{
+  if (data->split_files)
+  {
+    int i = 0;
+    for (i = 0; i < data->number_of_split_files; i++)
+    {
+      free(data->split_files[i]);
+      data->split_files[i] = NULL;
+    }
+    free(data->split_files);
+    data->split_files = NULL;
+  }
+  data->number_of_split_files = 0;
+}
+
+char *strdup_or_null(const char *str)
+{
+  if (str)
+  {
+    return strdup(str);
+  }
+
+  return NULL;
+}
+
+void free_cached_tags(splt_tags *tags)
+{
+  free(tags->title);
+  free(tags->artist);
+  free(tags->album);
+  free(tags->performer);
+  free(tags->year);
+  free(tags->comment);
+  memset(tags, 0, sizeof(splt_tags));
+}
+
+void free_splitpoints_cache(splitpoints_cache **cache)
+{
+  if (cache)
+  {
+    if (*cache)
+    {
+      int i = 0;
+      if ((*cache)->points)
       {
-        int i = 0;
-        for (i = 0; i < data->number_of_filenames;i++)
+        for (i = 0; i < (*cache)->number_of_points; i++)
         {
-          free(data->filenames[i]);
-          data->filenames[i] = NULL;
+          free((*cache)->points[i].name);
         }
-        free(data->filenames);
-        data->filenames = NULL;
-      }
-      if (data->splitpoints)
-      {
-        free(data->splitpoints);
-        data->splitpoints = NULL;
+        free((*cache)->points);
+        (*cache)->points = NULL;
       }
 
-#ifdef __WIN32__
-      //free argv
-      if (data->argv)
+      if ((*cache)->tags)
       {
-        int i = 0;
-        for (i = 0; i < data->argc;i++)
+        for (i = 0; i < (*cache)->number_of_tags; i++)
         {
-          if (data->argv[i])
-          {
-            free(data->argv[i]);
-            data->argv[i] = NULL;
-          }
+          free_cached_tags(&(*cache)->tags[i]);
         }
-
-        free(data->argv);
-        data->argv = NULL;
+        free((*cache)->tags);
+        (*cache)->tags = NULL;
       }
-#endif 
 
-      //free left variables in the state
-      mp3splt_free_state(data->state, NULL);
-      data->state = NULL;
-
-      free(data);
-      data = NULL;
+      free(*cache);
+      *cache = NULL;
     }
   }
 }
 
-//prints a message
-void print_message(const char *m)
+//returns the name of the temporary file written before 'filename'
+char *get_temporary_filename(const char *filename)
 {
-  fprintf(console_out,"%s\n",m);
-  fflush(console_out);
+  //the runs in the threads of a process write the same files: each
+  //temporary file gets a number of its own
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&temporary_files_mutex);
+#endif
+  unsigned long number = ++number_of_temporary_files;
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(&temporary_files_mutex);
+#endif
+
+  int malloc_size = strlen(filename) + 64;
+  char *temporary = malloc(sizeof(char) * malloc_size);
+  if (!temporary)
+  {
+    errno = ENOMEM;
+    return NULL;
+  }
+
+#ifdef HAVE_UNISTD_H
+  snprintf(temporary, malloc_size, "%s.%ld.%lu.tmp", filename,
+      (long) getpid(), number);
+#else
+  snprintf(temporary, malloc_size, "%s.%lu.tmp", filename, number);
+#endif
+
+  return temporary;
 }
 
-//prints a warning
-void print_warning(const char *w)
+//opens a temporary file that close_atomic_file renames to 'filename',
+//so that 'filename' is never half written
+FILE *open_atomic_file(const char *filename, const char *mode, char **temporary)
 {
-  fprintf(console_err,_(" Warning: %s\n"),w);
-  fflush(console_err);
+  *temporary = get_temporary_filename(filename);
+  if (!*temporary)
+  {
+    return NULL;
+  }
+
+  FILE *file = fopen(*temporary, mode);
+  if (!file)
+  {
+    int saved_errno = errno;
+    free(*temporary);
+    *temporary = NULL;
+    errno = saved_errno;
+  }
+
+  return file;
 }
 
-//prints an error
-void print_error(const char *e)
+//renames the temporary file to 'filename'; returns -1 on error
+int rename_atomic_file(char *temporary, const char *filename)
 {
-  fprintf(console_err,_(" Error: %s\n"),e);
-  fflush(console_err);
+#ifdef __WIN32__
+  remove(filename);
+#endif
+  int result = rename(temporary, filename);
+  if (result != 0)
+  {
+    int saved_errno = errno;
+    remove(temporary);
+    errno = saved_errno;
+  }
+  free(temporary);
+
+  return (result == 0) ? 0 : -1;
 }
 
-void print_error_exit(const char *m, main_data *data)
+//closes the file opened with open_atomic_file and renames it to
+//'filename'; returns -1 on error (the temporary file is then removed)
+int close_atomic_file(FILE *file, char *temporary, const char *filename)
 {
-  print_error(m);
-  free_main_struct(&data);
-  exit(1);
+  if (fclose(file) != 0)
+  {
+    int saved_errno = errno;
+    remove(temporary);
+    free(temporary);
+    errno = saved_errno;
+    return -1;
+  }
+
+  return rename_atomic_file(temporary, filename);
 }
 
-void print_message_exit(const char *m, main_data *data)
+//closes the file opened with open_atomic_file and removes it
+void discard_atomic_file(FILE *file, char *temporary)
 {
-  print_message(m);
-  free_main_struct(&data);
-  exit(0);
+  fclose(file);
+  remove(temporary);
+  free(temporary);
 }
 
-void *my_malloc(size_t size, main_data *data)
+//returns the time of the trace in microseconds
+double get_trace_time()
 {
-  void *allocated = malloc(size);
-  if (! allocated)
+#ifdef CLOCK_MONOTONIC
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000.0 + now.tv_nsec / 1000.0;
+#else
+  return time(NULL) * 1000000.0;
+#endif
+}
+
+//returns the id of the calling thread, for the trace
+long get_thread_id()
+{
+#ifdef __WIN32__
+  return (long) GetCurrentThreadId();
+#elif defined(__linux__) && defined(SYS_gettid)
+  return (long) syscall(SYS_gettid);
+#else
+  return (long) getpid();
+#endif
+}
+
+//returns the size of a file, or -1 if unknown
+long long get_trace_file_size(const char *filename)
+{
+  struct stat file_stat;
+  if (!filename || (stat(filename, &file_stat) != 0) ||
+      !S_ISREG(file_stat.st_mode))
   {
-    print_error_exit(_("cannot allocate memory !"), data);
+    return -1;
   }
-  else
+
+  return (long long) file_stat.st_size;
+}
+
+//returns the start time of a span, 0 when we don't trace
+double trace_begin(main_data *data)
+{
+  if (!data || !data->trace)
   {
-    return allocated;
+    return 0;
   }
 
-  return NULL;
+  return get_trace_time();
 }
 
-void *my_realloc(void *ptr, size_t size, main_data *data)
+//records the span started at 'start'; 'file' and 'bytes' (-1 if unknown)
+//are shown as its arguments. The spans of a run are only appended by its
+//thread, so no lock is taken, and a span is dropped if out of memory
+void trace_end(main_data *data, const char *name, const char *file,
+    double start, long long bytes)
 {
-  void *allocated = realloc(ptr, size);
-  if (! allocated)
+  if (!data || !data->trace || (start <= 0))
   {
-    print_error_exit(_("cannot allocate memory !"), data);
+    return;
   }
-  else
+
+  trace_buffer *trace = data->trace;
+  if (trace->number_of_spans >= trace->capacity)
   {
-    return allocated;
+    int capacity = (trace->capacity > 0) ? trace->capacity * 2 : 256;
+    trace_span *spans = realloc(trace->spans, sizeof(trace_span) * capacity);
+    if (!spans)
+    {
+      return;
+    }
+    trace->spans = spans;
+    trace->capacity = capacity;
   }
-  
-  return NULL;
+
+  trace_span *span = &trace->spans[trace->number_of_spans];
+  span->name = name;
+  span->file = file ? strdup(file) : NULL;
+  span->start = start;
+  span->duration = get_trace_time() - start;
+  span->thread = get_thread_id();
+  span->bytes = bytes;
+  trace->number_of_spans++;
 }
 
-//shows a small mp3splt help and exits with error 1
-void show_small_help_exit(main_data *data)
+//ends the silence scan span if it is running; the next output file is
+//written after it
+void trace_end_silence_scan(main_data *data)
 {
-  free_main_struct(&data);
+  if (data && data->trace && (data->trace->scan_start > 0))
+  {
+    trace_end(data, "silence scan", data->trace->current_file,
+        data->trace->scan_start, -1);
+    data->trace->scan_start = 0;
+    data->trace->segment_start = get_trace_time();
+  }
+}
 
-  print_message(_("\n"
-        "USAGE:\n"
-        "      mp3splt [OPTIONS] FILE1 [FILE2] ... [BEGIN_TIME] [TIME] ... [END_TIME]\n"
-        "      TIME FORMAT: min.sec[.0-99], even if minutes are over 59\n"
-        "                   (or EOF for End Of File). "));
-  print_message(_("\nOPTIONS (split mode options)\n"
-        " -t + TIME: to split files every fixed time len. (TIME format same as above). \n"
-        " -c + file.cddb, file.cue or \"query\" or \"query{album}\". Get splitpoints and\n"
-        "      filenames from a .cddb or .cue file or from Internet (\"query\").\n"
-        "      Use -a to auto-adjust splitpoints."));
-  print_message(_(" -s   Silence detection: automatically find splitpoint. (Use -p for arguments)\n"
-        " -w   Splits wrapped files created with Mp3Wrap or AlbumWrap.\n"
-        " -l   Lists the tracks from file without extraction. (Only for wrapped mp3)\n"
-        " -e   Error mode: split mp3 with sync error detection. (For concatenated mp3)"));
-  print_message(_(" -A + AUDACITY_FILE: split with splitpoints from the audacity labels file"));
-  print_message(_(" -S + SPLIT_NUMBER: split in SPLIT_NUMBER equal time files"));
-  print_message(_(" -i   Count how many silence splitpoints we have with silence detection\n"
-        "      (Use -p for arguments)\n"
-        " -v   Prints current version and exits\n"
-        " -h   Shows this help"));
-  print_message(_("\n(other options)\n"
-        " -T + TAGS_VERSION: for mp3 files, force output tags as version 1, 2 or 1 & 2.\n"
-        "      TAGS_VERSION can be 1, 2 or 12\n"
-        "      (default is to set the same version as the file to split)"));
-  print_message(_(" -m + M3U_FILE: Appends to the specified m3u file the split filenames.\n"
-        " -f   Frame mode (mp3 only): process all frames. For higher precision and VBR.\n"
-        " -a   Auto-Adjust splitpoints with silence detection. (Use -p for arguments)"));
-  print_message(_(" -p + PARAMETERS (th, nt, off, min, rm, gap): user arguments for -s and -a.\n"
-        " -o + FORMAT: output filename pattern. Can contain those variables:\n"
-        "      @a: artist tag, @p: performer tag (might not exists), @b: album tag\n"
-        "      @t: title tag, @n: track number identifier, @N: track tag number\n"
-        "      (a digit may follow the 'n' or 'N' for the number of digits to output),\n"
-        "      @f: original filename"));
-  print_message(_(" -g + TAGS: custom tags for the split files.\n"
-        "      TAGS can contain those variables: \n"
-        "         @a, @b, @t, @y, @c, @n, @o (set original tags),\n"
-        "         @N (auto increment track number).\n"
-        "      TAGS format is like [@a=artist1,@t=title1]%[@o,@N=2,@a=artist2]\n"
-        "       (% means that we set the tags for all remaining files)"));
-  print_message(_(" -d + DIRNAME: to put all output files in the directory DIRNAME.\n"
-        " -k   Consider input not seekable (slower). Default when input is STDIN (-).\n"
-        " -O + TIME: Overlap split files with TIME (slower)."));
-  print_message(_(" -n   No Tag: does not write ID3v1 or vorbis comment. If you need clean files.\n"
-        " -x   No Xing header: does not write the Xing header. Use with -n if you wish\n"
-        "      to concatenate the split files\n"
-        " -N   Don't create the 'mp3splt.log' log file when using '-s'."));
-  print_message(_(" -P   Pretend to split: simulation of the process, without creating any\n"
-                  "      files or directories"));
-  print_message(_(" -E + CUE_FILE: export splitpoints to CUE file (use with -P if needed)"));
-  print_message(_(" -q   Quiet mode: try not to prompt (if possible) and print less messages.\n"
-        " -Q   Very quiet mode: don't print anything to stdout and no progress bar\n"
-        "       (also enables -q).\n"
-        " -D   Debug mode: used to debug the program.\n\n"
-        "      Please read man page for complete documentation.\n"));
+//starts the spans of the library split of 'filename'
+void trace_split_start(main_data *data, const char *filename)
+{
+  if (data && data->trace)
+  {
+    data->trace->current_file = filename;
+    data->trace->scan_start = 0;
+    data->trace->segment_start = get_trace_time();
+  }
+}
+
+//the silence scan span lasts while the library reports its progress
+void trace_progress(main_data *data, splt_progress *p_bar)
+{
+  if (!data || !data->trace)
+  {
+    return;
+  }
 
-  if (console_out == stderr)
+  if (p_bar->progress_type == SPLT_PROGRESS_SCAN_SILENCE)
   {
-    exit(1);
+    if (data->trace->scan_start <= 0)
+    {
+      data->trace->scan_start = get_trace_time();
+    }
   }
   else
   {
-    exit(0);
+    trace_end_silence_scan(data);
   }
 }
 
-//
-char **rmopt(char **argv, int offset, int tot)
+//an output file has been written since the previous one
+void trace_output_file(main_data *data, const char *file)
 {
-#ifdef __WIN32__
-  int i = 0;
-  for (i = 0; i < offset;i++)
+  if (!data || !data->trace)
   {
-    if (argv[i])
-    {
-      free(argv[i]);
-      argv[i] = NULL;
-    }
+    return;
   }
-#endif
 
-  char **first = &argv[1];
-  while (offset < tot)
+  trace_end_silence_scan(data);
+  if (data->trace->segment_start <= 0)
   {
-    *first = argv[offset];
-    first++;
-    offset++;
+    data->trace->segment_start = get_trace_time();
   }
-
-  return argv;
+  trace_end(data, "write segment", file, data->trace->segment_start,
+      get_trace_file_size(file));
+  data->trace->segment_start = get_trace_time();
 }
 
-//parse the -p option
-int parse_arg(char *arg, float *th, int *gap,
-    int *nt, float *off, int *rm, float *min)
+//writes a field of a tab separated file (--plan, --manifest), escaping
+//the tabs, the newlines and the backslashes
+void write_tsv_string(FILE *file, const char *string)
 {
-  char *ptr = NULL;
-  int found = 0;
-
-  if ((gap!=NULL) && ((ptr=strstr(arg, "gap"))!=NULL))
+  const char *ptr = NULL;
+  for (ptr = string; *ptr != '\0'; ptr++)
   {
-    if ((ptr=strchr(ptr, '='))!=NULL)
+    switch (*ptr)
     {
-      if (sscanf(ptr+1, "%d", gap)==1)
-      {
-        found++;
-      }
-      else 
-      {
-        print_warning(_("bad gap argument. It will be ignored !"));
-      }
+      case '\t':
+        fputs("\\t", file);
+        break;
+      case '\n':
+        fputs("\\n", file);
+        break;
+      case '\r':
+        fputs("\\r", file);
+        break;
+      case '\\':
+        fputs("\\\\", file);
+        break;
+      default:
+        fputc(*ptr, file);
+        break;
     }
   }
+}
 
-  if ((th!=NULL) && ((ptr=strstr(arg, "th"))!=NULL))
+//writes a string escaped for json
+void write_json_string(FILE *file, const char *string)
+{
+  fputc('"', file);
+  for (; *string; string++)
   {
-    if ((ptr=strchr(ptr, '='))!=NULL)
+    unsigned char c = (unsigned char) *string;
+    if ((c == '"') || (c == '\\'))
     {
-      if (sscanf(ptr+1, "%f", th)==1)
-      {
-        found++;
-      }
-      else 
-      {
-        print_warning(_("bad threshold argument. It will be ignored !"));
-      }
+      fprintf(file, "\\%c", c);
     }
-  }
-
-  if ((nt!=NULL) && ((ptr=strstr(arg, "nt"))!=NULL))
-  {
-    if ((ptr=strchr(ptr, '='))!=NULL)
+    else if (c < 0x20)
     {
-      if (sscanf(ptr+1, "%d", nt)==1)
-      {
-        found++;
-      }
-      else 
-      {
-        print_warning(_("bad tracknumber argument. It will be ignored !"));
-      }
+      fprintf(file, "\\u%04x", c);
+    }
+    else
+    {
+      fputc(c, file);
     }
   }
+  fputc('"', file);
+}
 
-  if (rm!=NULL)
+//writes the spans in the Chrome trace event format (--trace), readable
+//by chrome://tracing and Perfetto; the trace is written on every exit,
+//to also show where a failed or cancelled run stopped
+void write_trace(main_data *data)
+{
+  options *opt = data->opt;
+  trace_buffer *trace = data->trace;
+  if (!trace || !opt || !opt->trace_arg)
   {
-    if ((ptr=strstr(arg, "rm"))!=NULL)
-    {
-      found++;
-      *rm = 1;
-    }
+    return;
   }
 
-  if ((off!=NULL) && ((ptr=strstr(arg, "off"))!=NULL))
+  trace_end_silence_scan(data);
+
+  char *temporary = NULL;
+  FILE *file = open_atomic_file(opt->trace_arg, "w", &temporary);
+  if (!file)
   {
-    if ((ptr=strchr(ptr, '='))!=NULL)
-    {
-      if (sscanf(ptr+1, "%f", off)==1)
-      {
-        found++;
-      }
-      else 
-      {
-        print_warning(_("bad offset argument. It will be ignored!"));
-      }
-    }
+    char message[1024] = { '\0' };
+    snprintf(message, 1024, _("cannot write the trace '%s' (%s)"),
+        opt->trace_arg, strerror(errno));
+    fprintf(data->console_err, _(" Warning: %s\n"), message);
+    return;
   }
 
-  if ((min!=NULL) && ((ptr=strstr(arg, "min"))!=NULL))
+  fprintf(file, "{\"traceEvents\":[\n");
+  int i = 0;
+  for (i = 0; i < trace->number_of_spans; i++)
   {
-    if ((ptr=strchr(ptr, '='))!=NULL)
+    trace_span *span = &trace->spans[i];
+    fprintf(file, "{\"name\":\"%s\",\"cat\":\"mp3splt\",\"ph\":\"X\","
+        "\"ts\":%.3f,\"dur\":%.3f,\"pid\":%ld,\"tid\":%ld,\"args\":{",
+        span->name, span->start, span->duration, (long) getpid(),
+        span->thread);
+    if (span->file)
     {
-      if (sscanf(ptr+1, "%f", min)==1)
-      {
-        found++;
-      }
-      else 
-      {
-        print_warning(_("bad minimum silence length argument. It will be ignored !"));
-      }
+      fprintf(file, "\"file\":");
+      write_json_string(file, span->file);
+    }
+    if (span->bytes >= 0)
+    {
+      fprintf(file, "%s\"bytes\":%lld", span->file ? "," : "", span->bytes);
     }
+    fprintf(file, "}}%s\n", (i + 1 < trace->number_of_spans) ? "," : "");
   }
+  fprintf(file, "],\"displayTimeUnit\":\"ms\"}\n");
 
-  return found;
+  if (close_atomic_file(file, temporary, opt->trace_arg) == -1)
+  {
+    char message[1024] = { '\0' };
+    snprintf(message, 1024, _("cannot write the trace '%s' (%s)"),
+        opt->trace_arg, strerror(errno));
+    fprintf(data->console_err, _(" Warning: %s\n"), message);
+  }
 }
 
-int we_have_incompatible_stdin_option(options *opt)
+//frees the recorded spans
+void free_trace(main_data *data)
 {
-  return opt->s_option || opt->w_option ||
-    opt->l_option || opt->e_option ||
-    opt->i_option || opt->a_option ||
-    opt->p_option || opt->S_option;
+  trace_buffer *trace = data->trace;
+  if (!trace)
+  {
+    return;
+  }
+
+  int i = 0;
+  for (i = 0; i < trace->number_of_spans; i++)
+  {
+    free(trace->spans[i].file);
+  }
+  free(trace->spans);
+  free(trace);
+  data->trace = NULL;
 }
 
-//check if we have the correct arguments
-void check_args(int argc, main_data *data)
+//gives a hint on a range of the input file to the page cache
+void advise_input(cache_hints *hints, long long offset, long long length,
+    int advice)
 {
-  options *opt = data->opt;
+#ifdef HAVE_POSIX_FADVISE
+  if ((hints->fd >= 0) && (length > 0))
+  {
+    posix_fadvise(hints->fd, (off_t) offset, (off_t) length, advice);
+  }
+#endif
+}
 
-  if (argc < 2)
+//drops the pages of the input file and closes it
+void cache_hints_finish(main_data *data)
+{
+  cache_hints *hints = data->cache;
+  if (hints->fd < 0)
   {
-    console_out = stderr;
-    show_small_help_exit(data);
+    return;
   }
-  else
+
+#ifdef HAVE_POSIX_FADVISE
+  posix_fadvise(hints->fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+  close(hints->fd);
+  hints->fd = -1;
+}
+
+void free_main_struct(main_data **d)
+{
+  if (d)
   {
-    //if we want input not seekable (-k)
-    if (opt->k_option)
+    main_data *data = *d;
+    if (data)
     {
-      if (we_have_incompatible_stdin_option(opt))
+      //try to stop the split
+      mp3splt_stop_split(data->state, NULL);
+      write_trace(data);
+      free_trace(data);
+      //free options
+      free_options(&data->opt);
+
+      //free silence level
+      if (data->sl)
       {
-        print_error_exit(_("cannot use -k option (or STDIN) with"
-              " one of the following options: -S -s -w -l -e -i -a -p"), data);
+        if (data->sl->blocks)
+        {
+          free(data->sl->blocks);
+          data->sl->blocks = NULL;
+        }
+        if (data->sl->peaks)
+        {
+          free(data->sl->peaks);
+          data->sl->peaks = NULL;
+        }
+        free(data->sl);
+        data->sl = NULL;
       }
-    }
 
-    //if we dewrap (-w)
-    if (opt->w_option)
-    {
-      if (opt->t_option || opt->c_option ||
-          opt->s_option || opt->l_option ||
-          opt->e_option || opt->i_option ||
-          opt->f_option || opt->a_option ||
-          opt->p_option || opt->o_option ||
-          opt->g_option || opt->n_option ||
-          opt->x_option || opt->A_option ||
-          opt->E_option || opt->S_option)
+      free_directory_cache(&data->dir_cache);
+
+      if (data->io)
       {
-        print_error_exit(_("the -w option can only be used with -m, -d, -q and -Q"), data);
+        free(data->io);
+        data->io = NULL;
       }
-    }
 
-    //if we list wrapped files (-l)
-    if (opt->l_option)
-    {
-      if (opt->t_option || opt->c_option ||
-          opt->s_option || opt->e_option ||
-          opt->i_option || opt->m_option ||
-          opt->f_option || opt->a_option ||
-          opt->p_option || opt->o_option ||
-          opt->g_option || opt->d_option ||
-          opt->n_option || opt->qq_option ||
-          opt->x_option || opt->A_option ||
-          opt->S_option)
+      if (data->cache)
       {
-        print_error_exit(_("the -l option can only be used with -q"), data);
+        cache_hints_finish(data);
+        free(data->cache);
+        data->cache = NULL;
       }
-    }
 
-    //error mode (-e)
-    if (opt->e_option)
-    {
-      if (opt->t_option || opt->c_option || 
-          opt->s_option || opt->i_option || 
-          opt->a_option || opt->p_option ||
-          opt->g_option || opt->n_option ||
-          opt->A_option || opt->E_option ||
-          opt->S_option)
+      if (data->concat_cue)
       {
-        print_error_exit(_("the -e option can only be used with -m, -f, -o, -d, -q, -Q"), data);
+        remove(data->concat_cue);
+        free(data->concat_cue);
+        data->concat_cue = NULL;
       }
-    }
-
-    //frame mode (-f)
-    if (opt->f_option)
-    {
-    }
 
-    //cddb/cue/freedb (-c)
-    if (opt->c_option)
-    {
-      if (opt->t_option || opt->s_option ||
-          opt->i_option || opt->g_option ||
-          opt->A_option || opt->S_option)
+      if (data->follow_name)
       {
-        print_error_exit(_("the -c option cannot be used with -t, -g, -s, -A, -i or -S"), data);
+        free(data->follow_name);
+        data->follow_name = NULL;
       }
-    }
 
-    if (opt->A_option)
-    {
-      if (opt->t_option || opt->s_option || opt->i_option || opt->S_option)
+      if (data->duplicates)
       {
-        print_error_exit(_("the -A option cannot be used with -t, -s, -i or -S"), data);
+        int j = 0;
+        for (j = 0; j < data->number_of_duplicates; j++)
+        {
+          int k = 0;
+          for (k = 0; k < data->duplicates[j].number_of_outputs; k++)
+          {
+            free(data->duplicates[j].outputs[k]);
+          }
+          free(data->duplicates[j].outputs);
+        }
+        free(data->duplicates);
+        data->duplicates = NULL;
       }
-    }
 
-    //time split (-t)
-    if (opt->t_option)
-    {
-      if (opt->s_option || opt->i_option || opt->S_option)
+      if (data->local_cddb)
       {
-        print_error_exit(_("the -t option cannot be used with -s, -i or -S"), data);
+        int i = 0;
+        for (i = 0; i < data->local_cddb->results.number; i++)
+        {
+          free(data->local_cddb->results.results[i].name);
+          free(data->local_cddb->files[i]);
+        }
+        free(data->local_cddb->results.results);
+        free(data->local_cddb->files);
+        free(data->local_cddb);
+        data->local_cddb = NULL;
       }
-    }
 
-    //silence split (-s)
-    if (opt->s_option)
-    {
-      if (opt->a_option || opt->i_option || opt->S_option)
+      //only the arrays, the arguments are in 'argv'
+      if (data->original_argv)
       {
-        print_error_exit(_("-s option cannot be used with -a, -i or -S"), data);
+        free(data->original_argv);
+        data->original_argv = NULL;
       }
-    }
-
-    //auto adjust option (-a)
-    if (opt->a_option)
-    {
-      if (opt->i_option)
+      if (data->watch_arguments)
       {
-        print_error_exit(_("-a option cannot be used with -i"), data);
+        free(data->watch_arguments);
+        data->watch_arguments = NULL;
       }
-    }
-
-    if (opt->S_option)
-    {
-    }
 
-    //parameters (-p)
-    if (opt->p_option)
-    {
-      if (!opt->a_option && !opt->s_option && !opt->i_option)
-      {
-        print_error_exit(_("the -p option cannot be used without -a, -s or -i"), data);
-      }
-    }
+      free_splitpoints_cache(&data->sp_cache);
 
-    //output format (-o)
-    if (opt->o_option)
-    {
-      if (opt->i_option)
-      {
-        print_error_exit(_("the -o option cannot be used with -i"), data);
-      }
-      if (opt->output_format)
+      if (data->manifest)
       {
-        if ((strcmp(opt->output_format,"-") == 0) && (opt->m_option || opt->d_option))
+        int i = 0;
+        for (i = 0; i < data->number_of_manifest_entries; i++)
         {
-          print_error_exit(_("cannot use '-o -' (STDOUT) with -m or -d"), data);
+          free(data->manifest[i].path);
+          data->manifest[i].path = NULL;
         }
+        free(data->manifest);
+        data->manifest = NULL;
+        data->number_of_manifest_entries = 0;
       }
-    }
 
-    //custom tags (-g)
-    if (opt->g_option)
-    {
-      if (opt->i_option || opt->n_option)
+      //unfinished split plan and silence log
+      if (data->plan)
       {
-        print_error_exit(_("the -g option cannot be used with -n or -i"), data);
+        discard_atomic_file(data->plan, data->plan_temporary);
+        data->plan = NULL;
+        data->plan_temporary = NULL;
       }
-    }
 
-    //directory (-d)
-    if (opt->d_option)
-    {
-      if (opt->i_option)
+      if (data->silence_log_temporary)
       {
-        print_error_exit(_("the -d option cannot be used with -i"), data);
+        remove(data->silence_log_temporary);
+        free(data->silence_log_temporary);
+        data->silence_log_temporary = NULL;
       }
-    }
 
-    //no tags (-n)
-    if (opt->n_option)
-    {
-      if (opt->i_option || opt->T_option)
-      {
-        print_error_exit(_("the -n option cannot be used with -i or -T"), data);
-      }
-    }
+      free(data->silence_log_file);
+      free(data->cancel_log_file);
+      free(data->cddb_file);
+      data->silence_log_file = NULL;
+      data->cancel_log_file = NULL;
+      data->cddb_file = NULL;
 
-    //generate m3u file (-m)
-    if (opt->m_option)
-    {
-      if (opt->i_option)
+      if (data->console_null)
       {
-        print_error_exit(_("the -m option cannot be used with -i"), data);
+        fclose(data->console_null);
+        data->console_null = NULL;
       }
-    }
-
-    //count silence splitpoints (-i)
-    if (opt->i_option)
-    {
-    }
-
-    //quiet mode (-q)
-    if (opt->q_option)
-    {
-    }
 
-    //very quiet mode (-Q)
-    if (opt->qq_option)
-    {
-      if (opt->o_option)
+      if (data->m3u_files)
       {
-        if (strcmp(opt->output_format,"-") == 0)
+        int i = 0;
+        for (i = 0; i < data->number_of_m3u_files; i++)
         {
-          print_error_exit(_("the -Q option cannot be used with"
-              " STDOUT output ('-o -')"), data);
+          free(data->m3u_files[i].filename);
+          free(data->m3u_files[i].content);
         }
+        free(data->m3u_files);
+        data->m3u_files = NULL;
+        data->number_of_m3u_files = 0;
       }
-      if (opt->c_option)
+
+      //free filenames & splitpoints
+      if (data->filenames)
       {
-        if (strncmp(opt->cddb_arg,"query",5) == 0)
+        int i = 0;
+        for (i = 0; i < data->number_of_filenames;i++)
         {
-          print_error_exit(_("the -Q option cannot be used with"
-              " interactive freedb query ('-c query')"), data);
+          free(data->filenames[i]);
+          data->filenames[i] = NULL;
         }
+        free(data->filenames);
+        data->filenames = NULL;
       }
-    }
-
-    if (opt->N_option)
-    {
-      if (!opt->s_option)
+      if (data->splitpoints)
       {
-        print_error_exit(_("the -N option must be used with"
-            " silence detection (-s option)"), data);
+        free(data->splitpoints);
+        data->splitpoints = NULL;
       }
-    }
+      free_split_files(data);
 
-    if (opt->O_option)
-    {
-      if (opt->w_option || opt->e_option ||
-          opt->l_option || opt->i_option)
+#ifdef __WIN32__
+      //free argv
+      if (data->argv)
       {
-        print_error_exit(_("the -O option cannot be used with"
-            " -w, -e, -l or -i"), data);
+        int i = 0;
+        for (i = 0; i < data->argc;i++)
+        {
+          if (data->argv[i])
+          {
+            free(data->argv[i]);
+            data->argv[i] = NULL;
+          }
+        }
+
+        free(data->argv);
+        data->argv = NULL;
       }
-    }
+#endif 
 
-    if (opt->x_option)
-    {
-    }
+      //free left variables in the state
+      mp3splt_free_state(data->state, NULL);
+      data->state = NULL;
 
-    if (opt->T_option)
-    {
-      int force_tags_version = opt->T_option_value;
-      if ((force_tags_version != 1) && (force_tags_version != 2) &&
-          (force_tags_version != 12))
-      {
-        print_error_exit("the -T option can only have values 1, 2 or 12", data);
-      }
+      free(data);
+      data = NULL;
     }
   }
 }
 
-//prints a confirmation error that comes from the library
-void process_confirmation_error(int conf, main_data *data)
+//the sinks of the run executed by this thread, or the standard ones
+//outside of a run
+FILE *get_console_out()
 {
-  char *error_from_library = NULL;
-  error_from_library = mp3splt_get_strerror(data->state, conf);
-  if (error_from_library != NULL)
-  {
-    if (conf >= 0)
-    {
-      print_message(error_from_library);
-      free(error_from_library);
-    }
-    else
-    {
-      fprintf(console_err,"%s\n",error_from_library);
-      fflush(console_err);
-      free(error_from_library);
-      free_main_struct(&data);
-      exit(1);
-    }
-    error_from_library = NULL;
-  }
-  if (conf == SPLT_DEWRAP_OK)
-  {
-    print_message(_("\nAll files have been split correctly."
-          " Visit http://mp3wrap.sourceforge.net!"));
-  }
+  return callbacks_data ? callbacks_data->console_out : stdout;
 }
 
-//returns the converted string s in hundredth of seconds
-//returns -1 if it cannot convert
-long c_hundreths(const char *s)
+FILE *get_console_err()
 {
-  long minutes=0, seconds=0, hundredths=0, i;
-  long hun = -1;
+  return callbacks_data ? callbacks_data->console_err : stderr;
+}
 
-  if (strcmp(s,"EOF") == 0)
-  {
-    return LONG_MAX;
-  }
+//prints a message
+void print_message(const char *m)
+{
+  FILE *console_out = get_console_out();
+  fprintf(console_out,"%s\n",m);
+  fflush(console_out);
+}
+
+//prints a warning
+void print_warning(const char *w)
+{
+  FILE *console_err = get_console_err();
+  fprintf(console_err,_(" Warning: %s\n"),w);
+  fflush(console_err);
+}
+
+//prints an error
+void print_error(const char *e)
+{
+  FILE *console_err = get_console_err();
+  fprintf(console_err,_(" Error: %s\n"),e);
+  fflush(console_err);
+}
+
+void lock_getopt()
+{
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&getopt_mutex);
+#endif
+}
+
+void unlock_getopt()
+{
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(&getopt_mutex);
+#endif
+}
 
-  for(i=0; i<strlen(s); i++) // Some checking
+//the functions that can end the run return -1 when it must stop (after an
+//error, a cancel request, the help...), up to run_mp3splt which returns
+//the 'exit_status' of the main struct; they never exit the program
+
+//stops the run with 'status'; returns -1
+int stop_run(main_data *data, int status)
+{
+  if (data)
   {
-    if ((s[i]<0x30 || s[i] > 0x39) && (s[i]!='.'))
-    {
-      return -1;
-    }
+    data->exit_status = status;
   }
 
-  if (sscanf(s, "%ld.%ld.%ld", &minutes, &seconds, &hundredths) < 2)
+  return -1;
+}
+
+//prints the error and stops the run; returns -1
+int print_run_error(const char *m, main_data *data)
+{
+  print_error(m);
+  return stop_run(data, 1);
+}
+
+//stops the split from a library callback on error: the callbacks cannot
+//stop the run, so the error is reported by check_callback_error once the
+//library returns
+void stop_split_on_error(main_data *data, const char *m)
+{
+  if (!data || data->callback_error[0] != '\0')
   {
-    return -1;
+    return;
   }
 
-  if ((minutes < 0) || (seconds < 0) || (hundredths < 0))
+  snprintf(data->callback_error, 1024, "%s", m);
+  mp3splt_stop_split(data->state, NULL);
+}
+
+//stops the run with the error of a library callback, if any; returns -1
+//in that case
+int check_callback_error(main_data *data)
+{
+  if (data->callback_error[0] != '\0')
   {
-    return -1;
+    return print_run_error(data->callback_error, data);
   }
 
-  if ((seconds > 59) || (hundredths > 99))
+  return 0;
+}
+
+//prints the message and stops the run without error; returns -1
+int print_run_message(const char *m, main_data *data)
+{
+  print_message(m);
+  return stop_run(data, 0);
+}
+
+//returns NULL and stops the run if we cannot allocate
+void *my_malloc(size_t size, main_data *data)
+{
+  void *allocated = malloc(size);
+  if (! allocated)
   {
-    return -1;
+    print_run_error(_("cannot allocate memory !"), data);
   }
 
-  if (s[strlen(s)-2] == '.')
+  return allocated;
+}
+
+//returns NULL and stops the run if we cannot allocate: 'ptr' is then
+//left as it was
+void *my_realloc(void *ptr, size_t size, main_data *data)
+{
+  void *allocated = realloc(ptr, size);
+  if (! allocated)
   {
-    hundredths *= 10;
+    print_run_error(_("cannot allocate memory !"), data);
   }
 
-  hun = hundredths;
-  hun += (minutes*60 + seconds) * 100;
-
-  return hun;
+  return allocated;
 }
 
-//for the moment 2 ways of getting the file and one way to search it
-//freedb get type can be: cddb_cgi or cddb_protocol
-//freedb search type can be: cddb_cgi or web_search
-//query[get=cddb_cgi://freedb2.org/~cddb/cddb.cgi:80,search=cddb_cgi://freedb2.org/~cddb/cddb.cgi:80]
-//query[get=cddb_protocol://freedb.org:8880,search=cddb_cgi://freedb2.org/~cddb/cddb.cgi:80]
-//query[get=cddb_cgi://freedb.org/~cddb/cddb.cgi:80,search=cddb_cgi://freedb2.org/~cddb/cddb.cgi:80]
-//query[get...]{search_string}
-//query[get...]{search_string}(chosen_result_int)
-//we parse the query arguments
-int parse_query_arg(options *opt, const char *query)
+//shows a small mp3splt help and stops the run (with error 1 if the help
+//is printed on the error output); returns -1
+int show_small_help(main_data *data)
 {
-  const char *cur_pos = NULL;
-  const char *end_pos = NULL;
-  const char *test_pos = NULL;
-  cur_pos = query + 5;
-
-  short ambigous = SPLT_FALSE;
+  print_message(_("\n"
+        "USAGE:\n"
+        "      mp3splt [OPTIONS] FILE1 [FILE2] ... [BEGIN_TIME] [TIME] ... [END_TIME]\n"
+        "      TIME FORMAT: min.sec[.0-99], even if minutes are over 59\n"
+        "                   (or EOF for End Of File). "));
+  print_message(_("\nOPTIONS (split mode options)\n"
+        " -t + TIME: to split files every fixed time len. (TIME format same as above). \n"
+        " -c + file.cddb, file.cue or \"query\" or \"query{album}\". Get splitpoints and\n"
+        "      filenames from a .cddb or .cue file or from Internet (\"query\").\n"
+        "      \"discid{file.cue}\" or \"discid{4.05,3.20,...}\": exact lookup of the disc id.\n"
+        "      Use -a to auto-adjust splitpoints."));
+  print_message(_(" -s   Silence detection: automatically find splitpoint. (Use -p for arguments)\n"
+        " -w   Splits wrapped files created with Mp3Wrap or AlbumWrap.\n"
+        " -l   Lists the tracks from file without extraction. (Only for wrapped mp3)\n"
+        " -e   Error mode: split mp3 with sync error detection. (For concatenated mp3)"));
+  print_message(_(" -A + AUDACITY_FILE: split with splitpoints from the audacity labels file"));
+  print_message(_(" -S + SPLIT_NUMBER: split in SPLIT_NUMBER equal time files"));
+  print_message(_(" -i   Count how many silence splitpoints we have with silence detection\n"
+        "      (Use -p for arguments)\n"
+        " -v   Prints current version and exits\n"
+        " -h   Shows this help"));
+  print_message(_("\n(other options)\n"
+        " -T + TAGS_VERSION: for mp3 files, force output tags as version 1, 2 or 1 & 2.\n"
+        "      TAGS_VERSION can be 1, 2 or 12\n"
+        "      (default is to set the same version as the file to split)"));
+  print_message(_(" -m + M3U_FILE: Appends to the specified m3u file the split filenames.\n"
+        " -f   Frame mode (mp3 only): process all frames. For higher precision and VBR.\n"
+        " -a   Auto-Adjust splitpoints with silence detection. (Use -p for arguments)"));
+  print_message(_(" -p + PARAMETERS (th, nt, off, min, rm, gap): user arguments for -s and -a.\n"
+        " -o + FORMAT: output filename pattern. Can contain those variables:\n"
+        "      @a: artist tag, @p: performer tag (might not exists), @b: album tag\n"
+        "      @t: title tag, @n: track number identifier, @N: track tag number\n"
+        "      (a digit may follow the 'n' or 'N' for the number of digits to output),\n"
+        "      @f: original filename, @x: hex digits of a hash of the input file path\n"
+        "      (a digit may follow the 'x' for the number of hex digits, default 2)"));
+  print_message(_(" -g + TAGS: custom tags for the split files.\n"
+        "      TAGS can contain those variables: \n"
+        "         @a, @b, @t, @y, @c, @n, @o (set original tags),\n"
+        "         @N (auto increment track number).\n"
+        "      TAGS format is like [@a=artist1,@t=title1]%[@o,@N=2,@a=artist2]\n"
+        "       (% means that we set the tags for all remaining files)"));
+  print_message(_(" -d + DIRNAME: to put all output files in the directory DIRNAME.\n"
+        " -k   Consider input not seekable (slower). Default when input is STDIN (-).\n"
+        " -O + TIME: Overlap split files with TIME (slower)."));
+  print_message(_(" -n   No Tag: does not write ID3v1 or vorbis comment. If you need clean files.\n"
+        " -x   No Xing header: does not write the Xing header. Use with -n if you wish\n"
+        "      to concatenate the split files\n"
+        " -N   Don't create the 'mp3splt.log' log file when using '-s'."));
+  print_message(_(" -P   Pretend to split: simulation of the process, without creating any\n"
+                  "      files or directories"));
+  print_message(_(" -E + CUE_FILE: export splitpoints to CUE file (use with -P if needed)"));
+  print_message(_(" --splitpoints + FILE: read the splitpoints from FILE ('-' for STDIN),\n"
+        "      one TIME per line"));
+  print_message(_(" --plan + PLAN_FILE: with -P, write the segments to split in PLAN_FILE\n"
+        " --execute-plan + PLAN_FILE: split the segments of PLAN_FILE without analysis"));
+  print_message(_(" --manifest + FILE: write the size, hashes and mp3 frame checks of the created files"));
+  print_message(_(" --loudness: with -s or -i, print the estimated level and peak level of the files"));
+  print_message(_(" --waveform + dat|json: with -s or -i, write the waveform peaks of the input files\n"
+        " --waveform-resolution + N: waveform samples per pixel (one frame by default)"));
+  print_message(_(" --retag: set the tags of -g on the mp3 input files without splitting them"));
+  print_message(_(" --drop-cache: read the input files ahead and remove the input and output files from the cache"));
+  print_message(_(" --concat: split the input files as one file, in the order given"));
+  print_message(_(" --order + size|location: split the largest input files first,\n"
+        "      or in the order of their location on the disk"));
+  print_message(_(" --dedupe + link|copy: split identical input files once and link\n"
+        "      or copy the files created for the other ones"));
+  print_message(_(" --follow: with -s, split a growing file while it is written"));
+  print_message(_(" --watch: split the files dropped in the input directories"));
+  print_message(_(" --watch-jobs + N: with --watch, split up to N files at once"));
+  print_message(_(" --done-dir + DIR, --error-dir + DIR: with --watch, move the split or failed files"));
+  print_message(_(" --adjust-jobs + N: auto-adjust (-a) the splitpoints with N processes (0: the library scans the whole file)"));
+  print_message(_(" --build-cddb-index + DIR: index the xmcd files of the given directories for the local freedb search"));
+  print_message(_(" --trace + FILE: write the timeline of the run as Chrome trace events"));
+  print_message(_(" --prefetch + N: read the next N input files in the background"));
+  print_message(_(" --io-limit + RATE: limit the bytes read and written per second\n"
+        "      (RATE can have a K, M or G suffix, like 50M)\n"
+        " --io-priority + PRIORITY: set the I/O scheduling class of the process:\n"
+        "      'idle', 'be' or 'be:N' (best effort, N from 0 to 7)"));
+  print_message(_(" -q   Quiet mode: try not to prompt (if possible) and print less messages.\n"
+        " -Q   Very quiet mode: don't print anything to stdout and no progress bar\n"
+        "       (also enables -q).\n"
+        " -D   Debug mode: used to debug the program.\n\n"
+        "      Please read man page for complete documentation.\n"));
 
-  //if we have [get=...]
-  if (cur_pos[0] == '[')
+  if (data->console_out == data->console_err)
   {
-    cur_pos = strchr(query,'[');
+    return stop_run(data, 1);
+  }
 
-    //if we don't have ], ambigous
-    if (!(test_pos = strchr(cur_pos,']')))
+  return stop_run(data, 0);
+}
+
+//
+char **rmopt(char **argv, int offset, int tot)
+{
+#ifdef __WIN32__
+  int i = 0;
+  for (i = 0; i < offset;i++)
+  {
+    if (argv[i])
     {
-      ambigous = SPLT_TRUE;
+      free(argv[i]);
+      argv[i] = NULL;
     }
+  }
+#endif
 
-    int search_found = SPLT_FALSE;
-    int get_found = SPLT_FALSE;
-    int paranthesis_has_content = SPLT_FALSE;
-    //we find "get" or "search"
-    while((test_pos = strstr(cur_pos,"get="))||
-        (test_pos = strstr(cur_pos,"search=")))
-    {
-      paranthesis_has_content = SPLT_TRUE;
+  char **first = &argv[1];
+  while (offset < tot)
+  {
+    *first = argv[offset];
+    first++;
+    offset++;
+  }
 
-      //we find out which one is first
-      end_pos = strstr(cur_pos,"get=");
-      test_pos = strstr(cur_pos,"search=");
-      if (end_pos == NULL)
+  return argv;
+}
+
+//parse the -p option
+int parse_arg(char *arg, float *th, int *gap,
+    int *nt, float *off, int *rm, float *min)
+{
+  char *ptr = NULL;
+  int found = 0;
+
+  if ((gap!=NULL) && ((ptr=strstr(arg, "gap"))!=NULL))
+  {
+    if ((ptr=strchr(ptr, '='))!=NULL)
+    {
+      if (sscanf(ptr+1, "%d", gap)==1)
       {
-        cur_pos = test_pos;
+        found++;
       }
-      else
+      else 
       {
-        if (test_pos == NULL)
-        {
-          cur_pos = end_pos;
-        }
-        else
-        {
-          if (end_pos < test_pos)
-          {
-            cur_pos = end_pos;
-          }
-          else
-          {
-            cur_pos = test_pos;
-          }
-        }
+        print_warning(_("bad gap argument. It will be ignored !"));
       }
+    }
+  }
 
-      //we determine the type (get or search)
-      if (strstr(cur_pos,"get=") == cur_pos)
+  if ((th!=NULL) && ((ptr=strstr(arg, "th"))!=NULL))
+  {
+    if ((ptr=strchr(ptr, '='))!=NULL)
+    {
+      if (sscanf(ptr+1, "%f", th)==1)
       {
-        get_found = SPLT_TRUE;
-        search_found = SPLT_FALSE;
-        cur_pos += 4;
+        found++;
       }
-      else
+      else 
       {
-        search_found = SPLT_TRUE;
-        get_found = SPLT_FALSE;
-        cur_pos += 7;
+        print_warning(_("bad threshold argument. It will be ignored !"));
       }
+    }
+  }
 
-      //we get out the type of the search
-      char freedb_type[256] = "\0";
-      if ((end_pos=strstr(cur_pos,"://"))||
-          (end_pos=strchr(cur_pos,',')) ||
-          (end_pos=strchr(cur_pos,']')))
+  if ((nt!=NULL) && ((ptr=strstr(arg, "nt"))!=NULL))
+  {
+    if ((ptr=strchr(ptr, '='))!=NULL)
+    {
+      if (sscanf(ptr+1, "%d", nt)==1)
       {
-        if (end_pos-cur_pos < 255)
-        {
-          snprintf(freedb_type,end_pos-cur_pos+1,"%s",cur_pos);
-          freedb_type[end_pos-cur_pos] = '\0';
-          if ((strchr(cur_pos,',')==end_pos) ||
-              (strchr(cur_pos,']')==end_pos))
-          {
-            cur_pos = end_pos;
-          }
-          else
-          {
-            cur_pos = end_pos+3;
-          }
-          end_pos = cur_pos;
-        }
+        found++;
       }
-      else
+      else 
       {
-        end_pos = cur_pos;
+        print_warning(_("bad tracknumber argument. It will be ignored !"));
       }
+    }
+  }
 
-      //we get out the server
-      char freedb_server[256] = "\0";
-      while ((*end_pos != ':') && (*end_pos != ',') &&
-          (*end_pos != ']') && (*end_pos != '\0'))
+  if (rm!=NULL)
+  {
+    if ((ptr=strstr(arg, "rm"))!=NULL)
+    {
+      found++;
+      *rm = 1;
+    }
+  }
+
+  if ((off!=NULL) && ((ptr=strstr(arg, "off"))!=NULL))
+  {
+    if ((ptr=strchr(ptr, '='))!=NULL)
+    {
+      if (sscanf(ptr+1, "%f", off)==1)
       {
-        end_pos++;
+        found++;
       }
-      if ((end_pos != cur_pos) && (end_pos-cur_pos < 255)
-          && (*end_pos != '\0'))
+      else 
       {
-        snprintf(freedb_server,end_pos-cur_pos+1,"%s",cur_pos);
-        freedb_server[end_pos-cur_pos] = '\0';
-        if (*(end_pos+1) == ']' || *(end_pos+1) == ',')
-        {
-          cur_pos = end_pos+1;
-        }
-        else
-        {
-          cur_pos = end_pos;
-        }
-        end_pos = cur_pos;
+        print_warning(_("bad offset argument. It will be ignored!"));
       }
-      else
+    }
+  }
+
+  if ((min!=NULL) && ((ptr=strstr(arg, "min"))!=NULL))
+  {
+    if ((ptr=strchr(ptr, '='))!=NULL)
+    {
+      if (sscanf(ptr+1, "%f", min)==1)
       {
-        cur_pos = end_pos;
+        found++;
       }
-
-      //we get out the port
-      char freedb_port[10] = "\0";
-      int is_only_digits = SPLT_TRUE;
-      int freedb_int_port = -1;
-      //if we have the port
-      if (*end_pos == ':')
+      else 
       {
-        cur_pos++;
-        end_pos++;
-        while((*end_pos != ']') &&
-            (*end_pos != '\0') &&
-            (*end_pos != ','))
-        {
-          //we have to have only digits for the port
-          if (!isdigit(*end_pos))
-          {
-            ambigous = SPLT_TRUE;
-            is_only_digits = SPLT_FALSE;
-          }
-          end_pos++;
-        }
-        if ((end_pos != cur_pos) && (end_pos-cur_pos < 10))
-        {
-          snprintf(freedb_port,end_pos-cur_pos+1,"%s",cur_pos);
-          freedb_port[end_pos-cur_pos] = '\0';
-          cur_pos = end_pos;
-        }
+        print_warning(_("bad minimum silence length argument. It will be ignored !"));
+      }
+    }
+  }
 
-        //we get the port as integer
-        if (*freedb_port != '\0')
-        {
-          if (is_only_digits)
-          {
-            freedb_int_port = atoi(freedb_port);
-          }
-          else
-          {
-            freedb_int_port = SPLT_FREEDB_CDDB_CGI_PORT;
-            print_warning(_("found non digits characters in port !"
-                  " (switched to default)"));
-          }
-        }
+  return found;
+}
+
+int we_have_incompatible_stdin_option(options *opt)
+{
+  return opt->s_option || opt->w_option ||
+    opt->l_option || opt->e_option ||
+    opt->i_option || opt->a_option ||
+    opt->p_option || opt->S_option;
+}
+
+//check if we have the correct arguments
+int check_args(int argc, main_data *data)
+{
+  options *opt = data->opt;
+
+  if (argc < 2)
+  {
+    data->console_out = data->console_err;
+    return show_small_help(data);
+  }
+  else
+  {
+    //if we want input not seekable (-k)
+    if (opt->k_option)
+    {
+      if (we_have_incompatible_stdin_option(opt))
+      {
+        return print_run_error(_("cannot use -k option (or STDIN) with"
+              " one of the following options: -S -s -w -l -e -i -a -p"), data);
       }
+    }
 
-      //we put the search type as integer
-      int freedb_int_type = -1;
-      if (*freedb_type != '\0')
+    //if we dewrap (-w)
+    if (opt->w_option)
+    {
+      if (opt->t_option || opt->c_option ||
+          opt->s_option || opt->l_option ||
+          opt->e_option || opt->i_option ||
+          opt->f_option || opt->a_option ||
+          opt->p_option || opt->o_option ||
+          opt->g_option || opt->n_option ||
+          opt->x_option || opt->A_option ||
+          opt->E_option || opt->S_option)
       {
-        //get type
-        if (get_found)
-        {
-          if (strcmp(freedb_type,"cddb_protocol") == 0)
-          {
-            freedb_int_type = SPLT_FREEDB_GET_FILE_TYPE_CDDB;
-          }
-          else
-          {
-            if (strcmp(freedb_type,"cddb_cgi") == 0)
-            {
-              freedb_int_type = SPLT_FREEDB_GET_FILE_TYPE_CDDB_CGI;
-            }
-            else
-            {
-              print_warning(_("unknown search type !"
-                    " (switched to default)"));
-            }
-          }
-        }
-        else
-        {
-          //search type
-          if (strcmp(freedb_type,"cddb_cgi") == 0)
-          {
-            freedb_int_type = SPLT_FREEDB_SEARCH_TYPE_CDDB_CGI;
-          }
-          else
-          {
-            if (strcmp(freedb_type,"web_search") == 0)
-            {
-              print_warning(_("freedb web search not implemented yet !"
-                    " (switched to default)"));
-              freedb_int_type = SPLT_FREEDB_SEARCH_TYPE_CDDB_CGI;
-            }
-            else
-            {
-              print_warning(_("unknown get type ! (switched to default)"));
-            }
-          }
-        }
+        return print_run_error(_("the -w option can only be used with -m, -d, -q and -Q"), data);
       }
-      else
+    }
+
+    //if we list wrapped files (-l)
+    if (opt->l_option)
+    {
+      if (opt->t_option || opt->c_option ||
+          opt->s_option || opt->e_option ||
+          opt->i_option || opt->m_option ||
+          opt->f_option || opt->a_option ||
+          opt->p_option || opt->o_option ||
+          opt->g_option || opt->d_option ||
+          opt->n_option || opt->qq_option ||
+          opt->x_option || opt->A_option ||
+          opt->S_option)
       {
-        ambigous = SPLT_TRUE;
+        return print_run_error(_("the -l option can only be used with -q"), data);
       }
+    }
 
-      //if we have found search
-      if (search_found)
+    //error mode (-e)
+    if (opt->e_option)
+    {
+      if (opt->t_option || opt->c_option || 
+          opt->s_option || opt->i_option || 
+          opt->a_option || opt->p_option ||
+          opt->g_option || opt->n_option ||
+          opt->A_option || opt->E_option ||
+          opt->S_option)
       {
-        if (freedb_int_type != -1)
-        {
-          opt->freedb_search_type = freedb_int_type;
-        }
-        if (*freedb_server != '\0')
-        {
-          snprintf(opt->freedb_search_server,255, "%s",freedb_server);
-        }
-        else
-        {
-          snprintf(opt->freedb_search_server,255, "%s",SPLT_FREEDB2_CGI_SITE);
-        }
-        if (freedb_int_port != -1)
-        {
-          opt->freedb_search_port = freedb_int_port;
-        }
+        return print_run_error(_("the -e option can only be used with -m, -f, -o, -d, -q, -Q"), data);
       }
-      else
+    }
+
+    //frame mode (-f)
+    if (opt->f_option)
+    {
+    }
+
+    //cddb/cue/freedb (-c)
+    if (opt->c_option)
+    {
+      if (opt->t_option || opt->s_option ||
+          opt->i_option || opt->g_option ||
+          opt->A_option || opt->S_option)
       {
-        //if we have found get
-        if (get_found)
-        {
-          if (freedb_int_type != -1)
-          {
-            opt->freedb_get_type = freedb_int_type;
-          }
-          if (*freedb_server != '\0')
-          {
-            snprintf(opt->freedb_get_server,255, "%s", freedb_server);
-          }
-          else
-          {
-            snprintf(opt->freedb_get_server,255, "%s", SPLT_FREEDB2_CGI_SITE);
-          }
-          if (freedb_int_port != -1)
-          {
-            opt->freedb_get_port = freedb_int_port;
-          }
-        }
+        return print_run_error(_("the -c option cannot be used with -t, -g, -s, -A, -i or -S"), data);
       }
+    }
 
-      //if at the and something else than , or ], ambigous
-      if ((*cur_pos != ',') &&
-          (*cur_pos != ']') &&
-          (*cur_pos != '\0'))
+    if (opt->A_option)
+    {
+      if (opt->t_option || opt->s_option || opt->i_option || opt->S_option)
       {
-        ambigous = SPLT_TRUE;
+        return print_run_error(_("the -A option cannot be used with -t, -s, -i or -S"), data);
       }
     }
-    //if we don't have anything inside the paranthesis,
-    //ambigous
-    if (!paranthesis_has_content)
+
+    //time split (-t)
+    if (opt->t_option)
     {
-      ambigous = SPLT_TRUE;
+      if (opt->s_option || opt->i_option || opt->S_option)
+      {
+        return print_run_error(_("the -t option cannot be used with -s, -i or -S"), data);
+      }
+    }
+
+    //silence split (-s)
+    if (opt->s_option)
+    {
+      if (opt->a_option || opt->i_option || opt->S_option)
+      {
+        return print_run_error(_("-s option cannot be used with -a, -i or -S"), data);
+      }
+    }
+
+    //auto adjust option (-a)
+    if (opt->a_option)
+    {
+      if (opt->i_option)
+      {
+        return print_run_error(_("-a option cannot be used with -i"), data);
+      }
+    }
+    else if (opt->adjust_jobs >= 0)
+    {
+      return print_run_error(_("the --adjust-jobs option must be used with -a"), data);
     }
+
+    if (opt->S_option)
+    {
+    }
+
+    //parameters (-p)
+    if (opt->p_option)
+    {
+      if (!opt->a_option && !opt->s_option && !opt->i_option)
+      {
+        return print_run_error(_("the -p option cannot be used without -a, -s or -i"), data);
+      }
+    }
+
+    //output format (-o)
+    if (opt->o_option)
+    {
+      if (opt->i_option)
+      {
+        return print_run_error(_("the -o option cannot be used with -i"), data);
+      }
+      if (opt->output_format)
+      {
+        if ((strcmp(opt->output_format,"-") == 0) && (opt->m_option || opt->d_option))
+        {
+          return print_run_error(_("cannot use '-o -' (STDOUT) with -m or -d"), data);
+        }
+      }
+    }
+
+    //custom tags (-g)
+    if (opt->g_option)
+    {
+      if (opt->i_option || opt->n_option)
+      {
+        return print_run_error(_("the -g option cannot be used with -n or -i"), data);
+      }
+    }
+
+    //directory (-d)
+    if (opt->d_option)
+    {
+      if (opt->i_option)
+      {
+        return print_run_error(_("the -d option cannot be used with -i"), data);
+      }
+    }
+
+    //no tags (-n)
+    if (opt->n_option)
+    {
+      if (opt->i_option || opt->T_option)
+      {
+        return print_run_error(_("the -n option cannot be used with -i or -T"), data);
+      }
+    }
+
+    //generate m3u file (-m)
+    if (opt->m_option)
+    {
+      if (opt->i_option)
+      {
+        return print_run_error(_("the -m option cannot be used with -i"), data);
+      }
+    }
+
+    //count silence splitpoints (-i)
+    if (opt->i_option)
+    {
+    }
+
+    //quiet mode (-q)
+    if (opt->q_option)
+    {
+    }
+
+    //very quiet mode (-Q)
+    if (opt->qq_option)
+    {
+      if (opt->o_option)
+      {
+        if (strcmp(opt->output_format,"-") == 0)
+        {
+          return print_run_error(_("the -Q option cannot be used with"
+              " STDOUT output ('-o -')"), data);
+        }
+      }
+      if (opt->c_option)
+      {
+        if (strncmp(opt->cddb_arg,"query",5) == 0)
+        {
+          return print_run_error(_("the -Q option cannot be used with"
+              " interactive freedb query ('-c query')"), data);
+        }
+      }
+    }
+
+    if (opt->N_option)
+    {
+      if (!opt->s_option)
+      {
+        return print_run_error(_("the -N option must be used with"
+            " silence detection (-s option)"), data);
+      }
+    }
+
+    if (opt->O_option)
+    {
+      if (opt->w_option || opt->e_option ||
+          opt->l_option || opt->i_option)
+      {
+        return print_run_error(_("the -O option cannot be used with"
+            " -w, -e, -l or -i"), data);
+      }
+    }
+
+    if (opt->x_option)
+    {
+    }
+
+    if (opt->loudness_option)
+    {
+      //-a only decodes the gaps around the splitpoints, not the whole file
+      if (opt->a_option)
+      {
+        return print_run_error(_("the --loudness option cannot be used with -a:"
+              " the auto-adjust only scans the gaps around the splitpoints"),
+            data);
+      }
+      if (!opt->s_option && !opt->i_option)
+      {
+        return print_run_error(_("the --loudness option must be used with"
+              " the silence option (-s) or the count option (-i)"), data);
+      }
+    }
+
+    if (opt->retag_option)
+    {
+      if (!opt->g_option || !opt->custom_tags)
+      {
+        return print_run_error(_("the --retag option must be used with"
+              " the custom tags option (-g)"), data);
+      }
+      if (opt->l_option || opt->i_option || opt->c_option ||
+          opt->e_option || opt->t_option || opt->w_option ||
+          opt->s_option || opt->A_option || opt->S_option ||
+          opt->a_option || opt->p_option || opt->o_option ||
+          opt->d_option || opt->m_option || opt->E_option ||
+          opt->O_option || opt->plan_arg || opt->execute_plan_arg ||
+          opt->splitpoints_file_arg || opt->manifest_arg)
+      {
+        return print_run_error(_("the --retag option can only be used with"
+              " -g, -P, -q, -Q and -D"), data);
+      }
+    }
+
+    if (opt->waveform_arg)
+    {
+      if (!opt->s_option && !opt->i_option)
+      {
+        return print_run_error(_("the --waveform option must be used with"
+              " the silence option (-s) or the count option (-i)"), data);
+      }
+    }
+
+    if (opt->plan_arg)
+    {
+      if (!opt->P_option)
+      {
+        return print_run_error(_("the --plan option must be used with"
+              " the pretend option (-P)"), data);
+      }
+      if (opt->l_option || opt->i_option || opt->w_option || opt->e_option)
+      {
+        return print_run_error(_("the --plan option cannot be used with"
+              " -w, -l, -e or -i"), data);
+      }
+    }
+
+    if (opt->execute_plan_arg)
+    {
+      if (opt->l_option || opt->i_option || opt->c_option ||
+          opt->e_option || opt->t_option || opt->w_option ||
+          opt->s_option || opt->A_option || opt->S_option ||
+          opt->a_option || opt->p_option || opt->o_option ||
+          opt->d_option || opt->g_option || opt->O_option ||
+          opt->plan_arg || opt->splitpoints_file_arg)
+      {
+        //the ends in the plan already include the overlap of -O
+        return print_run_error(_("the --execute-plan option can only be used with"
+              " -f, -k, -n, -x, -T, -P, -m, -q, -Q and -D"), data);
+      }
+    }
+
+    if (opt->follow_option)
+    {
+      if (!opt->s_option)
+      {
+        return print_run_error(_("the --follow option must be used with"
+              " the silence option (-s)"), data);
+      }
+      if (opt->l_option || opt->i_option || opt->c_option ||
+          opt->e_option || opt->t_option || opt->w_option ||
+          opt->A_option || opt->S_option || opt->a_option ||
+          opt->E_option || opt->O_option || opt->concat_option ||
+          opt->retag_option || opt->dedupe_arg || opt->order_arg ||
+          opt->plan_arg || opt->execute_plan_arg || opt->loudness_option ||
+          opt->waveform_arg || opt->splitpoints_file_arg)
+      {
+        return print_run_error(_("the --follow option can only be used with"
+              " -s, -p, -o, -d, -m, -f, -n, -x, -T, -g, -P, -q, -Q, -D and --manifest"), data);
+      }
+    }
+
+    if (opt->cddb_index_arg)
+    {
+      if (opt->l_option || opt->i_option || opt->c_option ||
+          opt->e_option || opt->t_option || opt->w_option ||
+          opt->s_option || opt->A_option || opt->S_option ||
+          opt->retag_option || opt->follow_option || opt->watch_option ||
+          opt->concat_option || opt->execute_plan_arg)
+      {
+        return print_run_error(_("the --build-cddb-index option cannot be used with"
+              " -c, -t, -s, -A, -S, -w, -l, -e, -i, --retag, --follow, --watch,"
+              " --concat or --execute-plan"), data);
+      }
+    }
+
+    if (opt->watch_option)
+    {
+      if (!opt->d_option)
+      {
+        return print_run_error(_("the --watch option must be used with -d, outside"
+              " the watched directories"), data);
+      }
+      if (opt->m_option || opt->E_option || opt->manifest_arg ||
+          opt->plan_arg || opt->execute_plan_arg || opt->concat_option ||
+          opt->follow_option || opt->retag_option || opt->dedupe_arg ||
+          opt->order_arg)
+      {
+        return print_run_error(_("the --watch option cannot be used with -m, -E,"
+              " --manifest, --plan, --execute-plan, --concat, --follow,"
+              " --retag, --dedupe or --order"), data);
+      }
+    }
+    else if ((opt->watch_jobs != 1) || opt->done_dir_arg || opt->error_dir_arg)
+    {
+      return print_run_error(_("the --watch-jobs, --done-dir and --error-dir options"
+            " must be used with --watch"), data);
+    }
+
+    if (opt->done_dir_arg && !mp3splt_u_check_if_directory(opt->done_dir_arg))
+    {
+      return print_run_error(_("the --done-dir directory does not exist"), data);
+    }
+    if (opt->error_dir_arg && !mp3splt_u_check_if_directory(opt->error_dir_arg))
+    {
+      return print_run_error(_("the --error-dir directory does not exist"), data);
+    }
+
+    if (opt->dedupe_arg)
+    {
+      if (opt->l_option || opt->i_option || opt->P_option || opt->E_option ||
+          opt->concat_option || opt->retag_option || opt->loudness_option ||
+          opt->waveform_arg ||
+          (opt->output_format && (strcmp(opt->output_format, "-") == 0)))
+      {
+        return print_run_error(_("the --dedupe option cannot be used with -l, -i, -P, -E,"
+              " -o -, --concat, --retag, --loudness or --waveform"), data);
+      }
+    }
+
+    if (opt->order_arg && (opt->concat_option || opt->retag_option))
+    {
+      return print_run_error(_("the --order option cannot be used with"
+            " --concat or --retag"), data);
+    }
+
+    if (opt->concat_option)
+    {
+      if (we_have_incompatible_stdin_option(opt) || opt->plan_arg ||
+          opt->execute_plan_arg || opt->retag_option)
+      {
+        return print_run_error(_("the --concat option cannot be used with"
+              " -S -s -w -l -e -i -a -p, --plan, --execute-plan or --retag"), data);
+      }
+    }
+
+#ifdef MP3SPLT_EMBEDDED
+    //they change the process running the program linking mp3splt
+    if (opt->concat_option || opt->watch_option)
+    {
+      return print_run_error(_("--concat and --watch are only available"
+            " from the mp3splt program"), data);
+    }
+#endif
+
+    if (opt->splitpoints_file_arg)
+    {
+      if (opt->l_option || opt->i_option || opt->c_option ||
+          opt->e_option || opt->t_option || opt->w_option ||
+          opt->s_option || opt->A_option || opt->S_option)
+      {
+        return print_run_error(_("the --splitpoints option cannot be used with"
+              " -c, -t, -s, -A, -S, -w, -l, -e or -i"), data);
+      }
+    }
+
+    if (opt->T_option)
+    {
+      int force_tags_version = opt->T_option_value;
+      if ((force_tags_version != 1) && (force_tags_version != 2) &&
+          (force_tags_version != 12))
+      {
+        return print_run_error("the -T option can only have values 1, 2 or 12", data);
+      }
+    }
+  }
+
+  return 0;
+}
+
+//prints a confirmation error that comes from the library; returns -1 and
+//stops the run if it is an error
+int process_confirmation_error(int conf, main_data *data)
+{
+  char *error_from_library = NULL;
+  error_from_library = mp3splt_get_strerror(data->state, conf);
+  if (error_from_library != NULL)
+  {
+    if (conf >= 0)
+    {
+      print_message(error_from_library);
+      free(error_from_library);
+    }
+    else
+    {
+      fprintf(data->console_err,"%s\n",error_from_library);
+      fflush(data->console_err);
+      free(error_from_library);
+      return stop_run(data, 1);
+    }
+    error_from_library = NULL;
+  }
+  if (conf == SPLT_DEWRAP_OK)
+  {
+    print_message(_("\nAll files have been split correctly."
+          " Visit http://mp3wrap.sourceforge.net!"));
+  }
+
+  return 0;
+}
+
+//returns the converted string s in hundredth of seconds
+//returns -1 if it cannot convert
+long c_hundreths(const char *s)
+{
+  long minutes=0, seconds=0, hundredths=0, i;
+  long hun = -1;
+  long length = strlen(s);
+
+  if (strcmp(s,"EOF") == 0)
+  {
+    return LONG_MAX;
+  }
+
+  for(i=0; i<length; i++) // Some checking
+  {
+    if ((s[i]<0x30 || s[i] > 0x39) && (s[i]!='.'))
+    {
+      return -1;
+    }
+  }
+
+  if (sscanf(s, "%ld.%ld.%ld", &minutes, &seconds, &hundredths) < 2)
+  {
+    return -1;
+  }
+
+  if ((minutes < 0) || (seconds < 0) || (hundredths < 0))
+  {
+    return -1;
+  }
+
+  if ((seconds > 59) || (hundredths > 99))
+  {
+    return -1;
+  }
+
+  if (s[length-2] == '.')
+  {
+    hundredths *= 10;
+  }
+
+  hun = hundredths;
+  hun += (minutes*60 + seconds) * 100;
+
+  return hun;
+}
+
+//for the moment 2 ways of getting the file and one way to search it
+//freedb get type can be: cddb_cgi or cddb_protocol
+//freedb search type can be: cddb_cgi or web_search
+//query[get=cddb_cgi://freedb2.org/~cddb/cddb.cgi:80,search=cddb_cgi://freedb2.org/~cddb/cddb.cgi:80]
+//query[get=cddb_protocol://freedb.org:8880,search=cddb_cgi://freedb2.org/~cddb/cddb.cgi:80]
+//query[get=cddb_cgi://freedb.org/~cddb/cddb.cgi:80,search=cddb_cgi://freedb2.org/~cddb/cddb.cgi:80]
+//query[get...]{search_string}
+//query[get...]{search_string}(chosen_result_int)
+//we parse the query arguments
+int parse_query_arg(options *opt, const char *query)
+{
+  const char *cur_pos = NULL;
+  const char *end_pos = NULL;
+  const char *test_pos = NULL;
+  //after "query" or "discid"
+  cur_pos = query + strcspn(query, "[{(");
+
+  short ambigous = SPLT_FALSE;
+
+  //if we have [get=...]
+  if (cur_pos[0] == '[')
+  {
+    cur_pos = strchr(query,'[');
+
+    //if we don't have ], ambigous
+    if (!(test_pos = strchr(cur_pos,']')))
+    {
+      ambigous = SPLT_TRUE;
+    }
+
+    int search_found = SPLT_FALSE;
+    int get_found = SPLT_FALSE;
+    int paranthesis_has_content = SPLT_FALSE;
+    //we find "get" or "search"
+    while((test_pos = strstr(cur_pos,"get="))||
+        (test_pos = strstr(cur_pos,"search=")))
+    {
+      paranthesis_has_content = SPLT_TRUE;
+
+      //we find out which one is first
+      end_pos = strstr(cur_pos,"get=");
+      test_pos = strstr(cur_pos,"search=");
+      if (end_pos == NULL)
+      {
+        cur_pos = test_pos;
+      }
+      else
+      {
+        if (test_pos == NULL)
+        {
+          cur_pos = end_pos;
+        }
+        else
+        {
+          if (end_pos < test_pos)
+          {
+            cur_pos = end_pos;
+          }
+          else
+          {
+            cur_pos = test_pos;
+          }
+        }
+      }
+
+      //we determine the type (get or search)
+      if (strstr(cur_pos,"get=") == cur_pos)
+      {
+        get_found = SPLT_TRUE;
+        search_found = SPLT_FALSE;
+        cur_pos += 4;
+      }
+      else
+      {
+        search_found = SPLT_TRUE;
+        get_found = SPLT_FALSE;
+        cur_pos += 7;
+      }
+
+      //we get out the type of the search
+      char freedb_type[256] = "\0";
+      if ((end_pos=strstr(cur_pos,"://"))||
+          (end_pos=strchr(cur_pos,',')) ||
+          (end_pos=strchr(cur_pos,']')))
+      {
+        if (end_pos-cur_pos < 255)
+        {
+          snprintf(freedb_type,end_pos-cur_pos+1,"%s",cur_pos);
+          freedb_type[end_pos-cur_pos] = '\0';
+          if ((strchr(cur_pos,',')==end_pos) ||
+              (strchr(cur_pos,']')==end_pos))
+          {
+            cur_pos = end_pos;
+          }
+          else
+          {
+            cur_pos = end_pos+3;
+          }
+          end_pos = cur_pos;
+        }
+      }
+      else
+      {
+        end_pos = cur_pos;
+      }
+
+      //we get out the server
+      char freedb_server[256] = "\0";
+      while ((*end_pos != ':') && (*end_pos != ',') &&
+          (*end_pos != ']') && (*end_pos != '\0'))
+      {
+        end_pos++;
+      }
+      if ((end_pos != cur_pos) && (end_pos-cur_pos < 255)
+          && (*end_pos != '\0'))
+      {
+        snprintf(freedb_server,end_pos-cur_pos+1,"%s",cur_pos);
+        freedb_server[end_pos-cur_pos] = '\0';
+        if (*(end_pos+1) == ']' || *(end_pos+1) == ',')
+        {
+          cur_pos = end_pos+1;
+        }
+        else
+        {
+          cur_pos = end_pos;
+        }
+        end_pos = cur_pos;
+      }
+      else
+      {
+        cur_pos = end_pos;
+      }
+
+      //we get out the port
+      char freedb_port[10] = "\0";
+      int is_only_digits = SPLT_TRUE;
+      int freedb_int_port = -1;
+      //if we have the port
+      if (*end_pos == ':')
+      {
+        cur_pos++;
+        end_pos++;
+        while((*end_pos != ']') &&
+            (*end_pos != '\0') &&
+            (*end_pos != ','))
+        {
+          //we have to have only digits for the port
+          if (!isdigit(*end_pos))
+          {
+            ambigous = SPLT_TRUE;
+            is_only_digits = SPLT_FALSE;
+          }
+          end_pos++;
+        }
+        if ((end_pos != cur_pos) && (end_pos-cur_pos < 10))
+        {
+          snprintf(freedb_port,end_pos-cur_pos+1,"%s",cur_pos);
+          freedb_port[end_pos-cur_pos] = '\0';
+          cur_pos = end_pos;
+        }
+
+        //we get the port as integer
+        if (*freedb_port != '\0')
+        {
+          if (is_only_digits)
+          {
+            freedb_int_port = atoi(freedb_port);
+          }
+          else
+          {
+            freedb_int_port = SPLT_FREEDB_CDDB_CGI_PORT;
+            print_warning(_("found non digits characters in port !"
+                  " (switched to default)"));
+          }
+        }
+      }
+
+      //we put the search type as integer
+      int freedb_int_type = -1;
+      if (*freedb_type != '\0')
+      {
+        //get type
+        if (get_found)
+        {
+          if (strcmp(freedb_type,"cddb_protocol") == 0)
+          {
+            freedb_int_type = SPLT_FREEDB_GET_FILE_TYPE_CDDB;
+          }
+          else
+          {
+            if (strcmp(freedb_type,"cddb_cgi") == 0)
+            {
+              freedb_int_type = SPLT_FREEDB_GET_FILE_TYPE_CDDB_CGI;
+            }
+            else if (strcmp(freedb_type,"local") == 0)
+            {
+              freedb_int_type = MP3SPLT_LOCAL_CDDB_TYPE;
+            }
+            else
+            {
+              print_warning(_("unknown search type !"
+                    " (switched to default)"));
+            }
+          }
+        }
+        else
+        {
+          //search type
+          if (strcmp(freedb_type,"cddb_cgi") == 0)
+          {
+            freedb_int_type = SPLT_FREEDB_SEARCH_TYPE_CDDB_CGI;
+          }
+          else if (strcmp(freedb_type,"local") == 0)
+          {
+            freedb_int_type = MP3SPLT_LOCAL_CDDB_TYPE;
+          }
+          else
+          {
+            if (strcmp(freedb_type,"web_search") == 0)
+            {
+              print_warning(_("freedb web search not implemented yet !"
+                    " (switched to default)"));
+              freedb_int_type = SPLT_FREEDB_SEARCH_TYPE_CDDB_CGI;
+            }
+            else
+            {
+              print_warning(_("unknown get type ! (switched to default)"));
+            }
+          }
+        }
+      }
+      else
+      {
+        ambigous = SPLT_TRUE;
+      }
+
+      //if we have found search
+      if (search_found)
+      {
+        if (freedb_int_type != -1)
+        {
+          opt->freedb_search_type = freedb_int_type;
+        }
+        if (*freedb_server != '\0')
+        {
+          snprintf(opt->freedb_search_server,255, "%s",freedb_server);
+        }
+        else
+        {
+          snprintf(opt->freedb_search_server,255, "%s",SPLT_FREEDB2_CGI_SITE);
+        }
+        if (freedb_int_port != -1)
+        {
+          opt->freedb_search_port = freedb_int_port;
+        }
+      }
+      else
+      {
+        //if we have found get
+        if (get_found)
+        {
+          if (freedb_int_type != -1)
+          {
+            opt->freedb_get_type = freedb_int_type;
+          }
+          if (*freedb_server != '\0')
+          {
+            snprintf(opt->freedb_get_server,255, "%s", freedb_server);
+          }
+          else
+          {
+            snprintf(opt->freedb_get_server,255, "%s", SPLT_FREEDB2_CGI_SITE);
+          }
+          if (freedb_int_port != -1)
+          {
+            opt->freedb_get_port = freedb_int_port;
+          }
+        }
+      }
+
+      //if at the and something else than , or ], ambigous
+      if ((*cur_pos != ',') &&
+          (*cur_pos != ']') &&
+          (*cur_pos != '\0'))
+      {
+        ambigous = SPLT_TRUE;
+      }
+    }
+    //if we don't have anything inside the paranthesis,
+    //ambigous
+    if (!paranthesis_has_content)
+    {
+      ambigous = SPLT_TRUE;
+    }
+  }
+
+  //possible search string
+  int we_have_search_string = SPLT_FALSE;
+  if (cur_pos != NULL)
+  {
+    if ((cur_pos = strchr(cur_pos, '{')))
+    {
+      //if we don't have }, ambigous
+      if (!(end_pos = strchr(cur_pos,'}')))
+      {
+        ambigous = SPLT_TRUE;
+      }
+      else
+      {
+        if (end_pos-cur_pos < 2048)
+        {
+          snprintf(opt->freedb_arg_search_string, end_pos-cur_pos, "%s", cur_pos+1);
+          opt->freedb_arg_search_string[end_pos-cur_pos-1] = '\0';
+          we_have_search_string = SPLT_TRUE;
+        }
+      }
+    }
+
+    if (ambigous)
+    {
+      return ambigous;
+    }
+  }
+
+  //possible get result integer from the search results
+  if (cur_pos != NULL)
+  {
+    if ((cur_pos = strchr(cur_pos, '(')))
+    {
+      if (!we_have_search_string)
+      {
+        return ambigous;
+      }
+  
+      //if we don't have ), ambigous
+      if (!(end_pos = strchr(cur_pos,')')))
+      {
+        ambigous = SPLT_TRUE;
+      }
+      else
+      {
+        char chosen_int[256] = { '\0' };
+        if (end_pos-cur_pos < 256)
+        {
+          snprintf(chosen_int, end_pos-cur_pos, "%s", cur_pos+1);
+          opt->freedb_arg_result_option = atoi(chosen_int);
+        }
+      }
+    }
+  }
+
+  return ambigous;
+}
+
+//copies the next indexed word of 'text' (lowercase letters and digits,
+//at least 2 characters) to 'word' and moves 'position' after it;
+//returns SPLT_FALSE when there are no more words
+int get_next_local_cddb_word(const char **position, char *word)
+{
+  const char *text = *position;
+  while (*text)
+  {
+    while (*text && !isalnum((unsigned char) *text) &&
+        ((unsigned char) *text < 0x80))
+    {
+      text++;
+    }
+
+    int length = 0;
+    while (*text && (isalnum((unsigned char) *text) ||
+          ((unsigned char) *text >= 0x80)))
+    {
+      if (length < MP3SPLT_LOCAL_CDDB_WORD_SIZE - 1)
+      {
+        word[length++] = tolower((unsigned char) *text);
+      }
+      text++;
+    }
+    word[length] = '\0';
+
+    if (length >= 2)
+    {
+      *position = text;
+      return SPLT_TRUE;
+    }
+  }
+
+  *position = text;
+  return SPLT_FALSE;
+}
+
+//opens the file 'name' of the local cddb index 'index'
+FILE *open_local_cddb_file(const char *index, const char *name, const char *mode)
+{
+  size_t size = strlen(index) + strlen(name) + 2;
+  char *filename = malloc(size);
+  if (!filename)
+  {
+    return NULL;
+  }
+  snprintf(filename, size, "%s%c%s", index, SPLT_DIRCHAR, name);
+
+  FILE *file = fopen(filename, mode);
+  free(filename);
+
+  return file;
+}
+
+//reads the line at 'offset' without its newline; returns SPLT_FALSE at
+//the end of the file
+int read_local_cddb_line(FILE *file, long offset, char *line)
+{
+  if ((fseek(file, offset, SEEK_SET) != 0) ||
+      !fgets(line, MP3SPLT_LOCAL_CDDB_LINE_SIZE, file))
+  {
+    return SPLT_FALSE;
+  }
+  line[strcspn(line, "\r\n")] = '\0';
+
+  return SPLT_TRUE;
+}
+
+//compares the key of an index line (before the tab) with 'key'
+int compare_local_cddb_key(const char *line, const char *key)
+{
+  size_t length = strcspn(line, "\t");
+  int result = strncmp(line, key, length);
+  if (result != 0)
+  {
+    return result;
+  }
+
+  return (key[length] == '\0') ? 0 : -1;
+}
+
+//returns the offset of the first line of the sorted index file having a
+//key greater than or equal to 'key', by bisecting the bytes of the file
+long find_local_cddb_line(FILE *file, const char *key, char *line)
+{
+  fseek(file, 0, SEEK_END);
+  long low = 0;
+  long high = ftell(file);
+
+  //the lines starting before 'low' are before 'key', the lines starting
+  //at or after 'high' are not
+  while (low < high)
+  {
+    long middle = low + (high - low) / 2;
+
+    //the first line starting at or after 'middle'
+    long line_start = middle;
+    if (middle > 0)
+    {
+      fseek(file, middle - 1, SEEK_SET);
+      int c = 0;
+      while (((c = fgetc(file)) != EOF) && (c != '\n'))
+      {
+      }
+      line_start = ftell(file);
+    }
+
+    if ((line_start >= high) || !read_local_cddb_line(file, line_start, line))
+    {
+      high = middle;
+    }
+    else if (compare_local_cddb_key(line, key) < 0)
+    {
+      low = ftell(file);
+    }
+    else
+    {
+      high = line_start;
+    }
+  }
+
+  return low;
+}
+
+//puts in 'postings' the sorted offsets of the discs file following 'key'
+//in the index file (words or discids); returns -1 if we cannot allocate
+int get_local_cddb_postings(main_data *data, FILE *file, const char *key,
+    long **postings, int *number_of_postings)
+{
+  char line[MP3SPLT_LOCAL_CDDB_LINE_SIZE] = { '\0' };
+  int capacity = 0;
+  *postings = NULL;
+  *number_of_postings = 0;
+
+  long offset = find_local_cddb_line(file, key, line);
+  fseek(file, offset, SEEK_SET);
+  while (fgets(line, MP3SPLT_LOCAL_CDDB_LINE_SIZE, file) &&
+      (compare_local_cddb_key(line, key) == 0))
+  {
+    if (*number_of_postings >= capacity)
+    {
+      capacity = (capacity > 0) ? capacity * 2 : 64;
+      long *grown = my_realloc(*postings, sizeof(long) * capacity, data);
+      if (!grown)
+      {
+        free(*postings);
+        *postings = NULL;
+        *number_of_postings = 0;
+        return -1;
+      }
+      *postings = grown;
+    }
+    (*postings)[*number_of_postings] = atol(line + strlen(key) + 1);
+    (*number_of_postings)++;
+  }
+
+  return 0;
+}
+
+//splits the tab separated fields of an index line in place; returns the
+//number of fields
+int split_local_cddb_line(char *line, char **fields, int max_fields)
+{
+  int number_of_fields = 0;
+  char *field = line;
+  while (field && (number_of_fields < max_fields))
+  {
+    fields[number_of_fields++] = field;
+    field = strchr(field, '\t');
+    if (field)
+    {
+      *field++ = '\0';
+    }
+  }
+
+  return number_of_fields;
+}
+
+//SPLT_TRUE if the search string is a disc id (8 hexadecimal digits)
+int is_local_cddb_disc_id(const char *search)
+{
+  while (isspace((unsigned char) *search))
+  {
+    search++;
+  }
+  int length = 0;
+  while (isxdigit((unsigned char) search[length]))
+  {
+    length++;
+  }
+  const char *end = search + length;
+  while (isspace((unsigned char) *end))
+  {
+    end++;
+  }
+
+  return (length == 8) && (*end == '\0');
+}
+
+//searches the cds having all the words of 'search' in their artist and
+//title, or the cds of a disc id, in the index built with
+//--build-cddb-index; returns -1 on error
+int search_local_cddb(main_data *data, const char *index, const char *search)
+{
+  char line[MP3SPLT_LOCAL_CDDB_LINE_SIZE] = { '\0' };
+  char message[1024] = { '\0' };
+
+  FILE *discs = open_local_cddb_file(index, MP3SPLT_LOCAL_CDDB_DISCS, "rb");
+  if (!discs || !read_local_cddb_line(discs, 0, line) ||
+      (strcmp(line, MP3SPLT_LOCAL_CDDB_HEADER) != 0))
+  {
+    if (discs)
+    {
+      fclose(discs);
+    }
+    snprintf(message, 1024, _("'%s' is not a cddb index"
+          " (see --build-cddb-index)"), index);
+    return print_run_error(message, data);
+  }
+
+  long *offsets = NULL;
+  int number_of_offsets = 0;
+  int result = 0;
+  char word[MP3SPLT_LOCAL_CDDB_WORD_SIZE] = { '\0' };
+  if (is_local_cddb_disc_id(search))
+  {
+    FILE *discids = open_local_cddb_file(index, MP3SPLT_LOCAL_CDDB_DISCIDS, "rb");
+    if (discids)
+    {
+      const char *position = search;
+      get_next_local_cddb_word(&position, word);
+      result = get_local_cddb_postings(data, discids, word, &offsets,
+          &number_of_offsets);
+      fclose(discids);
+    }
+  }
+  else
+  {
+    FILE *words = open_local_cddb_file(index, MP3SPLT_LOCAL_CDDB_WORDS, "rb");
+    const char *position = search;
+    int first_word = SPLT_TRUE;
+    //the cds having all the words
+    while (words && (result == 0) &&
+        get_next_local_cddb_word(&position, word))
+    {
+      int number_of_postings = 0;
+      long *postings = NULL;
+      result = get_local_cddb_postings(data, words, word, &postings,
+          &number_of_postings);
+      if (first_word)
+      {
+        offsets = postings;
+        number_of_offsets = number_of_postings;
+        first_word = SPLT_FALSE;
+        continue;
+      }
+
+      int i = 0, j = 0, kept = 0;
+      while ((i < number_of_offsets) && (j < number_of_postings))
+      {
+        if (offsets[i] < postings[j])
+        {
+          i++;
+        }
+        else if (offsets[i] > postings[j])
+        {
+          j++;
+        }
+        else
+        {
+          offsets[kept++] = offsets[i];
+          i++;
+          j++;
+        }
+      }
+      number_of_offsets = kept;
+      free(postings);
+    }
+    if (words)
+    {
+      fclose(words);
+    }
+  }
+  if (result == -1)
+  {
+    free(offsets);
+    fclose(discs);
+    return -1;
+  }
+
+  if (number_of_offsets > MP3SPLT_LOCAL_CDDB_MAX_RESULTS)
+  {
+    snprintf(message, 1024, _("%d cds found, only the first %d are shown"),
+        number_of_offsets, MP3SPLT_LOCAL_CDDB_MAX_RESULTS);
+    print_warning(message);
+    number_of_offsets = MP3SPLT_LOCAL_CDDB_MAX_RESULTS;
+  }
+
+  local_cddb_results *local = my_malloc(sizeof(local_cddb_results), data);
+  if (local)
+  {
+    local->results.results =
+      my_malloc(sizeof(splt_freedb_one_result) * (number_of_offsets + 1), data);
+    local->results.number = 0;
+    local->files = local->results.results ?
+      my_malloc(sizeof(char *) * (number_of_offsets + 1), data) : NULL;
+  }
+  if (!local || !local->files)
+  {
+    if (local)
+    {
+      free(local->results.results);
+      free(local);
+    }
+    free(offsets);
+    fclose(discs);
+    return -1;
+  }
+  data->local_cddb = local;
+
+  int i = 0;
+  for (i = 0; i < number_of_offsets; i++)
+  {
+    //disc id, category, artist and title, xmcd file
+    char *fields[4] = { NULL };
+    if (!read_local_cddb_line(discs, offsets[i], line) ||
+        (split_local_cddb_line(line, fields, 4) != 4))
+    {
+      continue;
+    }
+
+    char name[MP3SPLT_LOCAL_CDDB_LINE_SIZE] = { '\0' };
+    snprintf(name, MP3SPLT_LOCAL_CDDB_LINE_SIZE, "%s [%s %s]",
+        fields[2], fields[1], fields[0]);
+
+    splt_freedb_one_result *result =
+      &local->results.results[local->results.number];
+    result->id = local->results.number;
+    result->name = strdup(name);
+    result->revision_number = 0;
+    result->revisions = NULL;
+    local->files[local->results.number] = strdup(fields[3]);
+    local->results.number++;
+  }
+  free(offsets);
+  fclose(discs);
+
+  if (local->results.number == 0)
+  {
+    return print_run_error(_("no cd found in the local cddb index"), data);
+  }
+
+  return 0;
+}
+
+//copies the xmcd file of the chosen cd of the local search to 'output';
+//returns -1 on error
+int get_local_cddb_file(main_data *data, int selected_cd, const char *output)
+{
+  char message[1024] = { '\0' };
+  local_cddb_results *local = data->local_cddb;
+  const char *source = local->files[selected_cd];
+
+  FILE *in = fopen(source, "rb");
+  char *temporary = NULL;
+  FILE *out = in ? open_atomic_file(output, "wb", &temporary) : NULL;
+  if (!in || !out)
+  {
+    snprintf(message, 1024, _("cannot copy '%s' to '%s': %s"),
+        source, output, strerror(errno));
+    if (in)
+    {
+      fclose(in);
+    }
+    return print_run_error(message, data);
+  }
+
+  char buffer[MP3SPLT_LOCAL_CDDB_LINE_SIZE];
+  size_t length = 0;
+  while ((length = fread(buffer, 1, sizeof(buffer), in)) > 0)
+  {
+    fwrite(buffer, 1, length, out);
+  }
+  fclose(in);
+
+  if (close_atomic_file(out, temporary, output) == -1)
+  {
+    snprintf(message, 1024, _("cannot copy '%s' to '%s': %s"),
+        source, output, strerror(errno));
+    return print_run_error(message, data);
+  }
+
+  return 0;
+}
+
+//makes the freedb search; returns -1 on error
+int do_freedb_search(main_data *data)
+{
+  int err = SPLT_OK;
+  options *opt = data->opt;
+  splt_state *state = data->state;
+
+  //we find out what search and get type we have
+  char search_type[30] = "";
+  char get_type[30] = "";
+  if (opt->freedb_search_type == SPLT_FREEDB_SEARCH_TYPE_CDDB_CGI)
+  {
+    snprintf(search_type,30,"%s","cddb_cgi");
+  }
+  else if (opt->freedb_search_type == MP3SPLT_LOCAL_CDDB_TYPE)
+  {
+    snprintf(search_type,30,"%s","local");
+  }
+  else
+  {
+    snprintf(search_type,30,"%s","web_search");
+  }
+  if (opt->freedb_get_type == SPLT_FREEDB_GET_FILE_TYPE_CDDB_CGI)
+  {
+    snprintf(get_type,30,"%s","cddb_cgi");
+  }
+  else if (opt->freedb_get_type == MP3SPLT_LOCAL_CDDB_TYPE)
+  {
+    snprintf(get_type,30,"%s","local");
+  }
+  else
+  {
+    snprintf(get_type,30,"%s","cddb_protocol");
+  }
+
+  //the results of a local search are only in the local index
+  int local_search = (opt->freedb_search_type == MP3SPLT_LOCAL_CDDB_TYPE);
+  if (local_search != (opt->freedb_get_type == MP3SPLT_LOCAL_CDDB_TYPE))
+  {
+    return print_run_error(_("the local freedb search and get types must be"
+          " used together"), data);
+  }
+
+  //print out infos about the servers
+  fprintf(data->console_out,_(" Freedb search type: %s , Site: %s , Port: %d\n"),
+      search_type,opt->freedb_search_server,opt->freedb_search_port);
+  fflush(data->console_out);
+  fprintf(data->console_out,_(" Freedb get type: %s , Site: %s , Port: %d\n"),
+      get_type,opt->freedb_get_server,opt->freedb_get_port);
+  fflush(data->console_out);
+
+  char *freedb_search_string = NULL;
+  char freedb_input[2048] = { '\0' };
+  //if we haven't chosen to search from the arguments, interactive search
+  if (opt->freedb_arg_search_string[0] == '\0')
+  {
+    //freedb search
+    print_message(_("CDDB QUERY. Insert album and"
+          " artist informations to find cd."));
+
+    short first_time = SPLT_TRUE;
+    //here we search freedb
+    do {
+      if (!first_time)
+      {
+        print_message(_("\nPlease search something ..."));
+      }
+
+      memset(freedb_input, '\0', sizeof(freedb_input));
+
+      fprintf(data->console_out, "\n\t____________________________________________________________]");
+      fprintf(data->console_out, _("\r Search: ["));
+
+      fgets(freedb_input, 2046, stdin);
+
+      first_time = SPLT_FALSE;
+
+      freedb_input[strlen(freedb_input)-1] = '\0';
+
+    } while (strlen(freedb_input)==0);
+
+    freedb_search_string = freedb_input;
+  }
+  else
+  {
+    freedb_search_string = opt->freedb_arg_search_string;
+  }
+
+  fprintf(data->console_out, _("\n  Search string: %s\n"),freedb_search_string);
+  fprintf(data->console_out, _("\nSearching from %s on port %d using %s ...\n"),
+      opt->freedb_search_server,opt->freedb_search_port, search_type);
+  fflush(data->console_out);
+
+  //the freedb results
+  const splt_freedb_results *f_results = NULL;
+  //we search the freedb
+  double search_start = trace_begin(data);
+  if (local_search)
+  {
+    if (search_local_cddb(data, opt->freedb_search_server,
+          freedb_search_string) == -1)
+    {
+      return -1;
+    }
+    f_results = &data->local_cddb->results;
+  }
+  else
+  {
+    f_results = mp3splt_get_freedb_search(state, freedb_search_string,
+        &err, opt->freedb_search_type,
+        opt->freedb_search_server,
+        opt->freedb_search_port);
+  }
+  trace_end(data, "freedb search", opt->freedb_search_server, search_start, -1);
+  if (process_confirmation_error(err, data) == -1)
+  {
+    return -1;
+  }
+
+  //if we don't have an auto-select the result X from the arguments:
+  // (query{artist}(resultX)
+  //, then interactive user ask
+  int selected_cd = 0;
+  if (opt->freedb_arg_result_option < 0)
+  {
+    //print the searched informations
+    print_message(_("List of found cd:"));
+
+    int cd_number = 0;
+    short end = SPLT_FALSE;
+    do {
+      fprintf(data->console_out,"%3d) %s\n",
+          f_results->results[cd_number].id,
+          f_results->results[cd_number].name);
+
+      int i = 0;
+      for(i = 0; i < f_results->results[cd_number].revision_number; i++)
+      {
+        fprintf(data->console_out, "  |\\=>");
+        fprintf(data->console_out, "%3d) ", f_results->results[cd_number].id+i+1);
+        fprintf(data->console_out, _("Revision: %d\n"), i+2);
+
+        //break at 22
+        if (((f_results->results[cd_number].id+i+2)%22)==0)
+        {
+          //duplicate, see below
+          char junk[18];
+          fprintf(data->console_out, _("-- 'q' to select cd, Enter for more:"));
+          fflush(data->console_out);
+
+          fgets(junk, 16, stdin);
+          if (junk[0]=='q')
+          {
+            end = SPLT_TRUE;
+            goto end;
+          }
+        }
+      }
+
+      //we read result from the char, q tu select cd or
+      //enter to show more results
+      if (((f_results->results[cd_number].id+1)%22)==0)
+      {
+        //duplicate, see ^^
+        char junk[18];
+        fprintf(data->console_out, _("-- 'q' to select cd, Enter for more: "));
+        fflush(data->console_out);
+
+        fgets(junk, 16, stdin);
+        if (junk[0]=='q')
+        {
+          end = SPLT_TRUE;
+          goto end;
+        }
+      }
+
+end:
+      if (end)
+      {
+        end = SPLT_FALSE;
+        break;
+      }
+
+      cd_number++;
+    } while (cd_number < f_results->number);
+
+    //select the CD
+    //input of the selected cd
+    char sel_cd_input[1024];
+    int tot = 0;
+    do {
+      selected_cd = 0;
+      fprintf(data->console_out, _("Select cd #: "));
+      fflush(data->console_out);
+      fgets(sel_cd_input, 254, stdin);
+      sel_cd_input[strlen(sel_cd_input)-1]='\0';
+      tot = 0;
+
+      if (sel_cd_input[tot] == '\0') 
+      {
+        selected_cd = -1;
+      }
+
+      while(sel_cd_input[tot] != '\0')
+      {
+        if (isdigit(sel_cd_input[tot++])==0)
+        {
+          fprintf(data->console_out, _("Please "));
+          fflush(data->console_out);
+
+          selected_cd = -1;
+          break;
+        }
+      }
+
+      if (selected_cd != -1) 
+      {
+        selected_cd = atoi(sel_cd_input);
+      }
+
+    } while ((selected_cd >= f_results->number) 
+        || (selected_cd < 0));
+  }
+  else
+  {
+    selected_cd = opt->freedb_arg_result_option;
+    if (selected_cd >= f_results->number)
+    {
+      selected_cd = 0;
+    }
+  }
+
+  fprintf(data->console_out, _("\nGetting file from %s on port %d using %s ...\n"),
+      opt->freedb_get_server,opt->freedb_get_port, get_type);
+  fflush(data->console_out);
+
+  //here we have the selected cd in selected_cd
+  double get_start = trace_begin(data);
+  if (local_search)
+  {
+    if (get_local_cddb_file(data, selected_cd, data->cddb_file) == -1)
+    {
+      return -1;
+    }
+  }
+  else
+  {
+    mp3splt_write_freedb_file_result(state, selected_cd,
+        data->cddb_file, &err, opt->freedb_get_type,
+        opt->freedb_get_server, opt->freedb_get_port);
+  }
+  trace_end(data, "freedb get", opt->freedb_get_server, get_start,
+      get_trace_file_size(data->cddb_file));
+  return process_confirmation_error(err, data);
+}
+
+//prints a library message
+void put_library_message(const char *message, splt_message_type mess_type)
+{
+  if (mess_type == SPLT_MESSAGE_INFO)
+  {
+    FILE *console_out = get_console_out();
+    fprintf(console_out,"%s",message);
+    fflush(console_out);
+  }
+  else if (mess_type == SPLT_MESSAGE_DEBUG)
+  {
+    FILE *console_err = get_console_err();
+    fprintf(console_err, "%s", message);
+    fflush(console_err);
+  }
+}
+
+//parses a rate like '50M' (bytes per second, with an optional K, M or G
+//suffix); returns -1 if the rate is not valid
+double parse_io_rate(const char *rate)
+{
+  char *end = NULL;
+  double value = strtod(rate, &end);
+  if ((end == rate) || (value <= 0))
+  {
+    return -1;
+  }
+
+  switch (toupper(*end))
+  {
+    case '\0':
+      return value;
+    case 'K':
+      value *= 1024;
+      break;
+    case 'M':
+      value *= 1024 * 1024;
+      break;
+    case 'G':
+      value *= 1024 * 1024 * 1024;
+      break;
+    default:
+      return -1;
+  }
+
+  if ((end[1] != '\0') && (strcmp(end + 1, "B") != 0) &&
+      (strcmp(end + 1, "b") != 0))
+  {
+    return -1;
+  }
+
+  return value;
+}
+
+//parses the --io-priority argument: 'idle', 'be' or 'be:N' with N
+//between 0 (highest) and 7 (lowest); returns -1 if not valid
+int parse_io_priority(options *opt, const char *priority)
+{
+  if (strcmp(priority, "idle") == 0)
+  {
+    opt->io_priority_class = MP3SPLT_IOPRIO_CLASS_IDLE;
+    opt->io_priority_level = 0;
+    return 0;
+  }
+
+  if (strncmp(priority, "be", 2) == 0)
+  {
+    opt->io_priority_class = MP3SPLT_IOPRIO_CLASS_BE;
+    if (priority[2] == '\0')
+    {
+      opt->io_priority_level = 4;
+      return 0;
+    }
+    if ((priority[2] == ':') && (priority[3] >= '0') &&
+        (priority[3] <= '7') && (priority[4] == '\0'))
+    {
+      opt->io_priority_level = priority[3] - '0';
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+//sets the I/O scheduling class and priority of the process
+void set_io_priority(main_data *data)
+{
+#if defined(__linux__) && defined(SYS_ioprio_set)
+  options *opt = data->opt;
+  int ioprio = (opt->io_priority_class << MP3SPLT_IOPRIO_CLASS_SHIFT) |
+    opt->io_priority_level;
+  if (syscall(SYS_ioprio_set, MP3SPLT_IOPRIO_WHO_PROCESS, 0, ioprio) == -1)
+  {
+    char message[256] = { '\0' };
+    snprintf(message, 256, _("cannot set the I/O priority (%s)"), strerror(errno));
+    print_warning(message);
+  }
+#else
+  print_warning(_("--io-priority is not supported on this system"));
+#endif
+}
+
+#ifdef __linux__
+//returns the current time in seconds
+double get_monotonic_time()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1000000000.0;
+}
+
+//returns the number of bytes read and written by the process so far,
+//including the reads and writes of the library, without the own bytes
+//of the limiter (the read of /proc/self/io is added to them)
+unsigned long long get_process_io_bytes(io_limiter *io)
+{
+  unsigned long long io_bytes = 0;
+  FILE *io_file = fopen("/proc/self/io", "r");
+  if (io_file)
+  {
+    char line[256] = { '\0' };
+    unsigned long long value = 0;
+    while (fgets(line, 256, io_file))
+    {
+      io->own_bytes += strlen(line);
+      if ((sscanf(line, "rchar: %llu", &value) == 1) ||
+          (sscanf(line, "wchar: %llu", &value) == 1))
+      {
+        io_bytes += value;
+      }
+    }
+    fclose(io_file);
+  }
+
+  return (io_bytes > io->own_bytes) ? io_bytes - io->own_bytes : 0;
+}
+#endif
+
+//counts the bytes of a progress message, written by the frontend and not
+//by the split (--io-limit)
+void io_limiter_count_message(main_data *data, int bytes)
+{
+  if (data && (data->io->bytes_per_second > 0) && (bytes > 0))
+  {
+    data->io->own_bytes += bytes;
+  }
+}
+
+//starts the I/O accounting for a new input file
+void io_limiter_start(main_data *data)
+{
+  if (!data->opt->io_limit_option)
+  {
+    return;
+  }
+
+#ifdef __linux__
+  io_limiter *io = data->io;
+  io->bytes_per_second = data->opt->io_limit;
+  io->last_time = get_monotonic_time();
+  io->start_time = io->last_time;
+  io->last_io_bytes = get_process_io_bytes(io);
+  io->start_io_bytes = io->last_io_bytes;
+  io->tokens = io->bytes_per_second;
+  io->effective_rate = 0;
+#endif
+}
+
+//called from the library callbacks: takes the bytes read and written
+//since the last sample from the bucket and sleeps if the bucket is
+//empty; the I/O is sampled every MP3SPLT_IO_LIMIT_INTERVAL seconds, or
+//now with 'force'
+void io_limiter_update(main_data *data, int force)
+{
+  io_limiter *io = data->io;
+  if (io->bytes_per_second <= 0)
+  {
+    return;
+  }
+
+#ifdef __linux__
+  double now = get_monotonic_time();
+  if (!force && (now - io->last_time < MP3SPLT_IO_LIMIT_INTERVAL))
+  {
+    return;
+  }
+  unsigned long long io_bytes = get_process_io_bytes(io);
+
+  io->tokens += (now - io->last_time) * io->bytes_per_second;
+  //allow bursts of one second at most
+  if (io->tokens > io->bytes_per_second)
+  {
+    io->tokens = io->bytes_per_second;
+  }
+  io->tokens -= (double) (io_bytes - io->last_io_bytes);
+  io->last_io_bytes = io_bytes;
+
+  if (io->tokens < 0)
+  {
+    double wait = -io->tokens / io->bytes_per_second;
+    struct timespec sleep_time;
+    sleep_time.tv_sec = (time_t) wait;
+    sleep_time.tv_nsec = (long) ((wait - sleep_time.tv_sec) * 1000000000.0);
+    while (nanosleep(&sleep_time, &sleep_time) == -1 && errno == EINTR && !data->cancel_requested)
+    {
+    }
+    now = get_monotonic_time();
+    io->tokens = 0;
+  }
+  io->last_time = now;
+
+  if (now > io->start_time)
+  {
+    io->effective_rate = (io_bytes - io->start_io_bytes) / (now - io->start_time);
+  }
+#endif
+}
+
+//prints the bytes read and written for the current input file
+void print_io_statistics(main_data *data)
+{
+  io_limiter *io = data->io;
+  if (io->bytes_per_second <= 0)
+  {
+    return;
+  }
+
+  io_limiter_update(data, SPLT_TRUE);
+
+  char message[256] = { '\0' };
+  snprintf(message, 256, _(" I/O: %.2f MB read and written, effective rate %.2f MB/s"
+        " (limit %.2f MB/s)"),
+      (io->last_io_bytes - io->start_io_bytes) / (1024.0 * 1024.0),
+      io->effective_rate / (1024.0 * 1024.0),
+      io->bytes_per_second / (1024.0 * 1024.0));
+  print_message(message);
+}
+
+//opens the input file to give hints on its pages (--drop-cache): read
+//sequentially, read ahead, and dropped once read
+void cache_hints_start(main_data *data, const char *filename)
+{
+  cache_hints *hints = data->cache;
+  hints->fd = -1;
+  hints->size = 0;
+  hints->advised = 0;
+  hints->dropped = 0;
+  hints->finished = 0;
+  if (!data->opt->drop_cache_option)
+  {
+    return;
+  }
+
+#ifdef HAVE_POSIX_FADVISE
+  if ((strcmp(filename, "-") == 0) || (strcmp(filename, "m-") == 0) ||
+      (strcmp(filename, "o-") == 0))
+  {
+    return;
+  }
+
+  struct stat input_stat;
+  hints->fd = open(filename, O_RDONLY);
+  if ((hints->fd < 0) || (fstat(hints->fd, &input_stat) != 0) ||
+      !S_ISREG(input_stat.st_mode))
+  {
+    cache_hints_finish(data);
+    return;
+  }
+  hints->size = input_stat.st_size;
+
+  posix_fadvise(hints->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  hints->advised = MP3SPLT_READAHEAD_WINDOW;
+  advise_input(hints, 0, hints->advised, POSIX_FADV_WILLNEED);
+#endif
+}
+
+//reads ahead of 'position' in the input file
+void cache_hints_read_ahead(cache_hints *hints, long long position)
+{
+#ifdef HAVE_POSIX_FADVISE
+  if (position + MP3SPLT_READAHEAD_WINDOW / 2 > hints->advised)
+  {
+    long long end = position + MP3SPLT_READAHEAD_WINDOW;
+    advise_input(hints, hints->advised, end - hints->advised,
+        POSIX_FADV_WILLNEED);
+    hints->advised = end;
+  }
+#endif
+}
+
+//called from the progress callback: during the silence detection, the
+//progress is the one of the whole input file, so we read ahead of it;
+//the progress of the split is the one of the output file being created,
+//which does not tell where it is in the input file (see
+//cache_hints_file_created)
+void cache_hints_update(main_data *data, splt_progress *p_bar)
+{
+  cache_hints *hints = data->cache;
+  if ((hints->fd < 0) || (p_bar->progress_type != SPLT_PROGRESS_SCAN_SILENCE))
+  {
+    return;
+  }
+
+  double progress = p_bar->percent_progress;
+  if (progress < 0)
+  {
+    progress = 0;
+  }
+  else if (progress > 1)
+  {
+    progress = 1;
+  }
+  cache_hints_read_ahead(hints, (long long) (progress * hints->size));
+}
+
+//called when an output file is created: the input file has been read up
+//to the size of the files created, so we read ahead from there and drop
+//the pages before; the overlapping files of -O are larger than what they
+//read, so their pages are only dropped at the end of the input file
+void cache_hints_file_created(main_data *data, const char *file)
+{
+  cache_hints *hints = data->cache;
+  struct stat output_stat;
+  if ((hints->fd < 0) || data->opt->P_option ||
+      (stat(file, &output_stat) != 0))
+  {
+    return;
+  }
+
+  hints->finished += output_stat.st_size;
+  cache_hints_read_ahead(hints, hints->finished);
+
+#ifdef HAVE_POSIX_FADVISE
+  if (!data->opt->O_option &&
+      (hints->finished - MP3SPLT_READAHEAD_WINDOW > hints->dropped))
+  {
+    long long end = hints->finished - MP3SPLT_READAHEAD_WINDOW;
+    advise_input(hints, hints->dropped, end - hints->dropped,
+        POSIX_FADV_DONTNEED);
+    hints->dropped = end;
+  }
+#endif
+}
+
+//asks the kernel to read the next 'opt->prefetch' input files in the
+//background while the current one is split (--prefetch); the reads are
+//queued together, so the device gets several requests at once
+void prefetch_next_inputs(main_data *data, int current)
+{
+#ifdef HAVE_POSIX_FADVISE
+  cache_hints *hints = data->cache;
+  //--prefetch accepts up to INT_MAX files: no overflow of the sum
+  int last = data->number_of_filenames - 1;
+  if (data->opt->prefetch < last - current)
+  {
+    last = current + data->opt->prefetch;
+  }
+
+  if (hints->next_prefetch <= current)
+  {
+    hints->next_prefetch = current + 1;
+  }
+
+  for (;hints->next_prefetch <= last; hints->next_prefetch++)
+  {
+    const char *filename = data->filenames[hints->next_prefetch];
+    if ((strcmp(filename, "-") == 0) || (strcmp(filename, "m-") == 0) ||
+        (strcmp(filename, "o-") == 0))
+    {
+      continue;
+    }
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+      continue;
+    }
+
+    //the pages stay in the cache after close
+    struct stat input_stat;
+    if ((fstat(fd, &input_stat) == 0) && S_ISREG(input_stat.st_mode))
+    {
+      off_t length = input_stat.st_size;
+      if (length > MP3SPLT_PREFETCH_SIZE)
+      {
+        length = MP3SPLT_PREFETCH_SIZE;
+      }
+      posix_fadvise(fd, 0, length, POSIX_FADV_WILLNEED);
+    }
+    close(fd);
+  }
+#endif
+}
+
+//writes the created file to the disk and drops its pages (--drop-cache)
+void drop_output_cache(const char *file)
+{
+#ifdef HAVE_POSIX_FADVISE
+  int fd = open(file, O_RDONLY);
+  if (fd < 0)
+  {
+    return;
+  }
+
+  //dirty pages cannot be dropped: write them first
+#ifdef HAVE_SYNC_FILE_RANGE
+  sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WAIT_BEFORE |
+      SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+#else
+  fsync(fd);
+#endif
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+#endif
+}
+
+//returns the physical location on the disk of the start of a file, from
+//its first extent (FIEMAP) or, where it is not available, its inode
+//number; returns LLONG_MAX if unknown
+long long get_file_location(const char *filename)
+{
+  struct stat input_stat;
+  if ((stat(filename, &input_stat) != 0) || !S_ISREG(input_stat.st_mode))
+  {
+    return LLONG_MAX;
+  }
+
+#ifdef FS_IOC_FIEMAP
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+  {
+    return LLONG_MAX;
+  }
+
+  union
+  {
+    struct fiemap map;
+    char bytes[sizeof(struct fiemap) + sizeof(struct fiemap_extent)];
+  } request;
+  memset(&request, 0, sizeof(request));
+  request.map.fm_start = 0;
+  request.map.fm_length = FIEMAP_MAX_OFFSET;
+  request.map.fm_extent_count = 1;
+
+  long long location = LLONG_MAX;
+  if ((ioctl(fd, FS_IOC_FIEMAP, &request.map) == 0) &&
+      (request.map.fm_mapped_extents > 0))
+  {
+    location = (long long) request.map.fm_extents[0].fe_physical;
+  }
+  close(fd);
+
+  return location;
+#else
+  return (long long) input_stat.st_ino;
+#endif
+}
+
+//an input file with its sort key (--order)
+typedef struct
+{
+  char *filename;
+  long long key;
+  int index;
+} ordered_input;
+
+//largest key first, then the order of the arguments
+int compare_inputs_by_size(const void *a, const void *b)
+{
+  const ordered_input *first = a;
+  const ordered_input *second = b;
+  if (first->key != second->key)
+  {
+    return (first->key > second->key) ? -1 : 1;
+  }
+  return first->index - second->index;
+}
+
+//smallest key first, then the order of the arguments
+int compare_inputs_by_location(const void *a, const void *b)
+{
+  const ordered_input *first = a;
+  const ordered_input *second = b;
+  if (first->key != second->key)
+  {
+    return (first->key < second->key) ? -1 : 1;
+  }
+  return first->index - second->index;
+}
+
+//orders the input files (--order): largest first, so that a big file
+//does not finish the batch alone, or by location on the disk, to read
+//them with less seeks; returns -1 on error
+int order_input_files(main_data *data)
+{
+  options *opt = data->opt;
+  int by_size = (strcmp(opt->order_arg, "size") == 0);
+  int number_of_files = data->number_of_filenames;
+  if (number_of_files < 2)
+  {
+    return 0;
+  }
+
+  ordered_input *inputs =
+    my_malloc(sizeof(ordered_input) * number_of_files, data);
+  if (!inputs)
+  {
+    return -1;
+  }
+  int i = 0;
+  for (i = 0; i < number_of_files; i++)
+  {
+    const char *filename = data->filenames[i];
+    inputs[i].filename = data->filenames[i];
+    inputs[i].index = i;
+
+    //unknown sizes go last, like the unknown locations
+    struct stat input_stat;
+    if (by_size)
+    {
+      inputs[i].key = -1;
+      if ((stat(filename, &input_stat) == 0) && S_ISREG(input_stat.st_mode))
+      {
+        inputs[i].key = input_stat.st_size;
+      }
+    }
+    else
+    {
+      inputs[i].key = get_file_location(filename);
+    }
+  }
+
+  qsort(inputs, number_of_files, sizeof(ordered_input),
+      by_size ? compare_inputs_by_size : compare_inputs_by_location);
+
+  for (i = 0; i < number_of_files; i++)
+  {
+    data->filenames[i] = inputs[i].filename;
+  }
+  free(inputs);
+  inputs = NULL;
+
+  return 0;
+}
+
+//stops the split in the library if a cancel was requested and it's safe:
+//when 'segment_finished' is SPLT_FALSE, we only stop if we are not
+//creating an output file or if we had a second cancel request
+void stop_split_if_cancelled(splt_progress *p_bar, int segment_finished)
+{
+  main_data *data = callbacks_data;
+  if (!data || !data->cancel_requested || data->split_cancelled)
+  {
+    return;
+  }
+
+  if (segment_finished || (data->cancel_requested > 1) ||
+      (p_bar && (p_bar->progress_type != SPLT_PROGRESS_CREATE) &&
+       (p_bar->progress_type != SPLT_PROGRESS_PREPARE)))
+  {
+    data->split_cancelled = SPLT_TRUE;
+    if (!segment_finished && p_bar &&
+        ((p_bar->progress_type == SPLT_PROGRESS_CREATE) ||
+         (p_bar->progress_type == SPLT_PROGRESS_PREPARE)))
+    {
+      snprintf(data->interrupted_file, sizeof(data->interrupted_file), "%s",
+          p_bar->filename_shorted);
+    }
+    mp3splt_stop_split(data->state, NULL);
+  }
+}
+
+//FNV-1a hash of 'size' bytes, continuing from 'hash'
+//(start with MP3SPLT_FNV_OFFSET)
+unsigned long long fnv1a_hash(const void *buffer, size_t size,
+    unsigned long long hash)
+{
+  const unsigned char *bytes = buffer;
+  size_t i = 0;
+  for (i = 0; i < size; i++)
+  {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+
+  return hash;
+}
+
+static const unsigned int sha256_k[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+  0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+  0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+  0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+  0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+  0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define MP3SPLT_ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+typedef struct {
+  unsigned int state[8];
+  unsigned long long length;
+  unsigned char block[64];
+  int block_length;
+} sha256_context;
+
+void sha256_init(sha256_context *ctx)
+{
+  static const unsigned int initial_state[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+  };
+  memcpy(ctx->state, initial_state, sizeof(initial_state));
+  ctx->length = 0;
+  ctx->block_length = 0;
+}
+
+void sha256_transform(sha256_context *ctx, const unsigned char *block)
+{
+  unsigned int w[64];
+  int i = 0;
+  for (i = 0; i < 16; i++)
+  {
+    w[i] = ((unsigned int) block[i * 4] << 24) |
+      ((unsigned int) block[i * 4 + 1] << 16) |
+      ((unsigned int) block[i * 4 + 2] << 8) | block[i * 4 + 3];
+  }
+  for (i = 16; i < 64; i++)
+  {
+    unsigned int s0 = MP3SPLT_ROTR(w[i - 15], 7) ^
+      MP3SPLT_ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    unsigned int s1 = MP3SPLT_ROTR(w[i - 2], 17) ^
+      MP3SPLT_ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+
+  unsigned int a = ctx->state[0], b = ctx->state[1];
+  unsigned int c = ctx->state[2], d = ctx->state[3];
+  unsigned int e = ctx->state[4], f = ctx->state[5];
+  unsigned int g = ctx->state[6], h = ctx->state[7];
+  for (i = 0; i < 64; i++)
+  {
+    unsigned int s1 = MP3SPLT_ROTR(e, 6) ^ MP3SPLT_ROTR(e, 11) ^
+      MP3SPLT_ROTR(e, 25);
+    unsigned int t1 = h + s1 + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+    unsigned int s0 = MP3SPLT_ROTR(a, 2) ^ MP3SPLT_ROTR(a, 13) ^
+      MP3SPLT_ROTR(a, 22);
+    unsigned int t2 = s0 + ((a & b) ^ (a & c) ^ (b & c));
+    h = g; g = f; f = e; e = d + t1;
+    d = c; c = b; b = a; a = t1 + t2;
+  }
+
+  ctx->state[0] += a; ctx->state[1] += b;
+  ctx->state[2] += c; ctx->state[3] += d;
+  ctx->state[4] += e; ctx->state[5] += f;
+  ctx->state[6] += g; ctx->state[7] += h;
+}
+
+void sha256_update(sha256_context *ctx, const unsigned char *data, size_t size)
+{
+  ctx->length += size;
+  while (size > 0)
+  {
+    if ((ctx->block_length == 0) && (size >= 64))
+    {
+      sha256_transform(ctx, data);
+      data += 64;
+      size -= 64;
+      continue;
+    }
+
+    size_t copied = 64 - ctx->block_length;
+    if (copied > size)
+    {
+      copied = size;
+    }
+    memcpy(ctx->block + ctx->block_length, data, copied);
+    ctx->block_length += copied;
+    data += copied;
+    size -= copied;
+
+    if (ctx->block_length == 64)
+    {
+      sha256_transform(ctx, ctx->block);
+      ctx->block_length = 0;
+    }
+  }
+}
+
+//writes the hash as 64 hexadecimal digits in 'hex'
+void sha256_final(sha256_context *ctx, char hex[65])
+{
+  unsigned long long bits = ctx->length * 8;
+  unsigned char padding[72] = { 0x80 };
+  size_t padding_length = (ctx->block_length < 56) ?
+    (56 - ctx->block_length) : (120 - ctx->block_length);
+  int i = 0;
+  for (i = 0; i < 8; i++)
+  {
+    padding[padding_length + i] = (unsigned char) (bits >> (56 - i * 8));
+  }
+  sha256_update(ctx, padding, padding_length + 8);
+
+  for (i = 0; i < 8; i++)
+  {
+    snprintf(hex + i * 8, 9, "%08x", ctx->state[i]);
+  }
+}
+
+//the hashes and the frame checks of an output file (--manifest)
+typedef struct {
+  sha256_context sha256;
+  unsigned long long fnv1a;
+  unsigned long long size;
+  //SPLT_TRUE if we check the mp3 frames
+  int check_frames;
+  //SPLT_TRUE once we know if the file starts with an ID3v2 tag
+  int started;
+  //bytes left of the current frame or tag
+  unsigned long long skip;
+  unsigned char header[10];
+  int header_length;
+  //SPLT_TRUE while the frames follow each other
+  int synced;
+  long frames;
+  double duration;
+  double last_frame_duration;
+  //number of times the frames did not follow each other
+  long anomalies;
+} output_check;
+
+//returns the length of the mp3 frame starting with 'header', or 0 if
+//'header' is not a valid frame header; sets the duration of the frame
+//and its sample rate (if 'sample_rate' is not NULL)
+unsigned long mp3_frame_length(const unsigned char *header, double *duration,
+    long *sample_rate)
+{
+  static const int bitrates[2][3][15] = {
+    {
+      { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448 },
+      { 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384 },
+      { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 }
+    },
+    {
+      { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256 },
+      { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 },
+      { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 }
+    }
+  };
+  static const int samplerates[3] = { 44100, 48000, 32000 };
+
+  if ((header[0] != 0xFF) || ((header[1] & 0xE0) != 0xE0))
+  {
+    return 0;
+  }
+
+  int version = (header[1] >> 3) & 0x03;
+  int layer = 4 - ((header[1] >> 1) & 0x03);
+  int bitrate_index = (header[2] >> 4) & 0x0F;
+  int samplerate_index = (header[2] >> 2) & 0x03;
+  int padding = (header[2] >> 1) & 0x01;
+
+  //reserved version, layer, samplerate; free or bad bitrate
+  if ((version == 1) || (layer == 4) || (samplerate_index == 3) ||
+      (bitrate_index == 0) || (bitrate_index == 15))
+  {
+    return 0;
+  }
+
+  int mpeg1 = (version == 3);
+  long bitrate = bitrates[mpeg1 ? 0 : 1][layer - 1][bitrate_index] * 1000L;
+  long samplerate = samplerates[samplerate_index];
+  if (version == 2)
+  {
+    samplerate /= 2;
+  }
+  else if (version == 0)
+  {
+    samplerate /= 4;
+  }
+
+  int samples = 1152;
+  unsigned long length = 0;
+  if (layer == 1)
+  {
+    samples = 384;
+    length = (12 * bitrate / samplerate + padding) * 4;
+  }
+  else if ((layer == 3) && !mpeg1)
+  {
+    samples = 576;
+    length = 72 * bitrate / samplerate + padding;
+  }
+  else
+  {
+    length = 144 * bitrate / samplerate + padding;
+  }
+
+  *duration = samples / (double) samplerate;
+  if (sample_rate)
+  {
+    *sample_rate = samplerate;
+  }
+
+  return length;
+}
+
+//checks that the mp3 frames of the bytes follow each other; the ID3v2
+//tag at the start and the ID3v1 tag at the end are skipped
+void check_mp3_frames(output_check *check, const unsigned char *bytes,
+    size_t size)
+{
+  while (size > 0)
+  {
+    if (check->skip > 0)
+    {
+      size_t skipped = (check->skip < size) ? check->skip : size;
+      check->skip -= skipped;
+      bytes += skipped;
+      size -= skipped;
+      continue;
+    }
+
+    check->header[check->header_length++] = *bytes++;
+    size--;
+
+    if (!check->started)
+    {
+      if (check->header_length < 3)
+      {
+        continue;
+      }
+      if (memcmp(check->header, "ID3", 3) == 0)
+      {
+        if (check->header_length < 10)
+        {
+          continue;
+        }
+        unsigned char *h = check->header;
+        check->skip = ((h[6] & 0x7F) << 21) | ((h[7] & 0x7F) << 14) |
+          ((h[8] & 0x7F) << 7) | (h[9] & 0x7F);
+        if (h[5] & 0x10)
+        {
+          check->skip += 10;
+        }
+        check->header_length = 0;
+      }
+      check->started = SPLT_TRUE;
+      continue;
+    }
+    if (check->header_length < 4)
+    {
+      continue;
+    }
+
+    if (memcmp(check->header, "TAG", 3) == 0)
+    {
+      check->skip = 128 - check->header_length;
+      check->header_length = 0;
+      continue;
+    }
+
+    double duration = 0;
+    unsigned long length = mp3_frame_length(check->header, &duration, NULL);
+    if (length >= 4)
+    {
+      check->frames++;
+      check->duration += duration;
+      check->last_frame_duration = duration;
+      check->synced = SPLT_TRUE;
+      check->skip = length - check->header_length;
+      check->header_length = 0;
+    }
+    else
+    {
+      //a new anomaly each time we lose the frames
+      if (check->synced || (check->frames == 0 && check->anomalies == 0))
+      {
+        check->anomalies++;
+      }
+      check->synced = SPLT_FALSE;
+      memmove(check->header, check->header + 1, check->header_length - 1);
+      check->header_length--;
+    }
+  }
+}
+
+//hashes the output file that has just been written and checks its frames;
+//the file is read right after its creation, from the page cache
+void check_output_file(main_data *data, const char *file)
+{
+  FILE *in = fopen(file, "rb");
+  if (!in)
+  {
+    return;
+  }
+
+  output_check check;
+  memset(&check, 0, sizeof(check));
+  sha256_init(&check.sha256);
+  check.fnv1a = MP3SPLT_FNV_OFFSET;
+
+  char extension[5] = { '\0' };
+  const char *dot = strrchr(file, '.');
+  if (dot && (strlen(dot) == 4))
+  {
+    int i = 0;
+    for (i = 0; i < 4; i++)
+    {
+      extension[i] = tolower(dot[i]);
+    }
+  }
+  check.check_frames = (strcmp(extension, ".mp3") == 0);
+
+  unsigned char *buffer = malloc(sizeof(unsigned char) * 65536);
+  if (!buffer)
+  {
+    fclose(in);
+    stop_split_on_error(data, _("cannot allocate memory !"));
+    return;
+  }
+  size_t read_bytes = 0;
+  while ((read_bytes = fread(buffer, 1, 65536, in)) > 0)
+  {
+    sha256_update(&check.sha256, buffer, read_bytes);
+    check.fnv1a = fnv1a_hash(buffer, read_bytes, check.fnv1a);
+    check.size += read_bytes;
+    if (check.check_frames)
+    {
+      check_mp3_frames(&check, buffer, read_bytes);
+    }
+  }
+  int read_error = ferror(in);
+  fclose(in);
+  free(buffer);
+  buffer = NULL;
+
+  if (read_error)
+  {
+    char message[1024] = { '\0' };
+    snprintf(message, 1024, _("cannot read '%s' for the manifest"), file);
+    print_warning(message);
+    return;
+  }
+
+  //the last frame is truncated
+  if (check.check_frames && (check.skip > 0 || check.header_length > 0))
+  {
+    if (check.synced && check.skip > 0)
+    {
+      check.frames--;
+      check.duration -= check.last_frame_duration;
+    }
+    check.anomalies++;
+  }
+
+  if (data->number_of_manifest_entries >= data->manifest_capacity)
+  {
+    int capacity = (data->manifest_capacity > 0) ?
+      data->manifest_capacity * 2 : 16;
+    manifest_entry *entries =
+      realloc(data->manifest, sizeof(manifest_entry) * capacity);
+    if (!entries)
+    {
+      stop_split_on_error(data, _("cannot allocate memory !"));
+      return;
+    }
+    data->manifest = entries;
+    data->manifest_capacity = capacity;
+  }
+
+  manifest_entry *entry = &data->manifest[data->number_of_manifest_entries];
+  entry->path = strdup(file);
+  if (!entry->path)
+  {
+    stop_split_on_error(data, _("cannot allocate memory !"));
+    return;
+  }
+  entry->size = check.size;
+  sha256_final(&check.sha256, entry->sha256);
+  entry->fnv1a = check.fnv1a;
+  entry->frames = check.check_frames ? check.frames : -1;
+  entry->duration = check.duration;
+  entry->anomalies = check.anomalies;
+  entry->has_level_estimate = SPLT_FALSE;
+  data->number_of_manifest_entries++;
+
+  if (check.anomalies > 0)
+  {
+    char message[1024] = { '\0' };
+    snprintf(message, 1024,
+        _("%ld frame continuity error(s) in \"%s\""), check.anomalies, file);
+    print_warning(message);
+  }
+}
+
+//writes the manifest of the created files (--manifest)
+void write_manifest(main_data *data)
+{
+  options *opt = data->opt;
+  if (!opt->manifest_arg)
+  {
+    return;
+  }
+
+  char *temporary = NULL;
+  FILE *manifest = open_atomic_file(opt->manifest_arg, "w", &temporary);
+  if (!manifest)
+  {
+    char message[1024] = { '\0' };
+    snprintf(message, 1024, _("cannot write the manifest '%s' (%s)"),
+        opt->manifest_arg, strerror(errno));
+    print_warning(message);
+    return;
+  }
+
+  fprintf(manifest, "# path\tsize\tsha256\tfnv1a64\tframes\tduration"
+      "\tanomalies\testimated_level_db\testimated_peak_db\n");
+  int i = 0;
+  for (i = 0; i < data->number_of_manifest_entries; i++)
+  {
+    manifest_entry *entry = &data->manifest[i];
+    write_tsv_string(manifest, entry->path);
+    fprintf(manifest, "\t%llu\t%s\t%016llx\t%ld\t%.3f\t%ld",
+        entry->size, entry->sha256, entry->fnv1a,
+        entry->frames, entry->duration, entry->anomalies);
+    if (entry->has_level_estimate)
+    {
+      fprintf(manifest, "\t%.2f\t%.2f\n", entry->estimated_level_db,
+          entry->estimated_peak_db);
+    }
+    else
+    {
+      fprintf(manifest, "\t-\t-\n");
+    }
+  }
+
+  if (close_atomic_file(manifest, temporary, opt->manifest_arg) == -1)
+  {
+    char message[1024] = { '\0' };
+    snprintf(message, 1024, _("cannot write the manifest '%s' (%s)"),
+        opt->manifest_arg, strerror(errno));
+    print_warning(message);
+  }
+}
+
+//remembers the created output file, for the cancel summary
+void append_split_file(main_data *data, const char *file)
+{
+  char *copy = strdup(file);
+  if (!copy)
+  {
+    return;
+  }
+
+  char **split_files = realloc(data->split_files,
+      sizeof(char *) * (data->number_of_split_files + 1));
+  if (!split_files)
+  {
+    free(copy);
+    return;
+  }
+  data->split_files = split_files;
+  data->split_files[data->number_of_split_files] = copy;
+  data->number_of_split_files++;
+}
+
+//prints the split file
+void put_split_file(const char *file, int progress_data)
+{
+  if (callbacks_data)
+  {
+    append_split_file(callbacks_data, file);
+    io_limiter_update(callbacks_data, SPLT_FALSE);
+    trace_output_file(callbacks_data, file);
+  }
+
+  //we put necessary spaces
+  char temp[1024] = "";
+  int this_spaces = strlen(file)+16;
+  int counter = strlen(file)+16;
+  while (counter <= progress_data)
+  {
+    temp[counter-this_spaces] = ' ';
+    counter++;
+  }
+  temp[counter] = '\0';
+
+  FILE *console_out = get_console_out();
+  int written = fprintf(console_out,_("   File \"%s\" created%s\n"),file,temp);
+  io_limiter_count_message(callbacks_data, written);
+  fflush(console_out);
+
+  if (callbacks_data && callbacks_data->opt->manifest_arg &&
+      !callbacks_data->opt->P_option)
+  {
+    check_output_file(callbacks_data, file);
+  }
+
+  if (callbacks_data && callbacks_data->opt->drop_cache_option &&
+      !callbacks_data->opt->P_option)
+  {
+    cache_hints_file_created(callbacks_data, file);
+    drop_output_cache(file);
+  }
+
+  stop_split_if_cancelled(NULL, SPLT_TRUE);
+}
+
+//prints the progress bar
+void put_progress_bar(splt_progress *p_bar)
+{
+  char progress_text[2048] = " ";
+
+  switch (p_bar->progress_type)
+  {
+    case SPLT_PROGRESS_PREPARE:
+      snprintf(progress_text,2047,
+          _(" preparing \"%s\" (%d of %d)"),
+          p_bar->filename_shorted,
+          p_bar->current_split,
+          p_bar->max_splits);
+      break;
+    case SPLT_PROGRESS_CREATE:
+      snprintf(progress_text,2047,
+          _(" creating \"%s\" (%d of %d)"),
+          p_bar->filename_shorted,
+          p_bar->current_split,
+          p_bar->max_splits);
+      break;
+    case SPLT_PROGRESS_SEARCH_SYNC:
+      snprintf(progress_text,2047,
+          _(" searching for sync errors..."));
+      break;
+    case SPLT_PROGRESS_SCAN_SILENCE:
+      snprintf(progress_text,2047,
+          _("S: %02d, Level: %.2f dB; scanning for silence..."),
+          p_bar->silence_found_tracks, p_bar->silence_db_level);
+      break;
+    default:
+      snprintf(progress_text,2047, " ");
+      break;
+  }
+
+  //the effective I/O rate when limited
+  if (callbacks_data && (callbacks_data->io->bytes_per_second > 0))
+  {
+    int length = strlen(progress_text);
+    snprintf(progress_text + length, 2047 - length, " (I/O %.2f MB/s)",
+        callbacks_data->io->effective_rate / (1024.0 * 1024.0));
+  }
+
+  char printed_value[2048] = "";
+  //we update the progress
+  if (p_bar->percent_progress <= 0.01)
+  {
+    snprintf(printed_value,2047," [ - %%] %s", progress_text);
+  }
+  else
+  {
+    snprintf(printed_value,2047," [ %.2f %%] %s",
+        p_bar->percent_progress * 100, progress_text);
+  }
+
+  //we put necessary spaces
+  char temp[2048] = "";
+  int this_spaces = strlen(printed_value);
+  int counter = strlen(printed_value);
+  while (counter <= p_bar->user_data)
+  {
+    temp[counter-this_spaces] = ' ';
+    counter++;
+  }
+  temp[counter] = '\0';
+
+  FILE *console_progress = callbacks_data->console_progress;
+  int written = fprintf(console_progress,"%s%s\r",printed_value,temp);
+  io_limiter_count_message(callbacks_data, written);
+  fflush(console_progress);
+
+  p_bar->user_data = strlen(printed_value)+1;
+}
+
+//library progress callback: stops the split if we must and prints the
+//progress bar
+void put_progress(splt_progress *p_bar)
+{
+  stop_split_if_cancelled(p_bar, SPLT_FALSE);
+
+  if (callbacks_data)
+  {
+    io_limiter_update(callbacks_data, SPLT_FALSE);
+    cache_hints_update(callbacks_data, p_bar);
+    trace_progress(callbacks_data, p_bar);
+  }
+
+  if (callbacks_data && callbacks_data->show_progress)
+  {
+    put_progress_bar(p_bar);
+  }
+}
+
+//hash of the start, the middle and the end of a file: a cheap first
+//check of identical files (--dedupe); returns -1 if it cannot be read
+int sample_input_hash(main_data *data, const char *filename, long long size,
+    unsigned long long *hash)
+{
+  FILE *in = fopen(filename, "rb");
+  if (!in)
+  {
+    return -1;
+  }
+
+  unsigned char *buffer =
+    my_malloc(sizeof(unsigned char) * MP3SPLT_DEDUPE_SAMPLE, data);
+  if (!buffer)
+  {
+    fclose(in);
+    return -1;
+  }
+  long long offsets[3] = { 0, size / 2, size - MP3SPLT_DEDUPE_SAMPLE };
+  int result = 0;
+  int i = 0;
+
+  *hash = MP3SPLT_FNV_OFFSET;
+  for (i = 0; i < 3; i++)
+  {
+    long long offset = (offsets[i] > 0) ? offsets[i] : 0;
+    if (fseek(in, (long) offset, SEEK_SET) != 0)
+    {
+      result = -1;
+      break;
+    }
+    size_t read_bytes = fread(buffer, 1, MP3SPLT_DEDUPE_SAMPLE, in);
+    *hash = fnv1a_hash(buffer, read_bytes, *hash);
+  }
+  if (ferror(in))
+  {
+    result = -1;
+  }
+
+  fclose(in);
+  free(buffer);
+  buffer = NULL;
+
+  return result;
+}
+
+//SHA-256 of a whole file, to confirm identical files (--dedupe); returns
+//-1 if it cannot be read
+int full_input_hash(main_data *data, const char *filename, char hex[65])
+{
+  FILE *in = fopen(filename, "rb");
+  if (!in)
+  {
+    return -1;
+  }
+
+  sha256_context sha256;
+  sha256_init(&sha256);
+  unsigned char *buffer = my_malloc(sizeof(unsigned char) * 65536, data);
+  if (!buffer)
+  {
+    fclose(in);
+    return -1;
+  }
+  size_t read_bytes = 0;
+  while ((read_bytes = fread(buffer, 1, 65536, in)) > 0)
+  {
+    sha256_update(&sha256, buffer, read_bytes);
+  }
+  int read_error = ferror(in);
+  fclose(in);
+  free(buffer);
+  buffer = NULL;
+
+  sha256_final(&sha256, hex);
+
+  return read_error ? -1 : 0;
+}
+
+//finds the input files with the same content as a previous input file
+//(--dedupe): same size, then same samples, then same SHA-256; returns -1
+//on error
+int find_duplicate_inputs(main_data *data)
+{
+  int number_of_files = data->number_of_filenames;
+  data->duplicates = my_malloc(sizeof(input_duplicate) * number_of_files, data);
+  if (!data->duplicates)
+  {
+    return -1;
+  }
+  data->number_of_duplicates = number_of_files;
+  memset(data->duplicates, 0, sizeof(input_duplicate) * number_of_files);
+
+  long long *sizes = my_malloc(sizeof(long long) * number_of_files, data);
+  unsigned long long *samples =
+    my_malloc(sizeof(unsigned long long) * number_of_files, data);
+  char (*hashes)[65] = my_malloc(sizeof(char[65]) * number_of_files, data);
+  //0: not computed, 1: sample hash, 2: sample and full hash, -1: error
+  int *hashed = my_malloc(sizeof(int) * number_of_files, data);
+  if (!sizes || !samples || !hashes || !hashed)
+  {
+    free(sizes);
+    free(samples);
+    free(hashes);
+    free(hashed);
+    return -1;
+  }
+
+  int i = 0, j = 0;
+  for (j = 0; j < number_of_files; j++)
+  {
+    const char *filename = data->filenames[j];
+    struct stat input_stat;
+
+    data->duplicates[j].original = -1;
+    hashed[j] = 0;
+    sizes[j] = -1;
+    if ((strcmp(filename, "-") != 0) && (strcmp(filename, "m-") != 0) &&
+        (strcmp(filename, "o-") != 0) && (stat(filename, &input_stat) == 0) &&
+        S_ISREG(input_stat.st_mode))
+    {
+      sizes[j] = input_stat.st_size;
+    }
+    if (sizes[j] < 0)
+    {
+      continue;
+    }
+
+    for (i = 0; i < j; i++)
+    {
+      if ((data->duplicates[i].original >= 0) || (sizes[i] != sizes[j]))
+      {
+        continue;
+      }
+
+      int k = 0;
+      int files[2] = { i, j };
+      for (k = 0; k < 2; k++)
+      {
+        int f = files[k];
+        if ((hashed[f] == 0) && (sample_input_hash(data, data->filenames[f],
+                sizes[f], &samples[f]) == 0))
+        {
+          hashed[f] = 1;
+        }
+        else if (hashed[f] == 0)
+        {
+          hashed[f] = -1;
+        }
+      }
+      if ((hashed[i] < 1) || (hashed[j] < 1) || (samples[i] != samples[j]))
+      {
+        continue;
+      }
+
+      for (k = 0; k < 2; k++)
+      {
+        int f = files[k];
+        if (hashed[f] == 1)
+        {
+          hashed[f] = (full_input_hash(data, data->filenames[f],
+                hashes[f]) == 0) ? 2 : -1;
+        }
+      }
+      if ((hashed[i] == 2) && (hashed[j] == 2) &&
+          (strcmp(hashes[i], hashes[j]) == 0))
+      {
+        data->duplicates[j].original = i;
+        data->duplicates[i].has_copies = SPLT_TRUE;
+        break;
+      }
+    }
+  }
+
+  free(sizes);
+  free(samples);
+  free(hashes);
+  free(hashed);
+
+  return 0;
+}
+
+//keeps the files created from an input file that has identical copies;
+//returns -1 on error
+int keep_duplicate_outputs(main_data *data, int index)
+{
+  input_duplicate *duplicate = &data->duplicates[index];
+  if (!duplicate->has_copies)
+  {
+    return 0;
+  }
+
+  int i = 0;
+  duplicate->outputs =
+    my_malloc(sizeof(char *) * (data->number_of_split_files + 1), data);
+  if (!duplicate->outputs)
+  {
+    return -1;
+  }
+  for (i = 0; i < data->number_of_split_files; i++)
+  {
+    duplicate->outputs[i] = strdup(data->split_files[i]);
+    if (!duplicate->outputs[i])
+    {
+      return print_run_error(_("cannot allocate memory !"), data);
+    }
+    duplicate->number_of_outputs++;
+  }
+
+  return 0;
+}
+
+//length of the directory part of 'filename', separator included
+size_t get_directory_length(const char *filename)
+{
+  const char *separator = strrchr(filename, SPLT_DIRCHAR);
+  return separator ? (size_t) (separator - filename + 1) : 0;
+}
+
+//returns the position of 'stem' (the name of the input file) in the
+//output file name 'output_name', where the @f variable of the output
+//format put it; NULL if the format has no @f in the file name or if the
+//name is not found there
+const char *find_output_stem(main_data *data, const char *output_name,
+    const char *stem, size_t stem_length)
+{
+  options *opt = data->opt;
+  //the default names of the library start with @f, except the names from
+  //-c and -A
+  const char *format = "@f";
+  if (opt->o_option && opt->output_format)
+  {
+    format = opt->output_format;
+  }
+  else if (opt->c_option || opt->A_option)
+  {
+    return NULL;
+  }
+
+  const char *component = strrchr(format, SPLT_DIRCHAR);
+  component = component ? component + 1 : format;
+  const char *variable = strstr(component, "@f");
+  if (!variable)
+  {
+    return NULL;
+  }
+
+  //the text of the format before @f, up to the previous variable
+  const char *before = component;
+  int at_start = SPLT_TRUE;
+  const char *previous = NULL;
+  for (previous = variable - 1; previous >= component; previous--)
+  {
+    if (*previous == '@')
+    {
+      before = previous + 2;
+      while ((before < variable) && isdigit((unsigned char) *before))
+      {
+        before++;
+      }
+      at_start = SPLT_FALSE;
+      break;
+    }
+  }
+  size_t before_length = variable - before;
+
+  //and after @f, up to the next variable
+  const char *after = variable + 2;
+  size_t after_length = strcspn(after, "@");
+
+  if (at_start)
+  {
+    if ((strncmp(output_name, before, before_length) == 0) &&
+        (strncmp(output_name + before_length, stem, stem_length) == 0) &&
+        (strncmp(output_name + before_length + stem_length, after,
+                 after_length) == 0))
+    {
+      return output_name + before_length;
+    }
+    return NULL;
+  }
+
+  //after another variable: the name must be found once
+  const char *found = NULL;
+  const char *position = output_name;
+  for (position = output_name; *position != '\0'; position++)
+  {
+    if ((strncmp(position, before, before_length) == 0) &&
+        (strncmp(position + before_length, stem, stem_length) == 0) &&
+        (strncmp(position + before_length + stem_length, after,
+                 after_length) == 0))
+    {
+      if (found)
+      {
+        return NULL;
+      }
+      found = position + before_length;
+    }
+  }
+
+  return found;
+}
+
+//the name of the file created from 'original_input' for a copy 'input':
+//the name of the original input is replaced by the name of the copy and,
+//without -d, its directory by the directory of the copy; returns NULL if
+//we cannot allocate
+char *get_duplicate_output_name(main_data *data, const char *original_input,
+    const char *input, const char *output)
+{
+  size_t output_directory = get_directory_length(output);
+  size_t original_directory = get_directory_length(original_input);
+  const char *directory = output;
+  size_t directory_length = output_directory;
+  if (!data->opt->d_option && (output_directory == original_directory) &&
+      (strncmp(output, original_input, output_directory) == 0))
+  {
+    directory = input;
+    directory_length = get_directory_length(input);
+  }
+
+  //the names without their last extension, like @f
+  const char *original_name = original_input + original_directory;
+  const char *extension = strrchr(original_name, '.');
+  size_t original_length = extension ?
+    (size_t) (extension - original_name) : strlen(original_name);
+  const char *name = input + get_directory_length(input);
+  extension = strrchr(name, '.');
+  size_t name_length = extension ? (size_t) (extension - name) : strlen(name);
+
+  const char *output_name = output + output_directory;
+  const char *found = NULL;
+  if (original_length > 0)
+  {
+    found = find_output_stem(data, output_name, original_name,
+        original_length);
+  }
+
+  size_t size = directory_length + strlen(output_name) + name_length + 1;
+  char *target = my_malloc(size, data);
+  if (!target)
+  {
+    return NULL;
+  }
+  if (found)
+  {
+    snprintf(target, size, "%.*s%.*s%.*s%s", (int) directory_length, directory,
+        (int) (found - output_name), output_name, (int) name_length, name,
+        found + original_length);
+  }
+  else
+  {
+    snprintf(target, size, "%.*s%s", (int) directory_length, directory,
+        output_name);
+  }
+
+  return target;
+}
+
+//writes 'target' with the content of 'source': as a hard link with
+//'hard_link', or else as a copy (a reflink where supported); returns -1
+//on error
+int copy_output_file(const char *source, const char *target, int hard_link)
+{
+  //already linked
+  struct stat source_stat, target_stat;
+  if (hard_link && (stat(source, &source_stat) == 0) &&
+      (stat(target, &target_stat) == 0) &&
+      (source_stat.st_dev == target_stat.st_dev) &&
+      (source_stat.st_ino == target_stat.st_ino))
+  {
+    return 0;
+  }
+
+  char *temporary = get_temporary_filename(target);
+  if (!temporary)
+  {
+    return -1;
+  }
+  remove(temporary);
+
+#ifndef __WIN32__
+  if (hard_link && (link(source, temporary) == 0))
+  {
+    return rename_atomic_file(temporary, target);
+  }
+#endif
+
+  FILE *in = fopen(source, "rb");
+  FILE *out = in ? fopen(temporary, "wb") : NULL;
+  int result = (in && out) ? 0 : -1;
+  int copied = SPLT_FALSE;
+
+#ifdef FICLONE
+  if ((result == 0) && (ioctl(fileno(out), FICLONE, fileno(in)) == 0))
+  {
+    copied = SPLT_TRUE;
+  }
+#endif
+
+  if ((result == 0) && !copied)
+  {
+    unsigned char buffer[65536];
+    size_t read_bytes = 0;
+    while ((read_bytes = fread(buffer, 1, sizeof(buffer), in)) > 0)
+    {
+      if (fwrite(buffer, 1, read_bytes, out) != read_bytes)
+      {
+        result = -1;
+        break;
+      }
+    }
+    if (ferror(in))
+    {
+      result = -1;
+    }
+  }
+
+  int saved_errno = errno;
+  if (in)
+  {
+    fclose(in);
+  }
+  if (out && (fclose(out) != 0))
+  {
+    saved_errno = errno;
+    result = -1;
+  }
+
+  if (result != 0)
+  {
+    remove(temporary);
+    free(temporary);
+    errno = saved_errno;
+    return -1;
+  }
+
+  return rename_atomic_file(temporary, target);
+}
+
+//creates the files of an input file from the files of the identical input
+//file split before (--dedupe); returns -1 on error
+int reuse_duplicate_outputs(main_data *data, int index)
+{
+  int original = data->duplicates[index].original;
+  input_duplicate *duplicate = &data->duplicates[original];
+  const char *original_input = data->filenames[original];
+  const char *input = data->filenames[index];
+  int hard_link = (strcmp(data->opt->dedupe_arg, "link") == 0);
+
+  fprintf(data->console_out, _(" Same content as '%s': reusing its files\n"),
+      original_input);
+  fflush(data->console_out);
+
+  int i = 0;
+  for (i = 0; i < duplicate->number_of_outputs; i++)
+  {
+    const char *output = duplicate->outputs[i];
+    char *target = get_duplicate_output_name(data, original_input, input, output);
+    if (!target)
+    {
+      return -1;
+    }
+
+    if ((strcmp(target, output) != 0) &&
+        (copy_output_file(output, target, hard_link) == -1))
+    {
+      char message[1024] = { '\0' };
+      snprintf(message, 1024, _("cannot create '%s' from '%s': %s"),
+          target, output, strerror(errno));
+      free(target);
+      return print_run_error(message, data);
+    }
+
+    put_split_file(target, 0);
+    free(target);
+    target = NULL;
+  }
+
+  return 0;
+}
+
+//asks the run to stop: the first request finishes the segment being
+//created, the next ones stop as soon as possible; we only set a flag
+//here, the split is stopped from the library callbacks, so that it can
+//be called from a signal handler or from another thread
+void cancel_run(main_data *data)
+{
+  if (data->cancel_requested < 2)
+  {
+    data->cancel_requested++;
+  }
+}
+
+//the run of the command line, cancelled by the signal handler
+main_data *signal_run = NULL;
+
+//handler for the SIGINT and SIGTERM signals: cancels the run of the
+//command line; a third signal exits now
+void sigint_handler(int sig)
+{
+  if (signal_run)
+  {
+    if (signal_run->cancel_requested >= 2)
+    {
+      _exit(MP3SPLT_CANCELLED_EXIT_CODE);
+    }
+    cancel_run(signal_run);
+  }
+  signal(sig, sigint_handler);
+}
+
+//appends 'size' bytes to the content of the m3u file; returns -1 on error
+int append_m3u_content(main_data *data, m3u_file *m3u, const char *text,
+    size_t size)
+{
+  if (m3u->length + size > m3u->capacity)
+  {
+    size_t capacity = (m3u->capacity > 0) ? m3u->capacity : 4096;
+    while (m3u->length + size > capacity)
+    {
+      capacity *= 2;
+    }
+    char *content = realloc(m3u->content, capacity);
+    if (!content)
+    {
+      return print_run_error(_("cannot allocate memory !"), data);
+    }
+    m3u->content = content;
+    m3u->capacity = capacity;
+  }
+
+  memcpy(m3u->content + m3u->length, text, size);
+  m3u->length += size;
+
+  return 0;
+}
+
+//returns the m3u file named 'filename'; the first time, its current
+//content is loaded because the split files are appended to it; returns
+//NULL on error
+m3u_file *get_m3u_file(main_data *data, const char *filename)
+{
+  int i = 0;
+  for (i = 0; i < data->number_of_m3u_files; i++)
+  {
+    if (strcmp(data->m3u_files[i].filename, filename) == 0)
+    {
+      return &data->m3u_files[i];
+    }
+  }
+
+  m3u_file *m3u_files = realloc(data->m3u_files,
+      sizeof(m3u_file) * (data->number_of_m3u_files + 1));
+  if (!m3u_files)
+  {
+    print_run_error(_("cannot allocate memory !"), data);
+    return NULL;
+  }
+  data->m3u_files = m3u_files;
+
+  m3u_file *m3u = &data->m3u_files[data->number_of_m3u_files];
+  m3u->filename = strdup(filename);
+  m3u->content = NULL;
+  m3u->length = 0;
+  m3u->capacity = 0;
+  m3u->modified = SPLT_FALSE;
+  if (!m3u->filename)
+  {
+    print_run_error(_("cannot allocate memory !"), data);
+    return NULL;
+  }
+  data->number_of_m3u_files++;
+
+  FILE *in = fopen(filename, "rb");
+  if (in)
+  {
+    char buffer[4096];
+    size_t read_bytes = 0;
+    while ((read_bytes = fread(buffer, 1, sizeof(buffer), in)) > 0)
+    {
+      if (append_m3u_content(data, m3u, buffer, read_bytes) == -1)
+      {
+        fclose(in);
+        return NULL;
+      }
+    }
+    fclose(in);
+  }
+
+  return m3u;
+}
+
+//adds the files created from the current input file to the m3u file (-m)
+//of their output directory; the m3u is written by flush_m3u_files;
+//returns -1 on error
+int append_m3u_entries(main_data *data)
+{
+  if (data->number_of_split_files == 0)
+  {
+    return 0;
+  }
+
+  //the path of M3U is ignored
+  const char *m3u_name = strrchr(data->opt->m3u_arg, SPLT_DIRCHAR);
+  m3u_name = m3u_name ? m3u_name + 1 : data->opt->m3u_arg;
+
+  const char *first_file = data->split_files[0];
+  const char *first_name = strrchr(first_file, SPLT_DIRCHAR);
+  int dir_length = first_name ? (first_name - first_file) : 0;
+
+  int malloc_size = dir_length + strlen(m3u_name) + 2;
+  char *m3u_filename = my_malloc(sizeof(char) * malloc_size, data);
+  if (!m3u_filename)
+  {
+    return -1;
+  }
+  if (first_name)
+  {
+    snprintf(m3u_filename, malloc_size, "%.*s%c%s", dir_length, first_file,
+        SPLT_DIRCHAR, m3u_name);
+  }
+  else
+  {
+    snprintf(m3u_filename, malloc_size, "%s", m3u_name);
+  }
+  m3u_file *m3u = get_m3u_file(data, m3u_filename);
+  free(m3u_filename);
+  m3u_filename = NULL;
+  if (!m3u)
+  {
+    return -1;
+  }
+
+  int i = 0;
+  for (i = 0; i < data->number_of_split_files; i++)
+  {
+    const char *name = strrchr(data->split_files[i], SPLT_DIRCHAR);
+    name = name ? name + 1 : data->split_files[i];
+    if ((append_m3u_content(data, m3u, name, strlen(name)) == -1) ||
+        (append_m3u_content(data, m3u, "\n", 1) == -1))
+    {
+      return -1;
+    }
+  }
+  m3u->modified = SPLT_TRUE;
+
+  return 0;
+}
+
+//writes the modified m3u files with one write each, through a
+//temporary file renamed at the end
+void flush_m3u_files(main_data *data)
+{
+  int i = 0;
+  for (i = 0; i < data->number_of_m3u_files; i++)
+  {
+    m3u_file *m3u = &data->m3u_files[i];
+    if (!m3u->modified)
+    {
+      continue;
+    }
+    m3u->modified = SPLT_FALSE;
+
+    char *temporary = NULL;
+    FILE *out = open_atomic_file(m3u->filename, "wb", &temporary);
+    int result = -1;
+    if (out)
+    {
+      if (fwrite(m3u->content, 1, m3u->length, out) == m3u->length)
+      {
+        result = close_atomic_file(out, temporary, m3u->filename);
+      }
+      else
+      {
+        discard_atomic_file(out, temporary);
+      }
+    }
+
+    if (result == -1)
+    {
+      char message[1024] = { '\0' };
+      snprintf(message, 1024, _("cannot write the m3u file '%s' (%s)"),
+          m3u->filename, strerror(errno));
+      print_warning(message);
+    }
+  }
+}
+
+//exports the splitpoints of the current input file to the cue file (-E)
+//through a temporary file renamed at the end; returns -1 on error
+int export_cue_file(main_data *data)
+{
+  const char *cue_filename = data->opt->export_cue_arg;
+  char *temporary = get_temporary_filename(cue_filename);
+  if (!temporary)
+  {
+    return print_run_error(_("cannot allocate memory !"), data);
+  }
+
+  int err = SPLT_OK;
+  mp3splt_export_to_cue(data->state, temporary, SPLT_TRUE, &err);
+  if (err < 0)
+  {
+    remove(temporary);
+    free(temporary);
+    return process_confirmation_error(err, data);
+  }
+
+  if (rename_atomic_file(temporary, cue_filename) == -1)
+  {
+    char message[1024] = { '\0' };
+    snprintf(message, 1024, _("cannot write the cue file '%s' (%s)"),
+        cue_filename, strerror(errno));
+    print_warning(message);
+  }
+
+  return process_confirmation_error(err, data);
+}
+
+//renames the silence log of the current input file, written by the
+//library in a temporary file, to 'mp3splt.log'; returns -1 on error
+int finish_silence_log(main_data *data)
+{
+  if (!data->silence_log_temporary)
+  {
+    return 0;
+  }
+
+  char *temporary = strdup(data->silence_log_temporary);
+  if (!temporary)
+  {
+    return print_run_error(_("cannot allocate memory !"), data);
+  }
+
+  if ((rename_atomic_file(temporary, data->silence_log_file) == -1) &&
+      (errno != ENOENT))
+  {
+    char message[1024] = { '\0' };
+    snprintf(message, 1024, _("cannot write the silence log '%s' (%s)"),
+        data->silence_log_file, strerror(errno));
+    print_warning(message);
+  }
+
+  return 0;
+}
+
+//renames the split plan to its name once it is complete (--plan)
+void finish_plan(main_data *data)
+{
+  if (!data->plan)
+  {
+    return;
+  }
+
+  if (close_atomic_file(data->plan, data->plan_temporary,
+        data->opt->plan_arg) == -1)
+  {
+    char message[1024] = { '\0' };
+    snprintf(message, 1024, _("cannot write the split plan '%s' (%s)"),
+        data->opt->plan_arg, strerror(errno));
+    print_warning(message);
+  }
+  data->plan = NULL;
+  data->plan_temporary = NULL;
+}
+
+//writes the cancel summary: the input files split, the output files
+//created from the interrupted input file and the input files left
+void write_cancel_summary(main_data *data, int current_file_is_done)
+{
+  char *temporary = NULL;
+  FILE *summary = open_atomic_file(data->cancel_log_file, "w", &temporary);
+  if (!summary)
+  {
+    print_warning(_("cannot write the cancel summary file"));
+    return;
+  }
+
+  int j = 0;
+  for (j = 0; j < data->current_file_index; j++)
+  {
+    fprintf(summary, "input_done %s\n", data->filenames[j]);
+  }
+
+  int first_pending = data->current_file_index;
+  if (data->current_file_index < data->number_of_filenames)
+  {
+    char *current_filename = data->filenames[data->current_file_index];
+    if (current_file_is_done)
+    {
+      fprintf(summary, "input_done %s\n", current_filename);
+      first_pending++;
+    }
+    else if (data->number_of_split_files > 0 ||
+        data->interrupted_file[0] != '\0')
+    {
+      fprintf(summary, "input_interrupted %s\n", current_filename);
+      int i = 0;
+      for (i = 0; i < data->number_of_split_files; i++)
+      {
+        fprintf(summary, "segment_done %s\n", data->split_files[i]);
+      }
+      if (data->interrupted_file[0] != '\0')
+      {
+        fprintf(summary, "segment_interrupted %s\n", data->interrupted_file);
+      }
+      first_pending++;
+    }
+  }
+
+  for (j = first_pending; j < data->number_of_filenames; j++)
+  {
+    fprintf(summary, "input_pending %s\n", data->filenames[j]);
+  }
+
+  if (close_atomic_file(summary, temporary, data->cancel_log_file) == -1)
+  {
+    print_warning(_("cannot write the cancel summary file"));
+  }
+  summary = NULL;
+}
+
+//writes what was done before a cancel request and stops the run with
+//the cancel exit code; always returns -1
+int exit_cancelled(main_data *data, int current_file_is_done)
+{
+  write_cancel_summary(data, current_file_is_done);
+  write_manifest(data);
+  finish_plan(data);
+  if (data->opt->m_option && !data->opt->P_option)
+  {
+    if (append_m3u_entries(data) != -1)
+    {
+      flush_m3u_files(data);
+    }
+  }
+
+  char message[1024] = { '\0' };
+  snprintf(message, 1024, _("\n split cancelled; summary written to '%s'"),
+      data->cancel_log_file);
+  fprintf(data->console_err, "%s\n", message);
+  fflush(data->console_err);
+
+  return stop_run(data, MP3SPLT_CANCELLED_EXIT_CODE);
+}
+
+//returns the options, or NULL on error
+options *new_options(main_data *data)
+{
+  options *opt = my_malloc(sizeof(options), data);
+  if (!opt)
+  {
+    return NULL;
+  }
+
+  opt->T_option = SPLT_FALSE;
+  opt->T_option_value = 0;
+  opt->w_option = SPLT_FALSE; opt->l_option = SPLT_FALSE;
+  opt->e_option = SPLT_FALSE; opt->f_option = SPLT_FALSE;
+  opt->c_option = SPLT_FALSE; opt->t_option = SPLT_FALSE;
+  opt->s_option = SPLT_FALSE; opt->a_option = SPLT_FALSE;
+  opt->p_option = SPLT_FALSE; opt->o_option = SPLT_FALSE;
+  opt->d_option = SPLT_FALSE; opt->k_option = SPLT_FALSE;
+  opt->g_option = SPLT_FALSE; opt->n_option = SPLT_FALSE;
+  opt->q_option = SPLT_FALSE; opt->i_option = SPLT_FALSE;
+  opt->N_option = SPLT_FALSE; opt->O_option = SPLT_FALSE;
+  opt->E_option = SPLT_FALSE;
+  opt->P_option = SPLT_FALSE;
+  opt->x_option = SPLT_FALSE;
+  opt->X_option = SPLT_FALSE;
+  opt->qq_option = SPLT_FALSE;
+  opt->A_option = SPLT_FALSE;
+  opt->m_option = SPLT_FALSE;
+  opt->S_option = SPLT_FALSE;
+  opt->S_option_value = 0;
+  opt->cddb_arg = NULL; opt->dir_arg = NULL;
+  opt->export_cue_arg = NULL;
+  opt->audacity_labels_arg = NULL;
+  opt->param_args = NULL;
+  opt->m3u_arg = NULL;
+  opt->output_format = NULL;
+
+  opt->custom_tags = NULL;
+
+  //we put the default values for freedb search
+  //by default, CDDB_CGI (cddb.cgi) port 80 on freedb2.org
+  opt->freedb_search_type = SPLT_FREEDB_SEARCH_TYPE_CDDB_CGI;
+  snprintf(opt->freedb_search_server,255, "%s", SPLT_FREEDB2_CGI_SITE);
+  opt->freedb_search_port = SPLT_FREEDB_CDDB_CGI_PORT;
+  //we put the default values for the freedb cddb file get
+  //by default, CDDB_CGI (cddb.cgi) port 80 on freedb2.org
+  opt->freedb_get_type = SPLT_FREEDB_GET_FILE_TYPE_CDDB_CGI;
+  snprintf(opt->freedb_get_server,255, "%s", SPLT_FREEDB2_CGI_SITE);
+  opt->freedb_get_port = SPLT_FREEDB_CDDB_CGI_PORT;
+
+  opt->freedb_arg_search_string[0] = '\0';
+  opt->freedb_arg_result_option = -1;
+
+  opt->splitpoints_file_arg = NULL;
+  opt->plan_arg = NULL;
+  opt->execute_plan_arg = NULL;
+  opt->manifest_arg = NULL;
+  opt->loudness_option = SPLT_FALSE;
+  opt->waveform_arg = NULL;
+  opt->retag_option = SPLT_FALSE;
+  opt->drop_cache_option = SPLT_FALSE;
+  opt->prefetch = 0;
+  opt->concat_option = SPLT_FALSE;
+  opt->order_arg = NULL;
+  opt->dedupe_arg = NULL;
+  opt->follow_option = SPLT_FALSE;
+  opt->watch_option = SPLT_FALSE;
+  opt->watch_jobs = 1;
+  opt->done_dir_arg = NULL;
+  opt->error_dir_arg = NULL;
+  opt->trace_arg = NULL;
+  opt->cddb_index_arg = NULL;
+  opt->adjust_jobs = -1;
+
+  opt->io_limit_option = SPLT_FALSE;
+  opt->io_limit = 0;
+  opt->io_priority_option = SPLT_FALSE;
+  opt->io_priority_class = MP3SPLT_IOPRIO_CLASS_BE;
+  opt->io_priority_level = 4;
+
+  return opt;
+}
+
+void print_version(FILE *std)
+{
+  char version[128] = { '\0' };
+  mp3splt_get_version(version);
+  fprintf(std, PACKAGE_NAME" "VERSION" ("MP3SPLT_DATE") -"
+      " %s libmp3splt %s\n",_("using"),version);
+  fflush(std);
+}
+
+void print_authors(FILE *std)
+{
+  fprintf(std, "\t"MP3SPLT_AUTHOR1" "MP3SPLT_EMAIL1"\n\t"MP3SPLT_AUTHOR2" "MP3SPLT_EMAIL2"\n");
+  fflush(std);
+}
+
+void print_no_warranty(FILE *std)
+{
+  fprintf(std, _("THIS SOFTWARE COMES WITH ABSOLUTELY NO WARRANTY!"
+        " USE AT YOUR OWN RISK!\n"));
+  fflush(std);
+}
+
+//output package, version and authors
+void print_version_authors(FILE *std)
+{
+  print_version(std);
+  print_authors(std);
+  print_no_warranty(std);
+}
+
+//keeps the energy of the level in its 100 ms block (--loudness)
+void append_loudness_level(silence_level *sl, long time, float level)
+{
+  if (time < 0)
+  {
+    return;
+  }
+
+  long block = time / MP3SPLT_LOUDNESS_BLOCK;
+  if (block >= sl->blocks_capacity)
+  {
+    long capacity = (sl->blocks_capacity > 0) ? sl->blocks_capacity : 1024;
+    while (block >= capacity)
+    {
+      capacity *= 2;
+    }
+    loudness_block *blocks =
+      realloc(sl->blocks, sizeof(loudness_block) * capacity);
+    if (!blocks)
+    {
+      stop_split_on_error(callbacks_data, _("cannot allocate memory !"));
+      return;
+    }
+    memset(blocks + sl->blocks_capacity, 0,
+        sizeof(loudness_block) * (capacity - sl->blocks_capacity));
+    sl->blocks = blocks;
+    sl->blocks_capacity = capacity;
+  }
+
+  loudness_block *current = &sl->blocks[block];
+  if ((current->number_of_levels == 0) || (level > current->peak))
+  {
+    current->peak = level;
+  }
+  current->energy += pow(10.0, level / 10.0);
+  current->number_of_levels++;
+
+  if (block >= sl->number_of_blocks)
+  {
+    sl->number_of_blocks = block + 1;
+  }
+}
+
+//returns the sample rate of the input file from its first mp3 frame or
+//its vorbis identification header, or 0 if unknown; 'frame_samples' is
+//set to the number of samples of a mp3 frame, or 0
+long get_input_sample_rate(const char *filename, long *frame_samples)
+{
+  *frame_samples = 0;
+  FILE *in = fopen(filename, "rb");
+  if (!in)
+  {
+    return 0;
+  }
+
+  unsigned char buffer[16384];
+  size_t size = fread(buffer, 1, sizeof(buffer), in);
+  fclose(in);
+
+  size_t offset = 0;
+  if ((size >= 10) && (memcmp(buffer, "ID3", 3) == 0))
+  {
+    offset = 10 + (((buffer[6] & 0x7F) << 21) | ((buffer[7] & 0x7F) << 14) |
+        ((buffer[8] & 0x7F) << 7) | (buffer[9] & 0x7F));
+  }
+
+  long sample_rate = 0;
+  for (; (offset + 4 <= size) && (sample_rate == 0); offset++)
+  {
+    double duration = 0;
+    if ((offset + 23 <= size) && (memcmp(buffer + offset, "\001vorbis", 7) == 0))
+    {
+      const unsigned char *rate = buffer + offset + 12;
+      sample_rate = rate[0] | (rate[1] << 8) | (rate[2] << 16) |
+        ((long) rate[3] << 24);
+    }
+    else if (mp3_frame_length(buffer + offset, &duration, &sample_rate) == 0)
+    {
+      sample_rate = 0;
+    }
+    else
+    {
+      *frame_samples = (long) (duration * sample_rate + 0.5);
+    }
+  }
+
+  return sample_rate;
+}
+
+//prepares the waveform peaks of the input file (--waveform)
+void start_waveform(main_data *data, const char *filename)
+{
+  silence_level *sl = data->sl;
+
+  sl->number_of_peaks = 0;
+  long frame_samples = 0;
+  sl->sample_rate = get_input_sample_rate(filename, &frame_samples);
+  if (sl->sample_rate <= 0)
+  {
+    sl->sample_rate = MP3SPLT_WAVEFORM_SAMPLE_RATE;
+  }
+
+  //there is one level per frame, at a time in hundreths of seconds: the
+  //pixels are not smaller, or they would repeat the previous level
+  long minimum = (sl->sample_rate + 99) / 100;
+  if (frame_samples > minimum)
+  {
+    minimum = frame_samples;
+  }
+  sl->samples_per_pixel = sl->requested_samples_per_pixel;
+  if (sl->samples_per_pixel <= 0)
+  {
+    sl->samples_per_pixel = minimum;
+  }
+  else if (sl->samples_per_pixel < minimum)
+  {
+    sl->samples_per_pixel = minimum;
+    char message[1024] = { '\0' };
+    snprintf(message, 1024, _("the waveform of '%s' has %ld samples per pixel:"
+          " its levels are not finer than one frame"), filename, minimum);
+    print_warning(message);
+  }
+}
+
+//keeps the highest amplitude of the level in its waveform pixel
+void append_waveform_level(silence_level *sl, long time, float level)
+{
+  if (time < 0)
+  {
+    return;
+  }
+
+  long pixel = (long) ((double) time * sl->sample_rate /
+      (100.0 * sl->samples_per_pixel));
+  if (pixel >= sl->peaks_capacity)
+  {
+    long capacity = (sl->peaks_capacity > 0) ? sl->peaks_capacity : 4096;
+    while (pixel >= capacity)
+    {
+      capacity *= 2;
+    }
+    float *peaks = realloc(sl->peaks, sizeof(float) * capacity);
+    if (!peaks)
+    {
+      stop_split_on_error(callbacks_data, _("cannot allocate memory !"));
+      return;
+    }
+    sl->peaks = peaks;
+    sl->peaks_capacity = capacity;
+  }
+
+  if (pixel >= sl->number_of_peaks)
+  {
+    //the pixels without level keep the previous amplitude
+    float previous = (sl->number_of_peaks > 0) ?
+      sl->peaks[sl->number_of_peaks - 1] : 0;
+    while (sl->number_of_peaks < pixel)
+    {
+      sl->peaks[sl->number_of_peaks++] = previous;
+    }
+    sl->peaks[pixel] = 0;
+    sl->number_of_peaks = pixel + 1;
+  }
+
+  float amplitude = pow(10.0, level / 20.0);
+  if (amplitude > sl->peaks[pixel])
+  {
+    sl->peaks[pixel] = amplitude;
+  }
+}
+
+void get_silence_level(long time, float level, void *user_data)
+{
+  silence_level *sl = user_data;
+  if (level == INT_MIN)
+  {
+    sl->print_silence_level = SPLT_FALSE;
+  }
+  else if (level == INT_MAX)
+  {
+    sl->print_silence_level = SPLT_TRUE;
+  }
+  else
+  {
+    sl->level_sum += level;
+    sl->number_of_levels++;
+    if (sl->keep_levels)
+    {
+      append_loudness_level(sl, time, level);
+    }
+    if (sl->keep_peaks)
+    {
+      append_waveform_level(sl, time, level);
+    }
+  }
+}
+
+//keeps an argument left out of the command line of the splits (--watch);
+//returns -1 on error
+int keep_watch_argument(main_data *data, char *argument)
+{
+  char **watch_arguments = my_realloc(data->watch_arguments,
+      sizeof(char *) * (data->number_of_watch_arguments + 1), data);
+  if (!watch_arguments)
+  {
+    return -1;
+  }
+  data->watch_arguments = watch_arguments;
+  data->watch_arguments[data->number_of_watch_arguments] = argument;
+  data->number_of_watch_arguments++;
+
+  return 0;
+}
+
+//keeps the watch option just parsed by getopt and its separate argument;
+//returns -1 on error
+int keep_watch_option(main_data *data)
+{
+  char *option = data->argv[optind - 1];
+  if (optarg && (optarg == option) && (optind >= 2))
+  {
+    if (keep_watch_argument(data, data->argv[optind - 2]) == -1)
+    {
+      return -1;
+    }
+  }
+  return keep_watch_argument(data, option);
+}
+
+//returns -1 on error
+int append_filename(main_data *data, const char *str)
+{
+  if (data)
+  {
+    char **filenames = NULL;
+    if (!data->filenames)
+    {
+      filenames = my_malloc(sizeof(char *), data);
+    }
+    else
+    {
+      filenames = my_realloc(data->filenames, sizeof(char *) *
+          (data->number_of_filenames + 1), data);
+    }
+    if (!filenames)
+    {
+      return -1;
+    }
+    data->filenames = filenames;
+    data->filenames[data->number_of_filenames] = NULL;
+    if (str != NULL)
+    {
+      int malloc_size = strlen(str) + 1;
+      data->filenames[data->number_of_filenames] = my_malloc(sizeof(char) * 
+          malloc_size, data);
+      if (!data->filenames[data->number_of_filenames])
+      {
+        return -1;
+      }
+      snprintf(data->filenames[data->number_of_filenames],malloc_size, "%s",str);
+      data->number_of_filenames++;
+    }
+  }
+
+  return 0;
+}
+
+//the splitpoints array grows by doubling its size, so that appending
+//many splitpoints is not quadratic; returns -1 on error
+int append_splitpoint(main_data *data, long value)
+{
+  if (data)
+  {
+    if (data->number_of_splitpoints >= data->splitpoints_capacity)
+    {
+      int new_capacity = data->splitpoints_capacity * 2;
+      if (new_capacity < 16)
+      {
+        new_capacity = 16;
+      }
+
+      long *splitpoints = NULL;
+      if (!data->splitpoints)
+      {
+        splitpoints = my_malloc(sizeof(long) * new_capacity, data);
+      }
+      else
+      {
+        splitpoints = my_realloc(data->splitpoints,
+            sizeof(long) * new_capacity, data);
+      }
+      if (!splitpoints)
+      {
+        return -1;
+      }
+      data->splitpoints = splitpoints;
+      data->splitpoints_capacity = new_capacity;
+    }
+    data->splitpoints[data->number_of_splitpoints] = value;
+    data->number_of_splitpoints++;
+  }
+
+  return 0;
+}
+
+//reads the splitpoints from the binary splitpoints file 'in', after the
+//magic header; returns -1 on error
+int read_binary_splitpoints(main_data *data, FILE *in)
+{
+  unsigned char buffer[4096];
+  size_t read_bytes = 0;
+  size_t left_bytes = 0;
+
+  while ((read_bytes = fread(buffer + left_bytes, 1,
+          sizeof(buffer) - left_bytes, in)) > 0)
+  {
+    size_t total = left_bytes + read_bytes;
+    size_t i = 0;
+    for (i = 0; i + 4 <= total; i += 4)
+    {
+      unsigned long value = buffer[i] | (buffer[i+1] << 8) |
+        (buffer[i+2] << 16) | ((unsigned long) buffer[i+3] << 24);
+      long splitpoint = (value == 0xFFFFFFFFUL) ? LONG_MAX : (long) value;
+      if (append_splitpoint(data, splitpoint) == -1)
+      {
+        return -1;
+      }
+    }
+    left_bytes = total - i;
+    memmove(buffer, buffer + i, left_bytes);
+  }
+
+  if (left_bytes != 0)
+  {
+    print_warning(_("truncated binary splitpoints file"));
+  }
+
+  return 0;
+}
+
+//parses one line of a text splitpoints file; returns -1 on error
+int parse_splitpoints_line(main_data *data, char *line, int line_number)
+{
+  char *end = line + strlen(line);
+  while ((end > line) && isspace((unsigned char) end[-1]))
+  {
+    end--;
+  }
+  *end = '\0';
+
+  if ((line[0] == '\0') || (line[0] == '#'))
+  {
+    return 0;
+  }
+
+  long hundreths = c_hundreths(line);
+  if (hundreths == -1)
+  {
+    char message[512] = { '\0' };
+    snprintf(message, 512, _("bad splitpoint '%s' at line %d of the"
+          " splitpoints file"), line, line_number);
+    return print_run_error(message, data);
+  }
+
+  return append_splitpoint(data, hundreths);
+}
+
+//reads the splitpoints from the text splitpoints file 'in': one
+//splitpoint per line, in the TIME FORMAT; empty lines and lines starting
+//with '#' are ignored; lines longer than 255 characters are refused;
+//returns -1 on error
+int read_text_splitpoints(main_data *data, FILE *in,
+    const char *first_bytes, size_t first_bytes_length)
+{
+  char line[256] = { '\0' };
+  size_t line_length = 0;
+  int line_number = 0;
+
+  //the first bytes were already read when looking for the binary header
+  char buffer[4096];
+  size_t length = first_bytes_length;
+  memcpy(buffer, first_bytes, length);
+
+  do {
+    size_t i = 0;
+    for (i = 0; i < length; i++)
+    {
+      if (buffer[i] == '\n')
+      {
+        line[line_length] = '\0';
+        line_number++;
+        if (parse_splitpoints_line(data, line, line_number) == -1)
+        {
+          return -1;
+        }
+        line_length = 0;
+      }
+      else if (line_length < sizeof(line) - 1)
+      {
+        line[line_length] = buffer[i];
+        line_length++;
+      }
+      else
+      {
+        char message[512] = { '\0' };
+        snprintf(message, 512, _("line %d of the splitpoints file is too"
+              " long"), line_number + 1);
+        return print_run_error(message, data);
+      }
+    }
+  } while ((length = fread(buffer, 1, sizeof(buffer), in)) > 0);
+
+  if (line_length > 0)
+  {
+    line[line_length] = '\0';
+    line_number++;
+    return parse_splitpoints_line(data, line, line_number);
+  }
+
+  return 0;
+}
+
+//reads the splitpoints from a file (--splitpoints), or from stdin if the
+//filename is '-'; the file is a text file or a binary file starting with
+//MP3SPLT_SPLITPOINTS_MAGIC; returns -1 on error
+int read_splitpoints_file(main_data *data, const char *filename)
+{
+  FILE *in = NULL;
+  if (strcmp(filename, "-") == 0)
+  {
+    in = stdin;
+  }
+  else
+  {
+    in = fopen(filename, "rb");
+  }
+
+  if (!in)
+  {
+    char message[1024] = { '\0' };
+    snprintf(message, 1024, _("cannot open the splitpoints file '%s' (%s)"),
+        filename, strerror(errno));
+    return print_run_error(message, data);
+  }
+
+  char header[8];
+  size_t magic_length = strlen(MP3SPLT_SPLITPOINTS_MAGIC);
+  size_t header_length = fread(header, 1, magic_length, in);
+  int result = 0;
+  if ((header_length == magic_length) &&
+      (memcmp(header, MP3SPLT_SPLITPOINTS_MAGIC, magic_length) == 0))
+  {
+    result = read_binary_splitpoints(data, in);
+  }
+  else
+  {
+    result = read_text_splitpoints(data, in, header, header_length);
+  }
+
+  if (in != stdin)
+  {
+    fclose(in);
+  }
+
+  return result;
+}
+
+//returns SPLT_TRUE if the output format contains the @x variable
+int output_format_has_hash_variable(const char *format)
+{
+  const char *ptr = format;
+  while ((ptr = strchr(ptr, '@')) != NULL)
+  {
+    if (ptr[1] == 'x')
+    {
+      return SPLT_TRUE;
+    }
+    ptr++;
+  }
+
+  return SPLT_FALSE;
+}
+
+//replaces the @x variable of the output format with the first hex digits
+//of the hash of the input file path, as given; a digit may follow for the
+//number of hex digits (default 2). The format is expanded once for each
+//input file, before its segments are known: all the files split from an
+//input file have the same hash
+//-the result must be freed; NULL on error
+char *expand_hash_variables(const char *format, const char *filename,
+    main_data *data)
+{
+  char hash_digits[17] = { '\0' };
+  unsigned long long hash =
+    fnv1a_hash(filename, strlen(filename), MP3SPLT_FNV_OFFSET);
+  snprintf(hash_digits, 17, "%016llx", hash);
+
+  int malloc_size = strlen(format) * 8 + 1;
+  char *expanded = my_malloc(sizeof(char) * malloc_size, data);
+  if (!expanded)
+  {
+    return NULL;
+  }
+
+  const char *ptr = format;
+  char *out = expanded;
+  while (*ptr != '\0')
+  {
+    if ((ptr[0] == '@') && (ptr[1] == 'x'))
+    {
+      int number_of_digits = 2;
+      ptr += 2;
+      if (isdigit(*ptr) && (*ptr != '0'))
+      {
+        number_of_digits = *ptr - '0';
+        ptr++;
+      }
+      memcpy(out, hash_digits, number_of_digits);
+      out += number_of_digits;
+    }
+    else
+    {
+      *out = *ptr;
+      out++;
+      ptr++;
+    }
+  }
+  *out = '\0';
+
+  return expanded;
+}
+
+//returns SPLT_TRUE if we have already created the directory 'path'
+//and adds it to the cache otherwise; the cache only saves mkdir calls, so
+//the directory is not cached when memory is missing
+int directory_is_cached(main_data *data, const char *path)
+{
+  directory_cache *cache = data->dir_cache;
+  unsigned long long hash = fnv1a_hash(path, strlen(path), MP3SPLT_FNV_OFFSET);
+  int bucket = hash % MP3SPLT_DIR_CACHE_BUCKETS;
+
+  created_dir *dir = cache->buckets[bucket];
+  while (dir)
+  {
+    if (strcmp(dir->path, path) == 0)
+    {
+      return SPLT_TRUE;
+    }
+    dir = dir->next;
+  }
+
+  dir = malloc(sizeof(created_dir));
+  if (!dir)
+  {
+    return SPLT_FALSE;
+  }
+  dir->path = strdup(path);
+  if (!dir->path)
+  {
+    free(dir);
+    return SPLT_FALSE;
+  }
+  dir->next = cache->buckets[bucket];
+  cache->buckets[bucket] = dir;
+  cache->number_of_dirs++;
+
+  return SPLT_FALSE;
+}
+
+//creates the directory 'path' and its parents; directories already
+//created by a previous call are not checked again
+//returns -1 on error
+int create_directories_cached(main_data *data, const char *path)
+{
+  if (directory_is_cached(data, path))
+  {
+    return 0;
+  }
+
+  char *dir = strdup(path);
+  if (!dir)
+  {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  int result = 0;
+  char *ptr = dir;
+  do {
+    ptr = strchr(ptr + 1, SPLT_DIRCHAR);
+    if (ptr)
+    {
+      *ptr = '\0';
+    }
+
+#ifdef __WIN32__
+    int mkdir_result = mkdir(dir);
+#else
+    int mkdir_result = mkdir(dir, S_IRWXU | S_IRWXG | S_IRWXO);
+#endif
+    if ((mkdir_result == -1) && (errno != EEXIST))
+    {
+      //only the last directory must really exist
+      if (!ptr)
+      {
+        result = -1;
+      }
+    }
+
+    if (ptr)
+    {
+      *ptr = SPLT_DIRCHAR;
+    }
+  } while (ptr);
+
+  free(dir);
+  dir = NULL;
+
+  return result;
+}
+
+//sets the output format (-o) for the current file to split:
+//expands the @x variable and, if the directory part of the format has no
+//other variable, creates the output directory once and gives it to the
+//library as the path of split; returns -1 on error
+int set_output_format_for_file(main_data *data, const char *filename)
+{
+  options *opt = data->opt;
+  splt_state *state = data->state;
+  int err = SPLT_OK;
+
+  if (!opt->o_option || !opt->output_format ||
+      (strcmp(opt->output_format, "-") == 0))
+  {
+    return 0;
+  }
+
+  char *format = NULL;
+  if (output_format_has_hash_variable(opt->output_format))
+  {
+    format = expand_hash_variables(opt->output_format, filename, data);
+    if (!format)
+    {
+      return -1;
+    }
+  }
+  else
+  {
+    format = strdup(opt->output_format);
+    if (!format)
+    {
+      return print_run_error(_("cannot allocate memory !"), data);
+    }
+  }
+
+  char *last_dirchar = strrchr(format, SPLT_DIRCHAR);
+  if (last_dirchar && !opt->P_option && !opt->m_option)
+  {
+    *last_dirchar = '\0';
+  }
+  else
+  {
+    last_dirchar = NULL;
+  }
+
+  //the directory part only contains text: we create it ourselves
+  if (last_dirchar && (strchr(format, '@') == NULL))
+  {
+    char *ptr = format;
+    while ((ptr = strchr(ptr, '+')) != NULL)
+    {
+      *ptr = ' ';
+    }
+
+    char *base_dir = NULL;
+    if (opt->d_option)
+    {
+      base_dir = strdup(opt->dir_arg);
+    }
+    else
+    {
+      base_dir = strdup(filename);
+      if (base_dir)
+      {
+        char *end = strrchr(base_dir, SPLT_DIRCHAR);
+        if (end) { *end = '\0'; } else { base_dir[0] = '\0'; }
+      }
+    }
+    if (!base_dir)
+    {
+      free(format);
+      return print_run_error(_("cannot allocate memory !"), data);
+    }
+
+    int malloc_size = strlen(base_dir) + strlen(format) + 2;
+    char *output_dir = my_malloc(sizeof(char) * malloc_size, data);
+    if (!output_dir)
+    {
+      free(base_dir);
+      free(format);
+      return -1;
+    }
+    if (base_dir[0] != '\0')
+    {
+      snprintf(output_dir, malloc_size, "%s%c%s", base_dir, SPLT_DIRCHAR, format);
+    }
+    else
+    {
+      snprintf(output_dir, malloc_size, "%s", format);
+    }
+    free(base_dir);
+    base_dir = NULL;
+
+    if (create_directories_cached(data, output_dir) == -1)
+    {
+      char message[1024] = { '\0' };
+      snprintf(message, 1024, _("cannot create directory '%s' (%s)"),
+          output_dir, strerror(errno));
+      free(output_dir);
+      free(format);
+      return print_run_error(message, data);
+    }
+
+    mp3splt_set_int_option(state, SPLT_OPT_CREATE_DIRS_FROM_FILENAMES, SPLT_FALSE);
+    err = mp3splt_set_path_of_split(state, output_dir);
+    if (err >= 0)
+    {
+      err = SPLT_OK;
+      mp3splt_set_oformat(state, last_dirchar + 1, &err);
+    }
+
+    free(output_dir);
+    output_dir = NULL;
+  }
+  else
+  {
+    if (last_dirchar)
+    {
+      *last_dirchar = SPLT_DIRCHAR;
+    }
+    mp3splt_set_oformat(state, format, &err);
+  }
+
+  free(format);
+  format = NULL;
+
+  return process_confirmation_error(err, data);
+}
+
+//finds the plugins the first time we need them, so that runs stopping
+//before (bad arguments, no input file, cancelled confirmation, ...) don't
+//scan the plugin directories and open all the plugins; returns -1 on
+//error
+int find_plugins_once(main_data *data)
+{
+  if (data->plugins_found)
+  {
+    return 0;
+  }
+  data->plugins_found = SPLT_TRUE;
+
+  double start = trace_begin(data);
+  int err = mp3splt_find_plugins(data->state);
+  trace_end(data, "find plugins", NULL, start, -1);
+  return process_confirmation_error(err, data);
+}
+
+//keeps a copy of the splitpoints and tags that the library has read
+//from the cue, cddb or audacity file; returns -1 on error
+int cache_splitpoints(main_data *data)
+{
+  splitpoints_cache *cache = data->sp_cache;
+  int err = SPLT_OK;
+
+  int number_of_points = 0;
+  const splt_point *points =
+    mp3splt_get_splitpoints(data->state, &number_of_points, &err);
+  if (process_confirmation_error(err, data) == -1)
+  {
+    return -1;
+  }
+
+  int number_of_tags = 0;
+  const splt_tags *tags = mp3splt_get_tags(data->state, &number_of_tags, &err);
+  if (process_confirmation_error(err, data) == -1)
+  {
+    return -1;
+  }
+
+  int i = 0;
+  if (number_of_points > 0)
+  {
+    cache->points = my_malloc(sizeof(splt_point) * number_of_points, data);
+    if (!cache->points)
+    {
+      return -1;
+    }
+    for (i = 0; i < number_of_points; i++)
+    {
+      cache->points[i].value = points[i].value;
+      cache->points[i].type = points[i].type;
+      cache->points[i].name = strdup_or_null(points[i].name);
+    }
+  }
+  cache->number_of_points = number_of_points;
+
+  if (number_of_tags > 0)
+  {
+    cache->tags = my_malloc(sizeof(splt_tags) * number_of_tags, data);
+    if (!cache->tags)
+    {
+      return -1;
+    }
+    for (i = 0; i < number_of_tags; i++)
+    {
+      cache->tags[i] = tags[i];
+      cache->tags[i].title = strdup_or_null(tags[i].title);
+      cache->tags[i].artist = strdup_or_null(tags[i].artist);
+      cache->tags[i].album = strdup_or_null(tags[i].album);
+      cache->tags[i].performer = strdup_or_null(tags[i].performer);
+      cache->tags[i].year = strdup_or_null(tags[i].year);
+      cache->tags[i].comment = strdup_or_null(tags[i].comment);
+    }
+  }
+  cache->number_of_tags = number_of_tags;
+
+  cache->loaded = SPLT_TRUE;
+
+  return 0;
+}
+
+//sets the cached splitpoints and tags to the library
+//returns SPLT_FALSE if we have nothing cached, -1 on error
+int put_cached_splitpoints(main_data *data)
+{
+  splitpoints_cache *cache = data->sp_cache;
+  if (!cache->loaded)
+  {
+    return SPLT_FALSE;
+  }
+
+  int err = SPLT_OK;
+  int i = 0;
+  for (i = 0; i < cache->number_of_points; i++)
+  {
+    err = mp3splt_append_splitpoint(data->state, cache->points[i].value,
+        cache->points[i].name, cache->points[i].type);
+    if (process_confirmation_error(err, data) == -1)
+    {
+      return -1;
+    }
+  }
+
+  for (i = 0; i < cache->number_of_tags; i++)
+  {
+    splt_tags *tags = &cache->tags[i];
+    err = mp3splt_append_tags(data->state, tags->title, tags->artist,
+        tags->album, tags->performer, tags->year, tags->comment,
+        tags->track, tags->genre);
+    if (process_confirmation_error(err, data) == -1)
+    {
+      return -1;
+    }
+  }
+
+  return SPLT_TRUE;
+}
+
+//writes a field of the split plan
+void write_plan_field(FILE *plan, const char *field)
+{
+  fputc('\t', plan);
+
+  if (field)
+  {
+    write_tsv_string(plan, field);
+  }
+}
+
+//writes a time of the split plan, in hundreths of seconds
+void write_plan_time(FILE *plan, long hundreths)
+{
+  if (hundreths == LONG_MAX)
+  {
+    fputs("\tEOF", plan);
+  }
+  else
+  {
+    fprintf(plan, "\t%ld", hundreths);
+  }
+}
+
+//returns the duration of a mp3 file in hundredths of seconds, from its
+//frames; returns -1 if the file cannot be read
+long get_mp3_duration(main_data *data, const char *filename)
+{
+  FILE *in = fopen(filename, "rb");
+  if (!in)
+  {
+    return -1;
+  }
+
+  output_check check;
+  memset(&check, 0, sizeof(check));
+
+  unsigned char *buffer = malloc(sizeof(unsigned char) * 65536);
+  if (!buffer)
+  {
+    fclose(in);
+    return -1;
+  }
+  size_t read_bytes = 0;
+  while ((read_bytes = fread(buffer, 1, 65536, in)) > 0)
+  {
+    check_mp3_frames(&check, buffer, read_bytes);
+  }
+  int read_error = ferror(in);
+  fclose(in);
+  free(buffer);
+  buffer = NULL;
+
+  if (read_error)
+  {
+    return -1;
+  }
+
+  return (long) (check.duration * 100 + 0.5);
+}
+
+//with -S, the segment times of --plan come from the duration of the mp3
+//frames, that the ogg files don't have: they are refused before the
+//split; returns -1 in that case
+int check_segment_times_input(main_data *data, const char *filename)
+{
+  options *opt = data->opt;
+  if (!opt->S_option || !opt->plan_arg)
+  {
+    return 0;
+  }
+
+  const char *extension = strrchr(filename, '.');
+  if (extension && (strcasecmp(extension, ".mp3") == 0))
+  {
+    return 0;
+  }
+
+  char message[1024] = { '\0' };
+  snprintf(message, 1024, _("cannot use -S with --plan on '%s':"
+        " only the duration of mp3 files is known"), filename);
+  return print_run_error(message, data);
+}
+
+//finds the begin and end times in hundreths of seconds of the files created
+//by the last split of 'filename', like the library: from its splitpoints,
+//from the split time with -t or from the duration of the mp3 file with -S,
+//and with the overlap of -O added to the ends; returns SPLT_FALSE if they
+//cannot be found, -1 on error
+int get_segment_times(main_data *data, const char *filename, long **begins,
+    long **ends)
+{
+  options *opt = data->opt;
+  splt_state *state = data->state;
+  int err = SPLT_OK;
+
+  *begins = NULL;
+  *ends = NULL;
+  if (data->number_of_split_files == 0)
+  {
+    return SPLT_FALSE;
+  }
+
+  int number_of_points = 0;
+  const splt_point *points =
+    mp3splt_get_splitpoints(state, &number_of_points, &err);
+  if (process_confirmation_error(err, data) == -1)
+  {
+    return -1;
+  }
+
+  //the time split does not keep its splitpoints: segments follow each
+  //other; with -S, they have the same length (in hundreths of seconds)
+  double split_time = 0;
+  if (opt->t_option)
+  {
+    split_time =
+      mp3splt_get_float_option(state, SPLT_OPT_SPLIT_TIME, &err) * 100.0;
+  }
+  else if (opt->S_option)
+  {
+    long duration = get_mp3_duration(data, filename);
+    if ((duration <= 0) || (opt->S_option_value <= 0))
+    {
+      return SPLT_FALSE;
+    }
+    split_time = duration / (double) opt->S_option_value;
+  }
+
+  long overlap = 0;
+  if (opt->O_option)
+  {
+    overlap = mp3splt_get_long_option(state, SPLT_OPT_OVERLAP_TIME, &err);
+  }
+
+  *begins = my_malloc(sizeof(long) * data->number_of_split_files, data);
+  *ends = my_malloc(sizeof(long) * data->number_of_split_files, data);
+  if (!*begins || !*ends)
+  {
+    free(*begins);
+    *begins = NULL;
+    free(*ends);
+    *ends = NULL;
+    return -1;
+  }
+
+  int segment = 0;
+  int point = 0;
+  for (segment = 0; segment < data->number_of_split_files; segment++)
+  {
+    long begin = 0;
+    long end = LONG_MAX;
+
+    if (opt->t_option || opt->S_option)
+    {
+      begin = (long) (segment * split_time);
+      if (segment < data->number_of_split_files - 1)
+      {
+        end = (long) ((segment + 1) * split_time);
+      }
+    }
+    else
+    {
+      //the skippoints (removed silence) don't create files
+      while ((point < number_of_points - 1) &&
+          (points[point].type == SPLT_SKIPPOINT))
+      {
+        point++;
+      }
+      if (point >= number_of_points - 1)
+      {
+        free(*begins);
+        *begins = NULL;
+        free(*ends);
+        *ends = NULL;
+        return SPLT_FALSE;
+      }
+      begin = points[point].value;
+      end = points[point + 1].value;
+      point++;
+    }
+
+    if ((overlap > 0) && (end != LONG_MAX))
+    {
+      end = (end < LONG_MAX - overlap) ? end + overlap : LONG_MAX;
+    }
+
+    (*begins)[segment] = begin;
+    (*ends)[segment] = end;
+  }
+
+  return SPLT_TRUE;
+}
+
+//writes the segments that the pretend split of 'filename' would have
+//created in the split plan (--plan); each line is a self-contained segment
+//so that the plan can be shared between several mp3splt --execute-plan;
+//returns -1 on error
+int write_plan_for_file(main_data *data, const char *filename)
+{
+  options *opt = data->opt;
+  splt_state *state = data->state;
+
+  if (!data->plan)
+  {
+    data->plan = open_atomic_file(opt->plan_arg, "w", &data->plan_temporary);
+    if (!data->plan)
+    {
+      char message[1024] = { '\0' };
+      snprintf(message, 1024, _("cannot write the split plan '%s' (%s)"),
+          opt->plan_arg, strerror(errno));
+      return print_run_error(message, data);
+    }
+    fprintf(data->plan, "%s\n", MP3SPLT_PLAN_HEADER);
+  }
+
+  int err = SPLT_OK;
+  int number_of_tags = 0;
+  const splt_tags *tags = mp3splt_get_tags(state, &number_of_tags, &err);
+  if (process_confirmation_error(err, data) == -1)
+  {
+    return -1;
+  }
+
+  long *begins = NULL;
+  long *ends = NULL;
+  int found = get_segment_times(data, filename, &begins, &ends);
+  if (found == -1)
+  {
+    return -1;
+  }
+  if (!found)
+  {
+    char message[1024] = { '\0' };
+    snprintf(message, 1024,
+        _("cannot write the split plan of '%s': unknown segment times"),
+        filename);
+    print_warning(message);
+    return 0;
+  }
+
+  int segment = 0;
+  for (segment = 0; segment < data->number_of_split_files; segment++)
+  {
+    fputs("segment", data->plan);
+    write_plan_field(data->plan, filename);
+    write_plan_time(data->plan, begins[segment]);
+    write_plan_time(data->plan, ends[segment]);
+    write_plan_field(data->plan, data->split_files[segment]);
+
+    if (segment < number_of_tags)
+    {
+      const splt_tags *current_tags = &tags[segment];
+      write_plan_field(data->plan, current_tags->title);
+      write_plan_field(data->plan, current_tags->artist);
+      write_plan_field(data->plan, current_tags->album);
+      write_plan_field(data->plan, current_tags->performer);
+      write_plan_field(data->plan, current_tags->year);
+      write_plan_field(data->plan, current_tags->comment);
+      fprintf(data->plan, "\t%d\t%d", current_tags->track,
+          (int) current_tags->genre);
+    }
+
+    fputc('\n', data->plan);
+  }
+
+  free(begins);
+  free(ends);
+
+  if (fflush(data->plan) != 0)
+  {
+    return print_run_error(_("cannot write the split plan"), data);
+  }
+
+  return 0;
+}
+
+//estimates the level and the peak level of the levels between 'begin'
+//and 'end' (hundreths of seconds), gated like EBU R128 with 400 ms
+//windows, an absolute gate at -70 and a relative gate at -10; the levels
+//of the silence detection are not K-weighted and are averaged per frame,
+//so it is not a loudness; returns SPLT_FALSE if there is no level above
+//the gates
+int estimate_level(silence_level *sl, long begin, long end,
+    double *level, double *peak)
+{
+  long first = begin / MP3SPLT_LOUDNESS_BLOCK;
+  long last = (end == LONG_MAX) ? sl->number_of_blocks :
+    end / MP3SPLT_LOUDNESS_BLOCK;
+  if (last > sl->number_of_blocks)
+  {
+    last = sl->number_of_blocks;
+  }
+  if (first >= last)
+  {
+    return SPLT_FALSE;
+  }
+
+  int have_peak = SPLT_FALSE;
+  long block = 0;
+  for (block = first; block < last; block++)
+  {
+    loudness_block *current = &sl->blocks[block];
+    if ((current->number_of_levels > 0) &&
+        (!have_peak || (current->peak > *peak)))
+    {
+      *peak = current->peak;
+      have_peak = SPLT_TRUE;
+    }
+  }
+
+  //two passes: absolute gate, then relative gate from the first mean
+  double threshold = -70;
+  int pass = 0;
+  double mean = 0;
+  for (pass = 0; pass < 2; pass++)
+  {
+    double energy_sum = 0;
+    long number_of_windows = 0;
+    long window = 0;
+    for (window = first; window < last; window++)
+    {
+      double energy = 0;
+      unsigned long number_of_levels = 0;
+      long block_end = window + MP3SPLT_LOUDNESS_WINDOW;
+      if (block_end > last)
+      {
+        //segments shorter than a window have a single window
+        if (window > first)
+        {
+          break;
+        }
+        block_end = last;
+      }
+      for (block = window; block < block_end; block++)
+      {
+        energy += sl->blocks[block].energy;
+        number_of_levels += sl->blocks[block].number_of_levels;
+      }
+      if (number_of_levels == 0)
+      {
+        continue;
+      }
+
+      energy /= number_of_levels;
+      if (10 * log10(energy) > threshold)
+      {
+        energy_sum += energy;
+        number_of_windows++;
+      }
+    }
+
+    if (number_of_windows == 0)
+    {
+      return SPLT_FALSE;
+    }
+
+    mean = energy_sum / number_of_windows;
+    threshold = 10 * log10(mean) - 10;
+  }
+
+  *level = 10 * log10(mean);
+
+  return SPLT_TRUE;
+}
+
+//prints the estimated levels of the input file (-i) or of the files
+//created from it, from the levels of the silence detection (--loudness);
+//returns -1 on error
+int print_estimated_levels(main_data *data, const char *filename)
+{
+  silence_level *sl = data->sl;
+  char message[1024] = { '\0' };
+  double level = 0;
+  double peak = 0;
+
+  if (data->opt->i_option)
+  {
+    if (!estimate_level(sl, 0, LONG_MAX, &level, &peak))
+    {
+      snprintf(message, 1024,
+          _("no level to estimate the level of '%s'"), filename);
+      print_warning(message);
+      return 0;
+    }
+
+    snprintf(message, 1024,
+        _(" Estimated level: %.2f dB, estimated peak level %.2f dB"),
+        level, peak);
+    print_message(message);
+    return 0;
+  }
+
+  long *begins = NULL;
+  long *ends = NULL;
+  int found = get_segment_times(data, filename, &begins, &ends);
+  if (found == -1)
+  {
+    return -1;
+  }
+  if (!found)
+  {
+    snprintf(message, 1024,
+        _("cannot estimate the levels of the files of '%s'"), filename);
+    print_warning(message);
+    return 0;
+  }
+
+  int segment = 0;
+  for (segment = 0; segment < data->number_of_split_files; segment++)
+  {
+    const char *file = data->split_files[segment];
+    double segment_peak = 0;
+    if (!estimate_level(sl, begins[segment], ends[segment],
+          &level, &segment_peak))
+    {
+      snprintf(message, 1024, _("no level to estimate the level of '%s'"),
+          file);
+      print_warning(message);
+      continue;
+    }
+
+    snprintf(message, 1024,
+        _(" Estimated level of \"%s\": %.2f dB, estimated peak level %.2f dB"),
+        file, level, segment_peak);
+    print_message(message);
+
+    //the entries of this input file are the last ones of the manifest
+    int i = 0;
+    for (i = data->number_of_manifest_entries - 1;
+        i >= data->first_manifest_entry; i--)
+    {
+      manifest_entry *entry = &data->manifest[i];
+      if (strcmp(entry->path, file) == 0)
+      {
+        entry->has_level_estimate = SPLT_TRUE;
+        entry->estimated_level_db = level;
+        entry->estimated_peak_db = segment_peak;
+        break;
+      }
+    }
+  }
+
+  free(begins);
+  free(ends);
+
+  return 0;
+}
+
+//writes a 32 bits little endian integer
+void write_le32(FILE *out, long value)
+{
+  fputc(value & 0xFF, out);
+  fputc((value >> 8) & 0xFF, out);
+  fputc((value >> 16) & 0xFF, out);
+  fputc((value >> 24) & 0xFF, out);
+}
+
+//writes the waveform peaks of the input file next to it (or in the
+//output directory with -d), in the binary (.dat) or JSON format of
+//audiowaveform, with 8 bits values; returns -1 on error
+int write_waveform(main_data *data, const char *filename)
+{
+  options *opt = data->opt;
+  silence_level *sl = data->sl;
+
+  const char *base = strrchr(filename, SPLT_DIRCHAR);
+  base = base ? base + 1 : filename;
+  int base_length = strlen(base);
+  const char *extension = strrchr(base, '.');
+  if (extension && (extension != base))
+  {
+    base_length = extension - base;
+  }
+
+  int malloc_size = strlen(filename) + 16;
+  if (opt->d_option)
+  {
+    malloc_size += strlen(opt->dir_arg);
+  }
+  char *waveform_file = my_malloc(sizeof(char) * malloc_size, data);
+  if (!waveform_file)
+  {
+    return -1;
+  }
+  if (opt->d_option)
+  {
+    snprintf(waveform_file, malloc_size, "%s%c%.*s.%s", opt->dir_arg,
+        SPLT_DIRCHAR, base_length, base, opt->waveform_arg);
+  }
+  else
+  {
+    snprintf(waveform_file, malloc_size, "%.*s%.*s.%s", (int) (base - filename),
+        filename, base_length, base, opt->waveform_arg);
+  }
+
+  char *temporary = NULL;
+  FILE *out = open_atomic_file(waveform_file, "wb", &temporary);
+  if (!out)
+  {
+    char message[1024] = { '\0' };
+    snprintf(message, 1024, _("cannot write the waveform '%s' (%s)"),
+        waveform_file, strerror(errno));
+    free(waveform_file);
+    print_warning(message);
+    return 0;
+  }
+
+  int json = (strcmp(opt->waveform_arg, "json") == 0);
+  if (json)
+  {
+    fprintf(out, "{\"version\":1,\"sample_rate\":%ld,\"samples_per_pixel\":%ld,"
+        "\"bits\":8,\"length\":%ld,\"data\":[", sl->sample_rate,
+        sl->samples_per_pixel, sl->number_of_peaks);
+  }
+  else
+  {
+    write_le32(out, 1);
+    //8 bits values
+    write_le32(out, 1);
+    write_le32(out, sl->sample_rate);
+    write_le32(out, sl->samples_per_pixel);
+    write_le32(out, sl->number_of_peaks);
+  }
+
+  long pixel = 0;
+  for (pixel = 0; pixel < sl->number_of_peaks; pixel++)
+  {
+    //we only have the amplitude: the waveform is symmetric
+    int peak = (int) (sl->peaks[pixel] * 127 + 0.5);
+    if (peak > 127)
+    {
+      peak = 127;
+    }
+    if (json)
+    {
+      fprintf(out, "%s%d,%d", (pixel > 0) ? "," : "", -peak, peak);
+    }
+    else
+    {
+      fputc((unsigned char) (signed char) -peak, out);
+      fputc((unsigned char) peak, out);
+    }
+  }
+
+  if (json)
+  {
+    fprintf(out, "]}\n");
+  }
+
+  if (close_atomic_file(out, temporary, waveform_file) == -1)
+  {
+    char message[1024] = { '\0' };
+    snprintf(message, 1024, _("cannot write the waveform '%s' (%s)"),
+        waveform_file, strerror(errno));
+    print_warning(message);
+  }
+  else
+  {
+    char message[1024] = { '\0' };
+    snprintf(message, 1024, _(" Waveform written to '%s'"), waveform_file);
+    print_message(message);
+  }
+
+  free(waveform_file);
+  waveform_file = NULL;
+
+  return 0;
+}
+
+//appends 'size' bytes to the byte buffer
+void append_bytes(byte_buffer *buffer, const void *bytes, size_t size)
+{
+  if (buffer->failed)
+  {
+    return;
+  }
+
+  if (buffer->length + size > buffer->capacity)
+  {
+    size_t capacity = (buffer->capacity > 0) ? buffer->capacity : 1024;
+    while (buffer->length + size > capacity)
+    {
+      capacity *= 2;
+    }
+    unsigned char *new_bytes = realloc(buffer->bytes, capacity);
+    if (!new_bytes)
+    {
+      buffer->failed = SPLT_TRUE;
+      return;
+    }
+    buffer->bytes = new_bytes;
+    buffer->capacity = capacity;
+  }
+
+  memcpy(buffer->bytes + buffer->length, bytes, size);
+  buffer->length += size;
+}
+
+//returns SPLT_TRUE if 'text' only has ASCII characters
+int is_ascii(const char *text)
+{
+  for (; *text != '\0'; text++)
+  {
+    if ((unsigned char) *text >= 0x80)
+    {
+      return SPLT_FALSE;
+    }
+  }
+
+  return SPLT_TRUE;
+}
+
+//decodes the next UTF-8 character of 'text'; invalid bytes are returned
+//as they are
+unsigned long next_utf8_char(const char **text)
+{
+  const unsigned char *bytes = (const unsigned char *) *text;
+  unsigned long c = bytes[0];
+  int length = 1;
+
+  if ((c >= 0xC0) && (c < 0xE0) && ((bytes[1] & 0xC0) == 0x80))
+  {
+    c = ((c & 0x1F) << 6) | (bytes[1] & 0x3F);
+    length = 2;
+  }
+  else if ((c >= 0xE0) && (c < 0xF0) && ((bytes[1] & 0xC0) == 0x80) &&
+      ((bytes[2] & 0xC0) == 0x80))
+  {
+    c = ((c & 0x0F) << 12) | ((bytes[1] & 0x3F) << 6) | (bytes[2] & 0x3F);
+    length = 3;
+  }
+  else if ((c >= 0xF0) && (c < 0xF8) && ((bytes[1] & 0xC0) == 0x80) &&
+      ((bytes[2] & 0xC0) == 0x80) && ((bytes[3] & 0xC0) == 0x80))
+  {
+    c = ((c & 0x07) << 18) | ((bytes[1] & 0x3F) << 12) |
+      ((bytes[2] & 0x3F) << 6) | (bytes[3] & 0x3F);
+    length = 4;
+  }
+
+  *text += length;
+  return c;
+}
+
+//appends 'text' in UTF-16 little endian with its byte order mark
+void append_utf16_text(byte_buffer *buffer, const char *text)
+{
+  unsigned char bom[2] = { 0xFF, 0xFE };
+  append_bytes(buffer, bom, 2);
+
+  while (*text != '\0')
+  {
+    unsigned long c = next_utf8_char(&text);
+    unsigned char unit[4];
+    if (c >= 0x10000)
+    {
+      c -= 0x10000;
+      unsigned long high = 0xD800 | (c >> 10);
+      unsigned long low = 0xDC00 | (c & 0x3FF);
+      unit[0] = high & 0xFF; unit[1] = high >> 8;
+      unit[2] = low & 0xFF; unit[3] = low >> 8;
+      append_bytes(buffer, unit, 4);
+    }
+    else
+    {
+      unit[0] = c & 0xFF; unit[1] = (c >> 8) & 0xFF;
+      append_bytes(buffer, unit, 2);
+    }
+  }
+}
+
+//writes a 32 bits big endian size, syncsafe for ID3v2.4 frames and headers
+void put_id3v2_size(unsigned char *bytes, unsigned long size, int syncsafe)
+{
+  if (syncsafe)
+  {
+    bytes[0] = (size >> 21) & 0x7F;
+    bytes[1] = (size >> 14) & 0x7F;
+    bytes[2] = (size >> 7) & 0x7F;
+    bytes[3] = size & 0x7F;
+  }
+  else
+  {
+    bytes[0] = (size >> 24) & 0xFF;
+    bytes[1] = (size >> 16) & 0xFF;
+    bytes[2] = (size >> 8) & 0xFF;
+    bytes[3] = size & 0xFF;
+  }
+}
+
+//reads a 32 bits big endian size
+unsigned long get_id3v2_size(const unsigned char *bytes, int syncsafe)
+{
+  if (syncsafe)
+  {
+    return ((unsigned long) (bytes[0] & 0x7F) << 21) |
+      ((bytes[1] & 0x7F) << 14) | ((bytes[2] & 0x7F) << 7) | (bytes[3] & 0x7F);
+  }
+
+  return ((unsigned long) bytes[0] << 24) | ((unsigned long) bytes[1] << 16) |
+    ((unsigned long) bytes[2] << 8) | bytes[3];
+}
+
+//appends an ID3v2 text (or comment, if 'id' is COMM) frame: UTF-8 in
+//ID3v2.4, ISO-8859-1 or UTF-16 in ID3v2.3
+void append_id3v2_frame(byte_buffer *frames, const char *id,
+    const char *text, int version)
+{
+  byte_buffer content = { NULL, 0, 0, SPLT_FALSE };
+  int utf16 = ((version == 3) && !is_ascii(text));
+  unsigned char encoding = (version == 4) ? 0x03 : (utf16 ? 0x01 : 0x00);
+  append_bytes(&content, &encoding, 1);
+
+  //comment: language and empty description
+  if (strcmp(id, "COMM") == 0)
+  {
+    append_bytes(&content, "eng", 3);
+    if (utf16)
+    {
+      unsigned char empty[4] = { 0xFF, 0xFE, 0x00, 0x00 };
+      append_bytes(&content, empty, 4);
+    }
+    else
+    {
+      append_bytes(&content, "", 1);
+    }
+  }
+
+  if (utf16)
+  {
+    append_utf16_text(&content, text);
+  }
+  else
+  {
+    append_bytes(&content, text, strlen(text));
+  }
+
+  unsigned char header[10] = { 0 };
+  memcpy(header, id, 4);
+  put_id3v2_size(header + 4, content.length, version == 4);
+  frames->failed = frames->failed || content.failed;
+  append_bytes(frames, header, 10);
+  append_bytes(frames, content.bytes, content.length);
+  free(content.bytes);
+}
+
+//the artist written in the tags: the performer if any, like the library
+const char *get_artist_or_performer(const splt_tags *tags)
+{
+  if (tags->performer && (tags->performer[0] != '\0'))
+  {
+    return tags->performer;
+  }
+
+  return tags->artist;
+}
+
+//returns SPLT_TRUE if the frame 'id' is replaced by the new tags
+int id3v2_frame_is_replaced(const char *id, const splt_tags *tags)
+{
+  return ((tags->title && (strncmp(id, "TIT2", 4) == 0)) ||
+      (get_artist_or_performer(tags) && (strncmp(id, "TPE1", 4) == 0)) ||
+      ((tags->genre != MP3SPLT_UNDEFINED_GENRE) &&
+       (strncmp(id, "TCON", 4) == 0)) ||
+      (tags->album && (strncmp(id, "TALB", 4) == 0)) ||
+      (tags->year && ((strncmp(id, "TYER", 4) == 0) ||
+                      (strncmp(id, "TDRC", 4) == 0))) ||
+      (tags->comment && (strncmp(id, "COMM", 4) == 0)) ||
+      ((tags->track > 0) && (strncmp(id, "TRCK", 4) == 0)));
+}
+
+//appends the frames of the new tags
+void append_new_id3v2_frames(byte_buffer *frames, const splt_tags *tags,
+    int version)
+{
+  if (tags->title)
+  {
+    append_id3v2_frame(frames, "TIT2", tags->title, version);
+  }
+  const char *artist = get_artist_or_performer(tags);
+  if (artist)
+  {
+    append_id3v2_frame(frames, "TPE1", artist, version);
+  }
+  if (tags->album)
+  {
+    append_id3v2_frame(frames, "TALB", tags->album, version);
+  }
+  if (tags->year)
+  {
+    append_id3v2_frame(frames, (version == 4) ? "TDRC" : "TYER",
+        tags->year, version);
+  }
+  if (tags->comment)
+  {
+    append_id3v2_frame(frames, "COMM", tags->comment, version);
+  }
+  if (tags->track > 0)
+  {
+    char track[16] = { '\0' };
+    snprintf(track, sizeof(track), "%d", tags->track);
+    append_id3v2_frame(frames, "TRCK", track, version);
+  }
+  //the ID3v1 genre number, "(N)" in ID3v2.3
+  if (tags->genre != MP3SPLT_UNDEFINED_GENRE)
+  {
+    char genre[16] = { '\0' };
+    snprintf(genre, sizeof(genre), (version == 4) ? "%d" : "(%d)",
+        (int) tags->genre);
+    append_id3v2_frame(frames, "TCON", genre, version);
+  }
+}
+
+//copies a UTF-8 text in an ISO-8859-1 ID3v1 field
+void put_id3v1_field(unsigned char *field, int size, const char *text)
+{
+  memset(field, 0, size);
+  int i = 0;
+  while ((*text != '\0') && (i < size))
+  {
+    unsigned long c = next_utf8_char(&text);
+    field[i++] = (c <= 0xFF) ? (unsigned char) c : '?';
+  }
+}
+
+//updates the ID3v1 tag at the end of the file, if any
+int update_id3v1_tag(FILE *file, const splt_tags *tags, int pretend)
+{
+  unsigned char tag[128];
+  if ((fseek(file, -128, SEEK_END) != 0) ||
+      (fread(tag, 1, 128, file) != 128) || (memcmp(tag, "TAG", 3) != 0))
+  {
+    return SPLT_FALSE;
+  }
+  if (pretend)
+  {
+    return SPLT_TRUE;
+  }
+
+  if (tags->title) { put_id3v1_field(tag + 3, 30, tags->title); }
+  const char *artist = get_artist_or_performer(tags);
+  if (artist) { put_id3v1_field(tag + 33, 30, artist); }
+  if (tags->album) { put_id3v1_field(tag + 63, 30, tags->album); }
+  if (tags->year) { put_id3v1_field(tag + 93, 4, tags->year); }
+  if (tags->comment) { put_id3v1_field(tag + 97, 28, tags->comment); }
+  if ((tags->track > 0) && (tags->track < 256))
+  {
+    tag[125] = 0;
+    tag[126] = (unsigned char) tags->track;
+  }
+  if (tags->genre != MP3SPLT_UNDEFINED_GENRE)
+  {
+    tag[127] = tags->genre;
+  }
+
+  if ((fseek(file, -128, SEEK_END) != 0) ||
+      (fwrite(tag, 1, 128, file) != 128))
+  {
+    return -1;
+  }
+
+  return SPLT_TRUE;
+}
+
+//sets the tags of an mp3 file: the ID3v2 tag is rewritten in place if the
+//new frames fit in its size (padding included), otherwise the file is
+//copied after a new tag, with the mode and owner of the file (or copied
+//back in place if it has hard links); the ID3v1 tag is updated in place;
+//returns SPLT_FALSE if the file cannot be retagged, -1 on error
+int retag_mp3_file(main_data *data, const char *filename, const splt_tags *tags)
+{
+  int pretend = data->opt->P_option;
+  char message[1024] = { '\0' };
+  FILE *file = fopen(filename, pretend ? "rb" : "r+b");
+  if (!file)
+  {
+    snprintf(message, 1024, _("cannot open '%s' (%s)"), filename, strerror(errno));
+    print_warning(message);
+    return SPLT_FALSE;
+  }
+
+  //the current ID3v2 tag, if any
+  unsigned char header[10] = { 0 };
+  int version = 4;
+  unsigned long tag_size = 0;
+  byte_buffer frames = { NULL, 0, 0, SPLT_FALSE };
+  if ((fread(header, 1, 10, file) == 10) && (memcmp(header, "ID3", 3) == 0))
+  {
+    version = header[3];
+    tag_size = get_id3v2_size(header + 6, SPLT_TRUE);
+
+    //unsynchronisation, extended header and footer are not supported
+    if (((version != 3) && (version != 4)) || (header[5] & 0xD0))
+    {
+      snprintf(message, 1024, _("unsupported ID3v2 tag in '%s'"), filename);
+      print_warning(message);
+      fclose(file);
+      return SPLT_FALSE;
+    }
+
+    unsigned char *tag = my_malloc(tag_size + 1, data);
+    if (!tag)
+    {
+      fclose(file);
+      return -1;
+    }
+    if (fread(tag, 1, tag_size, file) != tag_size)
+    {
+      snprintf(message, 1024, _("truncated ID3v2 tag in '%s'"), filename);
+      print_warning(message);
+      free(tag);
+      fclose(file);
+      return SPLT_FALSE;
+    }
+
+    //we keep the frames not replaced
+    unsigned long position = 0;
+    while ((position + 10 <= tag_size) && (tag[position] != '\0'))
+    {
+      unsigned long frame_size = get_id3v2_size(tag + position + 4, version == 4);
+      if (position + 10 + frame_size > tag_size)
+      {
+        break;
+      }
+      if (!id3v2_frame_is_replaced((char *) tag + position, tags))
+      {
+        append_bytes(&frames, tag + position, 10 + frame_size);
+      }
+      position += 10 + frame_size;
+    }
+    free(tag);
+  }
+  else
+  {
+    header[0] = '\0';
+  }
+  append_new_id3v2_frames(&frames, tags, version);
+  if (frames.failed)
+  {
+    free(frames.bytes);
+    fclose(file);
+    return print_run_error(_("cannot allocate memory !"), data);
+  }
+
+  int in_place = ((header[0] != '\0') && (frames.length <= tag_size));
+  int result = SPLT_TRUE;
+
+  if (!pretend && in_place)
+  {
+    //same tag size: the rest of the tag is padding
+    unsigned char *padding = calloc(1, tag_size - frames.length + 1);
+    if (!padding ||
+        (fseek(file, 0, SEEK_SET) != 0) ||
+        (fwrite(header, 1, 10, file) != 10) ||
+        (fwrite(frames.bytes, 1, frames.length, file) != frames.length) ||
+        (fwrite(padding, 1, tag_size - frames.length, file) !=
+         tag_size - frames.length))
+    {
+      result = SPLT_FALSE;
+    }
+    free(padding);
+  }
+  else if (!pretend)
+  {
+    //a new tag with padding for the next updates, followed by the audio
+    unsigned long audio_offset = (header[0] != '\0') ? 10 + tag_size : 0;
+    unsigned long new_size = frames.length + MP3SPLT_ID3V2_PADDING;
+    unsigned char new_header[10] = { 'I', 'D', '3', 0, 0, 0 };
+    new_header[3] = version;
+    put_id3v2_size(new_header + 6, new_size, SPLT_TRUE);
+
+    //with hard links, the new content is written back in the file, so
+    //that all its names have the new tags: it is first written to a
+    //temporary file next to it, kept if the file cannot be written again
+    struct stat file_stat;
+    int have_stat = (fstat(fileno(file), &file_stat) == 0);
+    int hard_links = SPLT_FALSE;
+#ifndef __WIN32__
+    hard_links = (have_stat && (file_stat.st_nlink > 1));
+#endif
+
+    char *temporary = NULL;
+    FILE *out = open_atomic_file(filename, hard_links ? "w+b" : "wb",
+        &temporary);
+    if (!out)
+    {
+      result = SPLT_FALSE;
+    }
+    else
+    {
+      unsigned char *buffer = malloc(65536);
+      if (buffer)
+      {
+        memset(buffer, 0, MP3SPLT_ID3V2_PADDING);
+      }
+      int ok = (buffer && (fwrite(new_header, 1, 10, out) == 10) &&
+          (fwrite(frames.bytes, 1, frames.length, out) == frames.length) &&
+          (fwrite(buffer, 1, MP3SPLT_ID3V2_PADDING, out) ==
+           MP3SPLT_ID3V2_PADDING) &&
+          (fseek(file, audio_offset, SEEK_SET) == 0));
+      size_t read_bytes = 0;
+      while (ok && ((read_bytes = fread(buffer, 1, 65536, file)) > 0))
+      {
+        ok = (fwrite(buffer, 1, read_bytes, out) == read_bytes);
+      }
+      ok = ok && !ferror(file);
+
+      int written_back = SPLT_FALSE;
+#ifndef __WIN32__
+      if (ok && hard_links)
+      {
+        //the new content is complete and on the disk before the file is
+        //written again
+        long new_length = (long) (10 + new_size +
+            file_stat.st_size - audio_offset);
+        ok = ((fflush(out) == 0) && (fsync(fileno(out)) == 0) &&
+            (ftell(out) == new_length) && (fseek(out, 0, SEEK_SET) == 0) &&
+            (fseek(file, 0, SEEK_SET) == 0));
+        written_back = ok;
+        while (ok && ((read_bytes = fread(buffer, 1, 65536, out)) > 0))
+        {
+          ok = (fwrite(buffer, 1, read_bytes, file) == read_bytes);
+        }
+        ok = ok && !ferror(out) && (fflush(file) == 0) &&
+          (ftruncate(fileno(file), ftell(file)) == 0);
+      }
+      else if (ok && have_stat)
+      {
+        //the owner cannot be changed without privileges: the group is
+        //kept if we can
+        int owner_kept =
+          (fchown(fileno(out), file_stat.st_uid, file_stat.st_gid) == 0);
+        if (!owner_kept &&
+            (fchown(fileno(out), -1, file_stat.st_gid) != 0))
+        {
+          snprintf(message, 1024, _("cannot keep the owner of '%s'"),
+              filename);
+          print_warning(message);
+        }
+        if (fchmod(fileno(out), file_stat.st_mode & 07777) != 0)
+        {
+          snprintf(message, 1024, _("cannot keep the mode of '%s'"),
+              filename);
+          print_warning(message);
+        }
+      }
+#endif
+      free(buffer);
+
+      if (hard_links)
+      {
+        if (!ok && written_back)
+        {
+          fclose(out);
+          snprintf(message, 1024, _("'%s' was partly written: its new content"
+                " is in '%s'"), filename, temporary);
+          print_warning(message);
+          free(temporary);
+        }
+        else
+        {
+          discard_atomic_file(out, temporary);
+        }
+        result = ok;
+      }
+      else if (ok)
+      {
+        fclose(file);
+        result = (close_atomic_file(out, temporary, filename) == 0);
+        file = result ? fopen(filename, "r+b") : NULL;
+      }
+      else
+      {
+        fclose(file);
+        file = NULL;
+        discard_atomic_file(out, temporary);
+        result = SPLT_FALSE;
+      }
+    }
+  }
+  free(frames.bytes);
+  frames.bytes = NULL;
+
+  int id3v1 = SPLT_FALSE;
+  if (file && result)
+  {
+    id3v1 = update_id3v1_tag(file, tags, pretend);
+    if (id3v1 == -1)
+    {
+      result = SPLT_FALSE;
+    }
+  }
+  if (file && (fclose(file) != 0))
+  {
+    result = SPLT_FALSE;
+  }
+
+  if (!result)
+  {
+    snprintf(message, 1024, _("cannot write the tags of '%s' (%s)"),
+        filename, strerror(errno));
+    print_warning(message);
+    return SPLT_FALSE;
+  }
+
+  const char *id3v1_message = (id3v1 == SPLT_TRUE) ? _(" (and ID3v1 tag)") : "";
+  if (in_place)
+  {
+    snprintf(message, 1024, pretend ?
+        _("   ID3v2 tag of \"%s\" would be updated in place%s") :
+        _("   ID3v2 tag of \"%s\" updated in place%s"),
+        filename, id3v1_message);
+  }
+  else
+  {
+    snprintf(message, 1024, pretend ?
+        _("   File \"%s\" would be rewritten with a new ID3v2 tag%s") :
+        _("   File \"%s\" rewritten with a new ID3v2 tag%s"),
+        filename, id3v1_message);
+  }
+  print_message(message);
+
+  return SPLT_TRUE;
+}
+
+//sets the tags of -g on the input files, without splitting (--retag);
+//returns -1 on error
+int retag_files(main_data *data)
+{
+  options *opt = data->opt;
+  splt_state *state = data->state;
+  int err = SPLT_OK;
+
+  int ambiguous = mp3splt_put_tags_from_string(state, opt->custom_tags, &err);
+  if (process_confirmation_error(err, data) == -1)
+  {
+    return -1;
+  }
+  if (ambiguous)
+  {
+    print_warning(_("tags format ambiguous !"));
+  }
+
+  int number_of_tags = 0;
+  const splt_tags *tags = mp3splt_get_tags(state, &number_of_tags, &err);
+  if (process_confirmation_error(err, data) == -1)
+  {
+    return -1;
+  }
+
+  //after the last pair of brackets, the default tags of '%' are used
+  int has_default_tags = (strchr(opt->custom_tags, '%') != NULL);
+
+  int errors = 0;
+  int i = 0;
+  for (i = 0; i < data->number_of_filenames; i++)
+  {
+    const char *filename = data->filenames[i];
+    data->current_file_index = i;
+    if (data->cancel_requested)
+    {
+      return exit_cancelled(data, SPLT_FALSE);
+    }
+
+    const splt_tags *file_tags = NULL;
+    if (i < number_of_tags)
+    {
+      file_tags = &tags[i];
+    }
+    else if (has_default_tags && (number_of_tags > 0))
+    {
+      file_tags = &tags[number_of_tags - 1];
+    }
+    if (!file_tags)
+    {
+      continue;
+    }
+
+    const char *extension = strrchr(filename, '.');
+    if (!extension || (strlen(extension) != 4) ||
+        (tolower(extension[1]) != 'm') || (tolower(extension[2]) != 'p') ||
+        (extension[3] != '3'))
+    {
+      char message[1024] = { '\0' };
+      snprintf(message, 1024, _("only mp3 files can be retagged: '%s'"), filename);
+      print_warning(message);
+      errors++;
+      continue;
+    }
+
+    if (opt->P_option)
+    {
+      fprintf(data->console_out, _(" Pretending to retag file '%s' ...\n"), filename);
+    }
+    else
+    {
+      fprintf(data->console_out, _(" Retagging file '%s' ...\n"), filename);
+    }
+    fflush(data->console_out);
+
+    double retag_start = trace_begin(data);
+    int retagged = retag_mp3_file(data, filename, file_tags);
+    if (retagged == -1)
+    {
+      return -1;
+    }
+    if (!retagged)
+    {
+      errors++;
+    }
+    trace_end(data, "write tags", filename, retag_start,
+        get_trace_file_size(filename));
+  }
+
+  if (errors > 0)
+  {
+    char message[1024] = { '\0' };
+    snprintf(message, 1024, _("%d file(s) could not be retagged"), errors);
+    return print_run_error(message, data);
+  }
+
+  return 0;
+}
+
+//estimated level in dB of a mp3 layer III frame, from the global gain of
+//its granules (one step is 1.5 dB) without decoding them; granules
+//without coded values are silent; returns 0 for other layers
+float get_frame_level(const unsigned char *frame, unsigned long length)
+{
+  int version = (frame[1] >> 3) & 0x03;
+  int layer = 4 - ((frame[1] >> 1) & 0x03);
+  if (layer != 3)
+  {
+    return 0;
+  }
+
+  int mpeg1 = (version == 3);
+  int channels = (((frame[3] >> 6) & 0x03) == 3) ? 1 : 2;
+  unsigned long bit = (frame[1] & 0x01) ? 32 : 48;
+  int granules = mpeg1 ? 2 : 1;
+  if (mpeg1)
+  {
+    bit += 9 + ((channels == 1) ? 5 : 3) + 4 * channels;
+  }
+  else
+  {
+    bit += 8 + channels;
+  }
+
+  int max_gain = -1;
+  int granule = 0, channel = 0;
+  for (granule = 0; granule < granules; granule++)
+  {
+    for (channel = 0; channel < channels; channel++)
+    {
+      if ((bit + 29) > length * 8)
+      {
+        return 0;
+      }
+
+      int values[3] = { 0, 0, 0 };
+      int sizes[3] = { 12, 9, 8 };
+      int field = 0, i = 0;
+      for (field = 0; field < 3; field++)
+      {
+        for (i = 0; i < sizes[field]; i++, bit++)
+        {
+          values[field] = (values[field] << 1) |
+            ((frame[bit / 8] >> (7 - (bit % 8))) & 0x01);
+        }
+      }
+      //part2_3_length and big_values
+      if (((values[0] > 0) || (values[1] > 0)) && (values[2] > max_gain))
+      {
+        max_gain = values[2];
+      }
+      bit += mpeg1 ? 30 : 34;
+    }
+  }
+
+  if (max_gain < 0)
+  {
+    return MP3SPLT_FOLLOW_SILENT_LEVEL;
+  }
+
+  return 1.5 * (max_gain - 210);
+}
+
+//sets the output directory and format of the followed file; returns -1
+//on error
+int set_follow_output(main_data *data, const char *filename)
+{
+  options *opt = data->opt;
+  int err = mp3splt_set_path_of_split(data->state,
+      opt->d_option ? opt->dir_arg : NULL);
+  if (process_confirmation_error(err, data) == -1)
+  {
+    return -1;
+  }
+
+  return set_output_format_for_file(data, filename);
+}
+
+//ignores the messages and the progress of the pretend split of --follow
+void put_no_library_message(const char *message, splt_message_type mess_type)
+{
+}
+
+void put_no_progress(splt_progress *p_bar)
+{
+}
+
+//keeps the name of the segment of the pretend split of --follow
+void put_follow_name(const char *file, int progress_data)
+{
+  main_data *data = callbacks_data;
+  if (data && !data->follow_name)
+  {
+    data->follow_name = strdup(file);
+  }
+}
+
+//finds the name of the segment from 'begin' to 'end' (hundredths of
+//seconds) of the followed file with a pretend split in normal mode, which
+//does not read its frames; returns -1 on error
+int find_followed_segment_name(main_data *data, const char *filename,
+    long begin, long end)
+{
+  splt_state *state = data->state;
+  int err = SPLT_OK;
+
+  free(data->follow_name);
+  data->follow_name = NULL;
+
+  mp3splt_set_message_function(state, put_no_library_message);
+  mp3splt_set_split_filename_function(state, put_follow_name);
+  mp3splt_set_progress_function(state, put_no_progress);
+  mp3splt_set_int_option(state, SPLT_OPT_FRAME_MODE, SPLT_FALSE);
+  mp3splt_set_int_option(state, SPLT_OPT_PRETEND_TO_SPLIT, SPLT_TRUE);
+
+  err = mp3splt_set_filename_to_split(state, filename);
+  if (err >= 0)
+  {
+    err = mp3splt_append_splitpoint(state, begin, NULL, SPLT_SPLITPOINT);
+  }
+  if (err >= 0)
+  {
+    err = mp3splt_append_splitpoint(state, end, NULL, SPLT_SPLITPOINT);
+  }
+  if (err >= 0)
+  {
+    err = mp3splt_split(state);
+  }
+
+  mp3splt_set_int_option(state, SPLT_OPT_PRETEND_TO_SPLIT, SPLT_FALSE);
+  mp3splt_set_int_option(state, SPLT_OPT_FRAME_MODE, SPLT_TRUE);
+  mp3splt_set_progress_function(state, put_progress);
+  mp3splt_set_split_filename_function(state, put_split_file);
+  mp3splt_set_message_function(state, put_library_message);
+  mp3splt_erase_all_splitpoints(state, NULL);
+
+  if (process_confirmation_error(err, data) == -1)
+  {
+    return -1;
+  }
+  if (!data->follow_name)
+  {
+    char message[1024] = { '\0' };
+    snprintf(message, 1024, _("cannot find the name of the segment of '%s'"),
+        filename);
+    return print_run_error(message, data);
+  }
+
+  return 0;
+}
+
+//writes the ID3v2 tag and the frames of the window to 'window_file';
+//returns -1 on error, with errno set
+int write_follow_window(follow_window *window, const char *window_file)
+{
+  FILE *out = fopen(window_file, "wb");
+  if (!out)
+  {
+    return -1;
+  }
+
+  unsigned char buffer[MP3SPLT_FOLLOW_BUFFER];
+  int result = 0;
+  int part = 0;
+  for (part = 0; (part < 2) && (result == 0); part++)
+  {
+    unsigned long offset = (part == 0) ? 0 : window->begin;
+    unsigned long end = (part == 0) ? window->tag_end : window->end;
+    if (fseek(window->input, (long) offset, SEEK_SET) != 0)
+    {
+      result = -1;
+      break;
+    }
+    clearerr(window->input);
+    while ((offset < end) || ((part == 1) && (window->end == 0)))
+    {
+      size_t to_read = MP3SPLT_FOLLOW_BUFFER;
+      if ((end > 0) && (end - offset < to_read))
+      {
+        to_read = end - offset;
+      }
+      size_t read_bytes = fread(buffer, 1, to_read, window->input);
+      if (read_bytes == 0)
+      {
+        //the end of a window is always in the file
+        if (ferror(window->input) || (window->end > 0))
+        {
+          errno = EIO;
+          result = -1;
+        }
+        break;
+      }
+      if (fwrite(buffer, 1, read_bytes, out) != read_bytes)
+      {
+        result = -1;
+        break;
+      }
+      offset += read_bytes;
+    }
+  }
+
+  int saved_errno = errno;
+  if ((fclose(out) != 0) && (result == 0))
+  {
+    saved_errno = errno;
+    result = -1;
+  }
+  if (result == -1)
+  {
+    remove(window_file);
+    errno = saved_errno;
+  }
+
+  return result;
+}
+
+//splits the segment from 'begin' to 'end' (hundredths of seconds) of the
+//followed file; in frame mode, the library reads only the 'window' of
+//the file holding the segment, with the name it would give to the
+//segment of the whole file; returns -1 on error
+int split_followed_segment(main_data *data, const char *filename,
+    long begin, long end, follow_window *window)
+{
+  splt_state *state = data->state;
+  int err = SPLT_OK;
+
+  free_split_files(data);
+  mp3splt_erase_all_splitpoints(state, &err);
+  if (process_confirmation_error(err, data) == -1)
+  {
+    return -1;
+  }
+
+  const char *input = filename;
+  char *window_file = NULL;
+  char *segment_name = NULL;
+  int output_filenames = SPLT_OUTPUT_DEFAULT;
+  int create_dirs = SPLT_FALSE;
+  if (window)
+  {
+    if (find_followed_segment_name(data, filename, begin, end) == -1)
+    {
+      return -1;
+    }
+
+    //the window is written next to the segment, where the library
+    //would have written it
+    char *temporary = get_temporary_filename(data->follow_name);
+    if (temporary)
+    {
+      window_file = my_malloc(sizeof(char) * (strlen(temporary) + 5), data);
+      if (!window_file)
+      {
+        free(temporary);
+        return -1;
+      }
+      sprintf(window_file, "%s.mp3", temporary);
+      free(temporary);
+      temporary = NULL;
+    }
+
+    char *output_dir = data->follow_name;
+    segment_name = strrchr(output_dir, SPLT_DIRCHAR);
+    if (segment_name)
+    {
+      *segment_name = '\0';
+      segment_name++;
+    }
+    else
+    {
+      segment_name = output_dir;
+    }
+    char *extension = strrchr(segment_name, '.');
+    if (extension && (extension != segment_name))
+    {
+      *extension = '\0';
+    }
+    const char *path_of_split = (segment_name == output_dir) ? "." : output_dir;
+    if (path_of_split[0] == '\0')
+    {
+      path_of_split = SPLT_DIRSTR;
+    }
+    if (create_directories_cached(data, path_of_split) == -1)
+    {
+      char message[1024] = { '\0' };
+      snprintf(message, 1024, _("cannot create directory '%s' (%s)"),
+          path_of_split, strerror(errno));
+      free(window_file);
+      return print_run_error(message, data);
+    }
+
+    if (!window_file || (write_follow_window(window, window_file) == -1))
+    {
+      char message[1024] = { '\0' };
+      snprintf(message, 1024, _("cannot write the segment of '%s' to split"
+            " in '%s' (%s)"), filename, path_of_split, strerror(errno));
+      free(window_file);
+      return print_run_error(message, data);
+    }
+
+    output_filenames =
+      mp3splt_get_int_option(state, SPLT_OPT_OUTPUT_FILENAMES, &err);
+    create_dirs =
+      mp3splt_get_int_option(state, SPLT_OPT_CREATE_DIRS_FROM_FILENAMES, &err);
+    err = mp3splt_set_path_of_split(state, path_of_split);
+    mp3splt_set_int_option(state, SPLT_OPT_OUTPUT_FILENAMES, SPLT_OUTPUT_CUSTOM);
+    mp3splt_set_int_option(state, SPLT_OPT_CREATE_DIRS_FROM_FILENAMES,
+        SPLT_FALSE);
+    input = window_file;
+    long window_time = (long) (window->time * 100);
+    begin -= window_time;
+    if (end != LONG_MAX)
+    {
+      end -= window_time;
+    }
+  }
+
+  if (err >= 0)
+  {
+    err = mp3splt_set_filename_to_split(state, input);
+  }
+  if (err >= 0)
+  {
+    mp3splt_append_splitpoint(state, begin, segment_name, SPLT_SPLITPOINT);
+    mp3splt_append_splitpoint(state, end, NULL, SPLT_SPLITPOINT);
+
+    trace_split_start(data, filename);
+    err = mp3splt_split(state);
+    trace_end_silence_scan(data);
+  }
+
+  if (window_file)
+  {
+    remove(window_file);
+    free(window_file);
+    window_file = NULL;
+    mp3splt_set_int_option(state, SPLT_OPT_OUTPUT_FILENAMES, output_filenames);
+    mp3splt_set_int_option(state, SPLT_OPT_CREATE_DIRS_FROM_FILENAMES,
+        create_dirs);
+    if (set_follow_output(data, filename) == -1)
+    {
+      return -1;
+    }
+  }
+
+  if (check_callback_error(data) == -1)
+  {
+    return -1;
+  }
+  if (data->split_cancelled)
+  {
+    return exit_cancelled(data, SPLT_FALSE);
+  }
+  if (process_confirmation_error(err, data) == -1)
+  {
+    return -1;
+  }
+
+  if (data->opt->m_option && !data->opt->P_option)
+  {
+    if (append_m3u_entries(data) == -1)
+    {
+      return -1;
+    }
+    flush_m3u_files(data);
+  }
+
+  return 0;
+}
+
+#if !defined(__WIN32__) && !defined(MP3SPLT_EMBEDDED)
+//keeps the name of the window file written by the library (-a)
+void put_adjust_window(const char *file, int progress_data)
+{
+  main_data *data = callbacks_data;
+  if (data && !data->adjust_window)
+  {
+    data->adjust_window = strdup(file);
+  }
+}
+
+//ends the current silence of the window and keeps its splitpoint if it
+//is nearer to the original splitpoint than the previous ones
+void finish_adjust_silence(adjust_scan *scan)
+{
+  if (scan->silence_begin < 0)
+  {
+    return;
+  }
+
+  if (scan->silence_end - scan->silence_begin >= scan->min_length)
+  {
+    long point = scan->silence_begin +
+      (long) (scan->offset * (scan->silence_end - scan->silence_begin));
+    if ((scan->adjusted < 0) ||
+        (labs(point - scan->point) < labs(scan->adjusted - scan->point)))
+    {
+      scan->adjusted = point;
+    }
+  }
+  scan->silence_begin = -1;
+}
+
+//silence level callback of the window scans (-a)
+void get_adjust_level(long time, float level, void *user_data)
+{
+  adjust_scan *scan = user_data;
+  if ((level == INT_MIN) || (level == INT_MAX))
+  {
+    return;
+  }
+
+  if (level < scan->threshold)
+  {
+    if (scan->silence_begin < 0)
+    {
+      scan->silence_begin = time;
+    }
+    scan->silence_end = time;
+  }
+  else
+  {
+    finish_adjust_silence(scan);
+  }
+}
+
+//writes the error of the window of the splitpoint 'index' to the results
+//of adjust_windows, on one line
+void put_adjust_error(FILE *results, splt_state *state, int err, int index)
+{
+  char *error = (state && (err < 0)) ? mp3splt_get_strerror(state, err) : NULL;
+  char message[1024] = { '\0' };
+  snprintf(message, 1024, _("splitpoint %d: %s"), index + 1,
+      error ? error : _("the window could not be copied"));
+  free(error);
+
+  char *end = message;
+  while ((end = strchr(end, '\n')) != NULL)
+  {
+    *end = ' ';
+  }
+  fprintf(results, "error %s\n", message);
+  fflush(results);
+}
+
+//adjusts the splitpoints 'first', 'first' + 'step', ... of 'windows' in
+//a process of adjust_splitpoints, with its own library state: each
+//window is copied by the library to a file of 'directory' without
+//decoding, and only this file is scanned; writes 'index splitpoint'
+//lines to 'fd' for the silences found, and an 'error message' line
+//before returning -1 on error
+int adjust_windows(main_data *data, const char *filename,
+    const char *directory, const long *points, const int *windows,
+    int number_of_windows, int first, int step, int fd)
+{
+  splt_state *parent_state = data->state;
+  int err = SPLT_OK;
+  FILE *results = fdopen(fd, "w");
+  if (!results)
+  {
+    return -1;
+  }
+
+  adjust_scan scan;
+  scan.threshold =
+    mp3splt_get_float_option(parent_state, SPLT_OPT_PARAM_THRESHOLD, &err);
+  scan.offset =
+    mp3splt_get_float_option(parent_state, SPLT_OPT_PARAM_OFFSET, &err);
+  float min_length =
+    mp3splt_get_float_option(parent_state, SPLT_OPT_PARAM_MIN_LENGTH, &err);
+  scan.min_length = (long) (100 * min_length);
+  long gap = mp3splt_get_int_option(parent_state, SPLT_OPT_PARAM_GAP, &err) * 100L;
+  int frame_mode =
+    mp3splt_get_int_option(parent_state, SPLT_OPT_FRAME_MODE, &err);
+
+  //the state of the parent may be in use by the library: it is not used
+  //after the fork
+  err = SPLT_OK;
+  splt_state *state = mp3splt_new_state(&err);
+  if (state && (err >= 0))
+  {
+    err = mp3splt_find_plugins(state);
+  }
+  if (!state || (err < 0))
+  {
+    put_adjust_error(results, state, err, windows[first]);
+    if (state)
+    {
+      mp3splt_free_state(state, NULL);
+    }
+    fclose(results);
+    return -1;
+  }
+
+  mp3splt_set_split_filename_function(state, put_adjust_window);
+  mp3splt_set_silence_level_function(state, get_adjust_level, &scan);
+  mp3splt_set_int_option(state, SPLT_OPT_FRAME_MODE, frame_mode);
+  mp3splt_set_int_option(state, SPLT_OPT_AUTO_ADJUST, SPLT_FALSE);
+  mp3splt_set_int_option(state, SPLT_OPT_PRETEND_TO_SPLIT, SPLT_FALSE);
+  mp3splt_set_int_option(state, SPLT_OPT_ENABLE_SILENCE_LOG, SPLT_FALSE);
+  mp3splt_set_int_option(state, SPLT_OPT_OUTPUT_FILENAMES, SPLT_OUTPUT_CUSTOM);
+  mp3splt_set_int_option(state, SPLT_OPT_TAGS, SPLT_NO_TAGS);
+  mp3splt_set_float_option(state, SPLT_OPT_PARAM_THRESHOLD, scan.threshold);
+  mp3splt_set_float_option(state, SPLT_OPT_PARAM_MIN_LENGTH, min_length);
+  mp3splt_set_path_of_split(state, directory);
+
+  int result = 0;
+  int i = 0;
+  for (i = first; (i < number_of_windows) && (result != -1) &&
+      !data->cancel_requested; i += step)
+  {
+    long point = points[windows[i]];
+    long begin = (point > gap) ? point - gap : 0;
+    long end = (point < LONG_MAX - gap) ? point + gap : LONG_MAX;
+    char name[256] = { '\0' };
+    snprintf(name, 256, "window-%d", windows[i]);
+
+    //copy the window
+    err = SPLT_OK;
+    mp3splt_set_int_option(state, SPLT_OPT_SPLIT_MODE, SPLT_OPTION_NORMAL_MODE);
+    mp3splt_erase_all_splitpoints(state, &err);
+    if (err >= 0)
+    {
+      err = mp3splt_set_filename_to_split(state, filename);
+    }
+    if (err >= 0)
+    {
+      err = mp3splt_append_splitpoint(state, begin, name, SPLT_SPLITPOINT);
+    }
+    if (err >= 0)
+    {
+      err = mp3splt_append_splitpoint(state, end, NULL, SPLT_SPLITPOINT);
+    }
+    free(data->adjust_window);
+    data->adjust_window = NULL;
+  data->follow_name = NULL;
+    if (err >= 0)
+    {
+      err = mp3splt_split(state);
+    }
+    if ((err < 0) || !data->adjust_window)
+    {
+      put_adjust_error(results, state, err, windows[i]);
+      result = -1;
+      break;
+    }
+
+    //scan the window
+    scan.point = point - begin;
+    scan.silence_begin = -1;
+    scan.silence_end = -1;
+    scan.adjusted = -1;
+    err = SPLT_OK;
+    mp3splt_set_int_option(state, SPLT_OPT_SPLIT_MODE, SPLT_OPTION_SILENCE_MODE);
+    mp3splt_erase_all_splitpoints(state, &err);
+    if (err >= 0)
+    {
+      err = mp3splt_set_filename_to_split(state, data->adjust_window);
+    }
+    if (err >= 0)
+    {
+      mp3splt_count_silence_points(state, &err);
+    }
+    finish_adjust_silence(&scan);
+    remove(data->adjust_window);
+
+    if (err < 0)
+    {
+      put_adjust_error(results, state, err, windows[i]);
+      result = -1;
+    }
+    else if (scan.adjusted >= 0)
+    {
+      fprintf(results, "%d %ld\n", windows[i], begin + scan.adjusted);
+      fflush(results);
+    }
+  }
+
+  mp3splt_free_state(state, NULL);
+  if ((fclose(results) != 0) && (result != -1))
+  {
+    result = -1;
+  }
+
+  return result;
+}
+
+//removes the directory of the windows of adjust_splitpoints, with the
+//windows left by a failed process
+void remove_adjust_directory(const char *directory)
+{
+  DIR *dir = opendir(directory);
+  struct dirent *entry = NULL;
+  while (dir && ((entry = readdir(dir)) != NULL))
+  {
+    if ((strcmp(entry->d_name, ".") == 0) || (strcmp(entry->d_name, "..") == 0))
+    {
+      continue;
+    }
+    char path[4096] = { '\0' };
+    snprintf(path, 4096, "%s%c%s", directory, SPLT_DIRCHAR, entry->d_name);
+    remove(path);
+  }
+  if (dir)
+  {
+    closedir(dir);
+  }
+  rmdir(directory);
+}
+
+//-a: adjusts the splitpoints of the current file with the silences found
+//in windows of -p gap seconds around them, scanned at once by
+//--adjust-jobs processes, instead of letting the library decode the
+//whole file; returns SPLT_FALSE if the library has to adjust them, -1
+//on error
+int adjust_splitpoints(main_data *data, const char *filename)
+{
+  options *opt = data->opt;
+  splt_state *state = data->state;
+  int err = SPLT_OK;
+
+  if ((opt->adjust_jobs == 0) || (strcmp(filename, "-") == 0) ||
+      (strcmp(filename, "m-") == 0) || (strcmp(filename, "o-") == 0) ||
+      mp3splt_get_int_option(state, SPLT_OPT_INPUT_NOT_SEEKABLE, &err) ||
+      (mp3splt_get_int_option(state, SPLT_OPT_SPLIT_MODE, &err) !=
+       SPLT_OPTION_NORMAL_MODE))
+  {
+    return SPLT_FALSE;
+  }
+
+  int gap = mp3splt_get_int_option(state, SPLT_OPT_PARAM_GAP, &err);
+  if (gap <= 0)
+  {
+    return SPLT_FALSE;
+  }
+
+  double adjust_start = trace_begin(data);
+
+  int number_of_points = 0;
+  const splt_point *points =
+    mp3splt_get_splitpoints(state, &number_of_points, &err);
+  if (process_confirmation_error(err, data) == -1)
+  {
+    return -1;
+  }
+  if (number_of_points == 0)
+  {
+    return SPLT_TRUE;
+  }
+
+  int result = SPLT_TRUE;
+  long *values = my_malloc(sizeof(long) * number_of_points, data);
+  long *adjusted = my_malloc(sizeof(long) * number_of_points, data);
+  char **names = calloc(number_of_points, sizeof(char *));
+  int *types = my_malloc(sizeof(int) * number_of_points, data);
+  int *windows = my_malloc(sizeof(int) * number_of_points, data);
+  pid_t *pids = NULL;
+  int *fds = NULL;
+  char directory[4096] = { '\0' };
+  if (!values || !adjusted || !names || !types || !windows)
+  {
+    result = print_run_error(_("cannot allocate memory !"), data);
+    goto end;
+  }
+  int number_of_windows = 0;
+  int i = 0;
+  for (i = 0; i < number_of_points; i++)
+  {
+    values[i] = points[i].value;
+    adjusted[i] = points[i].value;
+    names[i] = points[i].name ? strdup(points[i].name) : NULL;
+    types[i] = points[i].type;
+    //the start and the end of the file are not adjusted
+    if ((values[i] > 0) && (values[i] != LONG_MAX))
+    {
+      windows[number_of_windows++] = i;
+    }
+  }
+
+  int jobs = opt->adjust_jobs;
+  if (jobs < 0)
+  {
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    jobs = (processors > 1) ? (int) processors : 1;
+    if (jobs > MP3SPLT_ADJUST_MAX_JOBS)
+    {
+      jobs = MP3SPLT_ADJUST_MAX_JOBS;
+    }
+  }
+  if (jobs > number_of_windows)
+  {
+    jobs = number_of_windows;
+  }
+
+  pids = my_malloc(sizeof(pid_t) * (jobs + 1), data);
+  fds = my_malloc(sizeof(int) * (jobs + 1), data);
+  if (!pids || !fds)
+  {
+    result = -1;
+    goto end;
+  }
+
+  //the windows are written in a new directory that only we can use
+  const char *temporary_directory = getenv("TMPDIR");
+  if (!temporary_directory || (temporary_directory[0] == '\0'))
+  {
+    temporary_directory = "/tmp";
+  }
+  snprintf(directory, sizeof(directory), "%s%cmp3splt-adjust-XXXXXX",
+      temporary_directory, SPLT_DIRCHAR);
+  if (mkdtemp(directory) == NULL)
+  {
+    char message[1024] = { '\0' };
+    snprintf(message, 1024, _("cannot create a temporary directory for -a"
+          " in '%s': %s"), temporary_directory, strerror(errno));
+    directory[0] = '\0';
+    result = print_run_error(message, data);
+    goto end;
+  }
+  fflush(NULL);
+  //the processes already started are waited for before reporting an error
+  char start_error[1024] = { '\0' };
+  int job = 0;
+  for (job = 0; job < jobs; job++)
+  {
+    int pipe_fds[2];
+    if (pipe(pipe_fds) != 0)
+    {
+      snprintf(start_error, 1024, _("cannot create a pipe for -a: %s"),
+          strerror(errno));
+      break;
+    }
+
+    pids[job] = fork();
+    if (pids[job] < 0)
+    {
+      snprintf(start_error, 1024, _("cannot start the -a processes: %s"),
+          strerror(errno));
+      close(pipe_fds[0]);
+      close(pipe_fds[1]);
+      break;
+    }
+
+    if (pids[job] == 0)
+    {
+      close(pipe_fds[0]);
+      int k = 0;
+      for (k = 0; k < job; k++)
+      {
+        close(fds[k]);
+      }
+      int adjust_result = adjust_windows(data, filename, directory, values,
+          windows, number_of_windows, job, jobs, pipe_fds[1]);
+      _exit((adjust_result == 0) ? 0 : 1);
+    }
+
+    close(pipe_fds[1]);
+    fds[job] = pipe_fds[0];
+  }
+  jobs = job;
+
+  //the results of the processes
+  char adjust_error[1024] = { '\0' };
+  for (job = 0; job < jobs; job++)
+  {
+    FILE *results = fdopen(fds[job], "r");
+    if (results)
+    {
+      char line[1024] = { '\0' };
+      while (fgets(line, 1024, results) != NULL)
+      {
+        if (strncmp(line, "error ", 6) == 0)
+        {
+          if (adjust_error[0] == '\0')
+          {
+            line[strcspn(line, "\n")] = '\0';
+            snprintf(adjust_error, 1024, "%s", line + 6);
+          }
+          continue;
+        }
+
+        int index = -1;
+        long point = -1;
+        if ((sscanf(line, "%d %ld", &index, &point) == 2) &&
+            (index >= 0) && (index < number_of_points) && (point >= 0))
+        {
+          adjusted[index] = point;
+        }
+      }
+      fclose(results);
+    }
+    else
+    {
+      close(fds[job]);
+    }
+
+    int status = 0;
+    pid_t waited = -1;
+    while (((waited = waitpid(pids[job], &status, 0)) == -1) &&
+        (errno == EINTR))
+    {
+    }
+    if (((waited != pids[job]) || !WIFEXITED(status) ||
+          (WEXITSTATUS(status) != 0)) && (adjust_error[0] == '\0'))
+    {
+      snprintf(adjust_error, 1024, _("a process of -a has failed"));
+    }
+  }
+  if (start_error[0] != '\0')
+  {
+    result = print_run_error(start_error, data);
+    goto end;
+  }
+
+  //an adjusted splitpoint cannot pass its neighbours
+  int number_of_adjusted = 0;
+  long previous = -1;
+  for (i = 0; i < number_of_points; i++)
+  {
+    long next = (i + 1 < number_of_points) ? values[i + 1] : LONG_MAX;
+    if ((adjusted[i] <= previous) || (adjusted[i] >= next))
+    {
+      adjusted[i] = values[i];
+    }
+    if (adjusted[i] != values[i])
+    {
+      number_of_adjusted++;
+    }
+    previous = adjusted[i];
+  }
+
+  if (data->cancel_requested)
+  {
+    result = exit_cancelled(data, SPLT_FALSE);
+    goto end;
+  }
+  if (adjust_error[0] != '\0')
+  {
+    char message[2048] = { '\0' };
+    snprintf(message, 2048, _("cannot adjust the splitpoints of '%s' (%s)"),
+        filename, adjust_error);
+    result = print_run_error(message, data);
+    goto end;
+  }
+
+  mp3splt_erase_all_splitpoints(state, &err);
+  result = process_confirmation_error(err, data);
+  for (i = 0; (i < number_of_points) && (result != -1); i++)
+  {
+    err = mp3splt_append_splitpoint(state, adjusted[i], names[i], types[i]);
+    result = process_confirmation_error(err, data);
+  }
+  if (result == -1)
+  {
+    goto end;
+  }
+  result = SPLT_TRUE;
+
+  trace_end(data, "auto-adjust", filename, adjust_start, -1);
+
+  if (!opt->q_option)
+  {
+    fprintf(data->console_out, _(" Auto-adjusted %d of %d splitpoints in windows of"
+          " %d seconds around them (%d processes)\n"),
+        number_of_adjusted, number_of_windows, gap, jobs);
+    fflush(data->console_out);
+  }
+
+end:
+  if (directory[0] != '\0')
+  {
+    remove_adjust_directory(directory);
+  }
+  if (names)
+  {
+    for (i = 0; i < number_of_points; i++)
+    {
+      free(names[i]);
+    }
+  }
+  free(names);
+  free(values);
+  free(adjusted);
+  free(types);
+  free(windows);
+  free(pids);
+  free(fds);
+
+  return result;
+}
+#else
+//-a: the library adjusts the splitpoints; no process is started from the
+//programs linking mp3splt
+int adjust_splitpoints(main_data *data, const char *filename)
+{
+  return SPLT_FALSE;
+}
+#endif
+
+//--follow: reads the input file as it grows, like 'tail -f', finds the
+//silences from the levels of the new frames and splits each segment as
+//soon as the silence after it lasts the minimum length (-p min); only
+//the incomplete frame at the end of the file is kept in memory. Stops
+//when the file did not grow for MP3SPLT_FOLLOW_TIMEOUT seconds or on
+//Ctrl+C, and then splits the last segment. In frame mode, the library
+//is given only the frames from the silence before the segment, as it
+//would read the whole file for each segment; returns -1 on error
+int follow_split(main_data *data)
+{
+  splt_state *state = data->state;
+  const char *filename = data->filenames[0];
+  int err = SPLT_OK;
+
+  if ((data->number_of_filenames != 1) || (strcmp(filename, "-") == 0) ||
+      (strcmp(filename, "m-") == 0) || (strcmp(filename, "o-") == 0))
+  {
+    return print_run_error(_("the --follow option needs one mp3 input file"
+          " (not STDIN)"), data);
+  }
+
+  //the segments are split by the library as soon as they are complete
+  if (find_plugins_once(data) == -1)
+  {
+    return -1;
+  }
+
+  float threshold =
+    mp3splt_get_float_option(state, SPLT_OPT_PARAM_THRESHOLD, &err);
+  float offset = mp3splt_get_float_option(state, SPLT_OPT_PARAM_OFFSET, &err);
+  float min_length =
+    mp3splt_get_float_option(state, SPLT_OPT_PARAM_MIN_LENGTH, &err);
+  if (min_length <= 0)
+  {
+    min_length = MP3SPLT_FOLLOW_MIN_SILENCE;
+  }
+  mp3splt_set_int_option(state, SPLT_OPT_SPLIT_MODE, SPLT_OPTION_NORMAL_MODE);
+  if (set_follow_output(data, filename) == -1)
+  {
+    return -1;
+  }
+
+  follow_window window;
+  window.input = NULL;
+  window.tag_end = 0;
+  window.begin = 0;
+  window.time = 0;
+  window.end = 0;
+  int frame_mode = mp3splt_get_int_option(state, SPLT_OPT_FRAME_MODE, &err);
+
+  FILE *in = fopen(filename, "rb");
+  if (in && frame_mode && !data->opt->P_option)
+  {
+    window.input = fopen(filename, "rb");
+    if (!window.input)
+    {
+      fclose(in);
+      in = NULL;
+    }
+  }
+  if (!in)
+  {
+    char message[1024] = { '\0' };
+    snprintf(message, 1024, _("cannot open '%s': %s"), filename,
+        strerror(errno));
+    return print_run_error(message, data);
+  }
+  follow_window *segment_window = window.input ? &window : NULL;
+
+  fprintf(data->console_out, _(" Following file '%s' ...\n"), filename);
+  fflush(data->console_out);
+
+  unsigned char *buffer =
+    my_malloc(sizeof(unsigned char) * MP3SPLT_FOLLOW_BUFFER, data);
+  if (!buffer)
+  {
+    fclose(in);
+    if (window.input)
+    {
+      fclose(window.input);
+    }
+    return -1;
+  }
+  size_t length = 0;
+  //offset in the file of the start of the buffer and of the silence
+  unsigned long buffer_offset = 0;
+  unsigned long silence_offset = 0;
+  unsigned long skip = 0;
+  int started = SPLT_FALSE;
+  //times in seconds from the start of the file
+  double time = 0;
+  double segment_begin = 0;
+  double silence_begin = -1;
+  int silence_split = SPLT_FALSE;
+  int idle_seconds = 0;
+
+  while (!data->cancel_requested && (idle_seconds < MP3SPLT_FOLLOW_TIMEOUT))
+  {
+    size_t read_bytes =
+      fread(buffer + length, 1, MP3SPLT_FOLLOW_BUFFER - length, in);
+    if (read_bytes == 0)
+    {
+      if (ferror(in))
+      {
+        break;
+      }
+      //wait for the file to grow
+      clearerr(in);
+      idle_seconds++;
+#ifdef __WIN32__
+      Sleep(1000);
+#else
+      sleep(1);
+#endif
+      continue;
+    }
+    idle_seconds = 0;
+    length += read_bytes;
+
+    size_t position = 0;
+    while (position < length)
+    {
+      if (skip > 0)
+      {
+        size_t skipped = (skip < length - position) ? skip : length - position;
+        skip -= skipped;
+        position += skipped;
+        continue;
+      }
+
+      //the ID3v2 tag at the start
+      if (!started)
+      {
+        if (length - position < 10)
+        {
+          break;
+        }
+        if (memcmp(buffer + position, "ID3", 3) == 0)
+        {
+          skip = 10 + get_id3v2_size(buffer + position + 6, SPLT_TRUE);
+          if (buffer[position + 5] & 0x10)
+          {
+            skip += 10;
+          }
+        }
+        window.tag_end = skip;
+        window.begin = skip;
+        started = SPLT_TRUE;
+        continue;
+      }
+
+      if (length - position < 4)
+      {
+        break;
+      }
+      double duration = 0;
+      unsigned long frame_length =
+        mp3_frame_length(buffer + position, &duration, NULL);
+      if (frame_length < 4)
+      {
+        position++;
+        continue;
+      }
+      if (length - position < frame_length)
+      {
+        break;
+      }
+
+      float level = get_frame_level(buffer + position, frame_length);
+      if (level < threshold)
+      {
+        if (silence_begin < 0)
+        {
+          silence_begin = time;
+          silence_offset = buffer_offset + position;
+          silence_split = SPLT_FALSE;
+        }
+        //the silence is long enough: the segment ends in it
+        if (!silence_split && (time + duration - silence_begin >= min_length))
+        {
+          double end = silence_begin + offset * min_length;
+          if (end > segment_begin)
+          {
+            window.end = buffer_offset + position + frame_length;
+            if (split_followed_segment(data, filename,
+                  (long) (segment_begin * 100), (long) (end * 100),
+                  segment_window) == -1)
+            {
+              fclose(in);
+              if (window.input)
+              {
+                fclose(window.input);
+              }
+              free(buffer);
+              return -1;
+            }
+            segment_begin = end;
+            //the next segment starts in this silence
+            window.begin = silence_offset;
+            window.time = silence_begin;
+          }
+          silence_split = SPLT_TRUE;
+        }
+      }
+      else
+      {
+        silence_begin = -1;
+      }
+
+      time += duration;
+      position += frame_length;
+    }
+
+    memmove(buffer, buffer + position, length - position);
+    length -= position;
+    buffer_offset += position;
+  }
+
+  int read_error = ferror(in);
+  fclose(in);
+  free(buffer);
+  buffer = NULL;
+
+  int result = 0;
+  if (read_error)
+  {
+    char message[1024] = { '\0' };
+    snprintf(message, 1024, _("cannot read '%s'"), filename);
+    result = print_run_error(message, data);
+  }
+  //the last segment, up to the end of the file
+  else if (time > segment_begin)
+  {
+    window.end = 0;
+    result = split_followed_segment(data, filename,
+        (long) (segment_begin * 100), LONG_MAX, segment_window);
+  }
+
+  if (window.input)
+  {
+    fclose(window.input);
+  }
+
+  return result;
+}
+
+#ifdef __linux__
+//SPLT_TRUE if the file name has an extension that can be split; hidden
+//files (partial uploads) are skipped
+int is_watched_file_name(const char *name)
+{
+  const char *dot = strrchr(name, '.');
+  if ((name[0] == '.') || !dot)
+  {
+    return SPLT_FALSE;
+  }
+
+  return (strcasecmp(dot, ".mp3") == 0) || (strcasecmp(dot, ".ogg") == 0);
+}
+
+//SPLT_TRUE if 'path' is 'directory' or is inside it, once the links are
+//resolved; 'path' may not exist yet, like the directory of -d
+int is_inside_directory(const char *path, const char *directory)
+{
+  char *real_directory = realpath(directory, NULL);
+  char *existing = strdup(path);
+  if (!real_directory || !existing)
+  {
+    free(real_directory);
+    free(existing);
+    return SPLT_FALSE;
+  }
+
+  //the nearest existing parent of 'path'
+  char *real_path = NULL;
+  while ((real_path = realpath(existing, NULL)) == NULL)
+  {
+    char *slash = strrchr(existing, SPLT_DIRCHAR);
+    if (!slash)
+    {
+      real_path = realpath(".", NULL);
+      break;
+    }
+    if (slash == existing)
+    {
+      slash[1] = '\0';
+    }
+    else
+    {
+      *slash = '\0';
+    }
+  }
+  free(existing);
+
+  int inside = SPLT_FALSE;
+  if (real_path)
+  {
+    size_t length = strlen(real_directory);
+    inside = (strcmp(real_directory, "/") == 0) ||
+      ((strncmp(real_path, real_directory, length) == 0) &&
+       ((real_path[length] == '\0') || (real_path[length] == SPLT_DIRCHAR)));
+  }
+  free(real_path);
+  free(real_directory);
+
+  return inside;
+}
+
+//adds a file to the queue of the watch mode; returns -1 on error
+int queue_watched_file(main_data *data, watch_queue *queue,
+    const char *directory, const char *name)
+{
+  if (!is_watched_file_name(name))
+  {
+    return 0;
+  }
+
+  size_t size = strlen(directory) + strlen(name) + 2;
+  char *filename = my_malloc(size, data);
+  if (!filename)
+  {
+    return -1;
+  }
+  snprintf(filename, size, "%s%c%s", directory, SPLT_DIRCHAR, name);
+
+  struct stat file_stat;
+  if ((stat(filename, &file_stat) != 0) || !S_ISREG(file_stat.st_mode))
+  {
+    free(filename);
+    return 0;
+  }
+
+  int i = 0;
+  for (i = 0; i < queue->number_of_files; i++)
+  {
+    if (strcmp(queue->files[i], filename) == 0)
+    {
+      free(filename);
+      return 0;
+    }
+  }
+  for (i = 0; i < queue->number_of_jobs; i++)
+  {
+    if (strcmp(queue->jobs[i].filename, filename) == 0)
+    {
+      free(filename);
+      return 0;
+    }
+  }
+
+  char **files = my_realloc(queue->files,
+      sizeof(char *) * (queue->number_of_files + 1), data);
+  if (!files)
+  {
+    free(filename);
+    return -1;
+  }
+  queue->files = files;
+  queue->files[queue->number_of_files] = filename;
+  queue->number_of_files++;
+
+  return 0;
+}
+
+//moves a finished input file to 'directory' (--done-dir, --error-dir)
+void move_watched_file(const char *filename, const char *directory)
+{
+  if (!directory)
+  {
+    return;
+  }
+
+  const char *name = strrchr(filename, SPLT_DIRCHAR);
+  name = name ? name + 1 : filename;
+  size_t size = strlen(directory) + strlen(name) + 2;
+  char *target = malloc(size);
+  if (!target)
+  {
+    return;
+  }
+  snprintf(target, size, "%s%c%s", directory, SPLT_DIRCHAR, name);
+
+  if (rename(filename, target) != 0)
+  {
+    char message[1024] = { '\0' };
+    snprintf(message, 1024, _("cannot move '%s' to '%s': %s"),
+        filename, directory, strerror(errno));
+    print_warning(message);
+  }
+  free(target);
+}
+
+//runs each split of the watch mode, defined below
+int run_command_line(int argc, char **argv);
+
+//splits one queued file in a child process, with the command line of
+//the watch mode where the watched directories are replaced by the file
+void start_watch_job(main_data *data, watch_queue *queue)
+{
+  char *filename = queue->files[0];
+  memmove(queue->files, queue->files + 1,
+      sizeof(char *) * (queue->number_of_files - 1));
+  queue->number_of_files--;
+
+  //without memory, the split fails like when the process cannot start
+  pid_t pid = -1;
+  char **argv = malloc(sizeof(char *) * (data->number_of_original_args + 2));
+  if (!argv)
+  {
+    errno = ENOMEM;
+    goto start_error;
+  }
+  int argc = 0, i = 0, j = 0;
+  for (i = 0; i < data->number_of_original_args; i++)
+  {
+    char *argument = data->original_argv[i];
+    int skipped = SPLT_FALSE;
+    for (j = 0; j < data->number_of_watch_arguments; j++)
+    {
+      skipped |= (argument == data->watch_arguments[j]);
+    }
+    if (!skipped)
+    {
+      argv[argc++] = argument;
+    }
+  }
+  argv[argc++] = filename;
+  argv[argc] = NULL;
+
+  fflush(NULL);
+  pid = fork();
+  if (pid == 0)
+  {
+    close(queue->inotify_fd);
+    watch_job_process = SPLT_TRUE;
+    //the options that change the process (-Q closes stdout) only apply to
+    //the job
+    _exit(run_command_line(argc, argv));
+  }
+  free(argv);
+
+start_error:
+  if (pid < 0)
+  {
+    char message[1024] = { '\0' };
+    snprintf(message, 1024, _("cannot start the split of '%s': %s"),
+        filename, strerror(errno));
+    print_warning(message);
+    move_watched_file(filename, data->opt->error_dir_arg);
+    free(filename);
+    return;
+  }
+
+  fprintf(data->console_out, _(" Splitting '%s' ...\n"), filename);
+  fflush(data->console_out);
+  queue->jobs[queue->number_of_jobs].pid = pid;
+  queue->jobs[queue->number_of_jobs].filename = filename;
+  queue->number_of_jobs++;
+}
+
+//waits for the finished jobs of the watch mode ('wait_all' for all the
+//jobs) and moves their input files
+void finish_watch_jobs(main_data *data, watch_queue *queue, int wait_all)
+{
+  while (queue->number_of_jobs > 0)
+  {
+    int status = 0;
+    pid_t pid = waitpid(-1, &status, wait_all ? 0 : WNOHANG);
+    if (pid <= 0)
+    {
+      if ((pid < 0) && (errno == EINTR))
+      {
+        continue;
+      }
+      return;
+    }
+
+    int i = 0;
+    for (i = 0; i < queue->number_of_jobs; i++)
+    {
+      if (queue->jobs[i].pid == pid)
+      {
+        break;
+      }
+    }
+    if (i == queue->number_of_jobs)
+    {
+      continue;
+    }
+
+    char *filename = queue->jobs[i].filename;
+    queue->jobs[i] = queue->jobs[queue->number_of_jobs - 1];
+    queue->number_of_jobs--;
+
+    int exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    if (exit_code == 0)
+    {
+      fprintf(data->console_out, _(" Split '%s'\n"), filename);
+      fflush(data->console_out);
+      move_watched_file(filename, data->opt->done_dir_arg);
+    }
+    //cancelled files are split again at the next start
+    else if (exit_code != MP3SPLT_CANCELLED_EXIT_CODE)
+    {
+      char message[1024] = { '\0' };
+      snprintf(message, 1024, _("the split of '%s' failed"), filename);
+      print_warning(message);
+      move_watched_file(filename, data->opt->error_dir_arg);
+    }
+    free(filename);
+  }
+}
+#endif
+
+//--watch: splits the mp3 and ogg files written or moved to the watched
+//directories (the directories given as input), with up to --watch-jobs
+//splits at once; the files already there are split first. Runs until
+//Ctrl+C, then waits for the running splits; returns -1 on error
+int watch_directories(main_data *data)
+{
+#ifndef __linux__
+  return print_run_error(_("--watch is not supported on this system"), data);
+#else
+  options *opt = data->opt;
+  watch_queue queue;
+  memset(&queue, 0, sizeof(queue));
+  int i = 0;
+
+  if (data->number_of_filenames <= 0)
+  {
+    return print_run_error(_("the --watch option needs directories to watch"),
+        data);
+  }
+  for (i = 0; i < data->number_of_filenames; i++)
+  {
+    if (!mp3splt_u_check_if_directory(data->filenames[i]))
+    {
+      char message[1024] = { '\0' };
+      snprintf(message, 1024, _("'%s' is not a directory to watch"),
+          data->filenames[i]);
+      return print_run_error(message, data);
+    }
+
+    //the created and moved files would be split again
+    const char *outputs[3] = { opt->dir_arg, opt->done_dir_arg,
+      opt->error_dir_arg };
+    int k = 0;
+    for (k = 0; k < 3; k++)
+    {
+      if (outputs[k] && is_inside_directory(outputs[k], data->filenames[i]))
+      {
+        char message[1024] = { '\0' };
+        snprintf(message, 1024, _("'%s' is inside the watched directory '%s':"
+              " its files would be split again"), outputs[k],
+            data->filenames[i]);
+        return print_run_error(message, data);
+      }
+    }
+  }
+
+  queue.inotify_fd = inotify_init();
+  if (queue.inotify_fd < 0)
+  {
+    char message[1024] = { '\0' };
+    snprintf(message, 1024, _("cannot watch the directories: %s"),
+        strerror(errno));
+    return print_run_error(message, data);
+  }
+  int *watches = my_malloc(sizeof(int) * data->number_of_filenames, data);
+  if (!watches)
+  {
+    close(queue.inotify_fd);
+    return -1;
+  }
+  for (i = 0; i < data->number_of_filenames; i++)
+  {
+    watches[i] = inotify_add_watch(queue.inotify_fd, data->filenames[i],
+        IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (watches[i] < 0)
+    {
+      char message[1024] = { '\0' };
+      snprintf(message, 1024, _("cannot watch '%s': %s"),
+          data->filenames[i], strerror(errno));
+      close(queue.inotify_fd);
+      free(watches);
+      return print_run_error(message, data);
+    }
+    fprintf(data->console_out, _(" Watching directory '%s' ...\n"), data->filenames[i]);
+  }
+  fflush(data->console_out);
+  queue.jobs = my_malloc(sizeof(watch_job) * opt->watch_jobs, data);
+  int result = queue.jobs ? 0 : -1;
+
+  //the files already there
+  for (i = 0; (i < data->number_of_filenames) && (result != -1); i++)
+  {
+    DIR *directory = opendir(data->filenames[i]);
+    struct dirent *entry = NULL;
+    while (directory && (result != -1) &&
+        ((entry = readdir(directory)) != NULL))
+    {
+      result =
+        queue_watched_file(data, &queue, data->filenames[i], entry->d_name);
+    }
+    if (directory)
+    {
+      closedir(directory);
+    }
+  }
+
+  char events[MP3SPLT_WATCH_EVENTS_SIZE]
+    __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  while (!data->cancel_requested && (result != -1))
+  {
+    finish_watch_jobs(data, &queue, SPLT_FALSE);
+    while ((queue.number_of_jobs < opt->watch_jobs) &&
+        (queue.number_of_files > 0))
+    {
+      start_watch_job(data, &queue);
+    }
+
+    //wake up at least every second for the finished jobs
+    struct pollfd watch_poll;
+    watch_poll.fd = queue.inotify_fd;
+    watch_poll.events = POLLIN;
+    if (poll(&watch_poll, 1, 1000) <= 0)
+    {
+      continue;
+    }
+
+    ssize_t length = read(queue.inotify_fd, events, sizeof(events));
+    char *event_position = events;
+    while ((length > 0) && (event_position < events + length))
+    {
+      struct inotify_event *event = (struct inotify_event *) event_position;
+      if (event->len > 0)
+      {
+        int k = 0;
+        for (k = 0; k < data->number_of_filenames; k++)
+        {
+          if ((watches[k] == event->wd) && (result != -1))
+          {
+            result = queue_watched_file(data, &queue, data->filenames[k],
+                event->name);
+          }
+        }
+      }
+      event_position += sizeof(struct inotify_event) + event->len;
+    }
+  }
+
+  if (queue.number_of_jobs > 0)
+  {
+    fprintf(data->console_out, _(" Waiting for %d split(s) ...\n"), queue.number_of_jobs);
+    fflush(data->console_out);
+  }
+  finish_watch_jobs(data, &queue, SPLT_TRUE);
+
+  close(queue.inotify_fd);
+  free(watches);
+  for (i = 0; i < queue.number_of_files; i++)
+  {
+    free(queue.files[i]);
+  }
+  free(queue.files);
+  free(queue.jobs);
+
+  return result;
+#endif
+}
+
+//appends a word or disc id of the cd at 'offset' in the discs file;
+//returns -1 on error
+int append_local_cddb_posting(main_data *data, local_cddb_posting **postings,
+    int *number_of_postings, int *capacity, const char *key, long offset)
+{
+  if (*number_of_postings >= *capacity)
+  {
+    int new_capacity = (*capacity > 0) ? *capacity * 2 : 1024;
+    local_cddb_posting *grown = my_realloc(*postings,
+        sizeof(local_cddb_posting) * new_capacity, data);
+    if (!grown)
+    {
+      return -1;
+    }
+    *postings = grown;
+    *capacity = new_capacity;
+  }
+
+  local_cddb_posting *posting = &(*postings)[*number_of_postings];
+  posting->key = strdup(key);
+  if (!posting->key)
+  {
+    return print_run_error(_("cannot allocate memory !"), data);
+  }
+  posting->offset = offset;
+  (*number_of_postings)++;
+
+  return 0;
+}
+
+void free_local_cddb_postings(local_cddb_posting **postings,
+    int number_of_postings)
+{
+  int i = 0;
+  for (i = 0; *postings && (i < number_of_postings); i++)
+  {
+    free((*postings)[i].key);
+  }
+  free(*postings);
+  *postings = NULL;
+}
+
+int compare_local_cddb_postings(const void *a, const void *b)
+{
+  const local_cddb_posting *first = a;
+  const local_cddb_posting *second = b;
+  int result = strcmp(first->key, second->key);
+  if (result != 0)
+  {
+    return result;
+  }
+
+  return (first->offset > second->offset) - (first->offset < second->offset);
+}
+
+//replaces the tabs and newlines, the separators of the index
+void remove_local_cddb_separators(char *text)
+{
+  for (; *text; text++)
+  {
+    if ((*text == '\t') || (*text == '\n') || (*text == '\r'))
+    {
+      *text = ' ';
+    }
+  }
+}
+
+//adds the cd of a xmcd file to the index; the other files are skipped;
+//returns -1 on error
+int index_cddb_file(main_data *data, local_cddb_builder *builder,
+    const char *filename)
+{
+  char line[MP3SPLT_LOCAL_CDDB_LINE_SIZE] = { '\0' };
+  FILE *file = fopen(filename, "r");
+  if (!file)
+  {
+    return 0;
+  }
+  if (!fgets(line, MP3SPLT_LOCAL_CDDB_LINE_SIZE, file) ||
+      (strncmp(line, "# xmcd", 6) != 0))
+  {
+    fclose(file);
+    return 0;
+  }
+
+  //the disc ids and the artist and title can be on several lines
+  char discids[MP3SPLT_LOCAL_CDDB_LINE_SIZE] = { '\0' };
+  char title[MP3SPLT_LOCAL_CDDB_LINE_SIZE] = { '\0' };
+  while (fgets(line, MP3SPLT_LOCAL_CDDB_LINE_SIZE, file))
+  {
+    line[strcspn(line, "\r\n")] = '\0';
+    if (strncmp(line, "DISCID=", 7) == 0)
+    {
+      size_t length = strlen(discids);
+      snprintf(discids + length, MP3SPLT_LOCAL_CDDB_LINE_SIZE - length,
+          "%s%s", (length > 0) ? "," : "", line + 7);
+    }
+    else if (strncmp(line, "DTITLE=", 7) == 0)
+    {
+      size_t length = strlen(title);
+      snprintf(title + length, MP3SPLT_LOCAL_CDDB_LINE_SIZE - length,
+          "%s", line + 7);
+    }
+  }
+  fclose(file);
+
+  char word[MP3SPLT_LOCAL_CDDB_WORD_SIZE] = { '\0' };
+  const char *position = discids;
+  if (!get_next_local_cddb_word(&position, word))
+  {
+    return 0;
+  }
+
+  //the category is the directory of the file in the freedb dumps
+  char category[MP3SPLT_LOCAL_CDDB_WORD_SIZE] = { '\0' };
+  const char *end = strrchr(filename, SPLT_DIRCHAR);
+  if (end)
+  {
+    const char *start = end;
+    while ((start > filename) && (*(start - 1) != SPLT_DIRCHAR))
+    {
+      start--;
+    }
+    snprintf(category, sizeof(category), "%.*s", (int) (end - start), start);
+  }
+  remove_local_cddb_separators(category);
+  remove_local_cddb_separators(title);
+
+#ifdef __WIN32__
+  char *path = _fullpath(NULL, filename, 0);
+#else
+  char *path = realpath(filename, NULL);
+#endif
+  if (!path)
+  {
+    path = strdup(filename);
+  }
+  if (!path)
+  {
+    return print_run_error(_("cannot allocate memory !"), data);
+  }
+  remove_local_cddb_separators(path);
+
+  long offset = ftell(builder->discs);
+  fprintf(builder->discs, "%s\t%s\t%s\t%s\n", word, category, title, path);
+  free(path);
+
+  do {
+    if (append_local_cddb_posting(data, &builder->discids,
+          &builder->number_of_discids, &builder->discids_capacity,
+          word, offset) == -1)
+    {
+      return -1;
+    }
+  } while (get_next_local_cddb_word(&position, word));
+
+  position = title;
+  while (get_next_local_cddb_word(&position, word))
+  {
+    if (append_local_cddb_posting(data, &builder->words,
+          &builder->number_of_words, &builder->words_capacity,
+          word, offset) == -1)
+    {
+      return -1;
+    }
+  }
+
+  builder->number_of_discs++;
+
+  return 0;
+}
+
+//adds the xmcd files of 'path' and of its subdirectories to the index;
+//returns -1 on error
+int add_cddb_files_to_index(main_data *data, local_cddb_builder *builder,
+    const char *path)
+{
+  struct stat path_stat;
+  if (data->cancel_requested || (stat(path, &path_stat) != 0))
+  {
+    return 0;
+  }
+
+  if (S_ISREG(path_stat.st_mode))
+  {
+    builder->number_of_files++;
+    return index_cddb_file(data, builder, path);
+  }
+  if (!S_ISDIR(path_stat.st_mode))
+  {
+    return 0;
+  }
+
+  int result = 0;
+  DIR *directory = opendir(path);
+  struct dirent *entry = NULL;
+  while (directory && (result != -1) &&
+      ((entry = readdir(directory)) != NULL))
+  {
+    if ((strcmp(entry->d_name, ".") == 0) || (strcmp(entry->d_name, "..") == 0))
+    {
+      continue;
+    }
+
+    size_t size = strlen(path) + strlen(entry->d_name) + 2;
+    char *child = my_malloc(size, data);
+    if (!child)
+    {
+      result = -1;
+      break;
+    }
+    snprintf(child, size, "%s%c%s", path, SPLT_DIRCHAR, entry->d_name);
+    result = add_cddb_files_to_index(data, builder, child);
+    free(child);
+  }
+  if (directory)
+  {
+    closedir(directory);
+  }
+
+  return result;
+}
+
+//returns the path of the file 'name' of the index, or NULL on error
+char *get_local_cddb_filename(main_data *data, const char *name)
+{
+  const char *index = data->opt->cddb_index_arg;
+  size_t size = strlen(index) + strlen(name) + 2;
+  char *filename = my_malloc(size, data);
+  if (filename)
+  {
+    snprintf(filename, size, "%s%c%s", index, SPLT_DIRCHAR, name);
+  }
+
+  return filename;
+}
+
+//sorts the postings and writes them once each to the index file 'name';
+//returns -1 on error
+int write_local_cddb_postings(main_data *data, const char *name,
+    local_cddb_posting *postings, int number_of_postings)
+{
+  qsort(postings, number_of_postings, sizeof(local_cddb_posting),
+      compare_local_cddb_postings);
+
+  char *filename = get_local_cddb_filename(data, name);
+  if (!filename)
+  {
+    return -1;
+  }
+  char *temporary = NULL;
+  FILE *file = open_atomic_file(filename, "wb", &temporary);
+  int i = 0;
+  for (i = 0; file && (i < number_of_postings); i++)
+  {
+    if ((i == 0) ||
+        (compare_local_cddb_postings(&postings[i], &postings[i - 1]) != 0))
+    {
+      fprintf(file, "%s\t%ld\n", postings[i].key, postings[i].offset);
+    }
+  }
+
+  if (!file || (close_atomic_file(file, temporary, filename) == -1))
+  {
+    char message[1024] = { '\0' };
+    snprintf(message, 1024, _("cannot write the index file '%s' (%s)"),
+        filename, strerror(errno));
+    free(filename);
+    return print_run_error(message, data);
+  }
+  free(filename);
+
+  return 0;
+}
+
+//--build-cddb-index: indexes the xmcd files of the freedb dumps given as
+//arguments for the local freedb search type. The index directory has
+//the cds ('discs'), and the sorted words of their artist and title
+//('words') and their disc ids ('discids') with the offset of the cd,
+//searched by bisection; returns -1 on error
+int build_cddb_index(main_data *data)
+{
+  options *opt = data->opt;
+  char message[1024] = { '\0' };
+
+  if (data->argc <= 1)
+  {
+    return print_run_error(_("the --build-cddb-index option needs the"
+          " directories of the xmcd files"), data);
+  }
+  if (create_directories_cached(data, opt->cddb_index_arg) == -1)
+  {
+    snprintf(message, 1024, _("cannot create the index directory '%s' (%s)"),
+        opt->cddb_index_arg, strerror(errno));
+    return print_run_error(message, data);
+  }
+
+  local_cddb_builder builder;
+  memset(&builder, 0, sizeof(builder));
+
+  char *discs_filename = get_local_cddb_filename(data, MP3SPLT_LOCAL_CDDB_DISCS);
+  if (!discs_filename)
+  {
+    return -1;
+  }
+  char *discs_temporary = NULL;
+  builder.discs = open_atomic_file(discs_filename, "wb", &discs_temporary);
+  if (!builder.discs)
+  {
+    snprintf(message, 1024, _("cannot write the index file '%s' (%s)"),
+        discs_filename, strerror(errno));
+    free(discs_filename);
+    return print_run_error(message, data);
+  }
+  fprintf(builder.discs, "%s\n", MP3SPLT_LOCAL_CDDB_HEADER);
+
+  int result = 0;
+  int i = 0;
+  for (i = 1; (i < data->argc) && (result != -1); i++)
+  {
+    fprintf(data->console_out, _(" Indexing '%s' ...\n"), data->argv[i]);
+    fflush(data->console_out);
+    result = add_cddb_files_to_index(data, &builder, data->argv[i]);
+  }
+
+  if ((result == -1) || data->cancel_requested)
+  {
+    discard_atomic_file(builder.discs, discs_temporary);
+    free(discs_filename);
+    free_local_cddb_postings(&builder.words, builder.number_of_words);
+    free_local_cddb_postings(&builder.discids, builder.number_of_discids);
+    return (result == -1) ? -1 : exit_cancelled(data, SPLT_FALSE);
+  }
+
+  if (close_atomic_file(builder.discs, discs_temporary, discs_filename) == -1)
+  {
+    snprintf(message, 1024, _("cannot write the index file '%s' (%s)"),
+        discs_filename, strerror(errno));
+    free(discs_filename);
+    free_local_cddb_postings(&builder.words, builder.number_of_words);
+    free_local_cddb_postings(&builder.discids, builder.number_of_discids);
+    return print_run_error(message, data);
+  }
+  free(discs_filename);
+
+  result = write_local_cddb_postings(data, MP3SPLT_LOCAL_CDDB_WORDS,
+      builder.words, builder.number_of_words);
+  free_local_cddb_postings(&builder.words, builder.number_of_words);
+  if (result != -1)
+  {
+    result = write_local_cddb_postings(data, MP3SPLT_LOCAL_CDDB_DISCIDS,
+        builder.discids, builder.number_of_discids);
+  }
+  free_local_cddb_postings(&builder.discids, builder.number_of_discids);
+  if (result == -1)
+  {
+    return -1;
+  }
+
+  snprintf(message, 1024, _(" Indexed %d cd(s) from %d file(s) in '%s'"),
+      builder.number_of_discs, builder.number_of_files, opt->cddb_index_arg);
+  print_message(message);
+
+  return 0;
+}
+
+//splits the fields of a plan line in place; returns the number of fields
+int split_plan_line(char *line, char **fields, int max_fields)
+{
+  int number_of_fields = 0;
+  char *read = line;
+  char *write = line;
+
+  fields[number_of_fields++] = write;
+  while (*read != '\0' && *read != '\n' && *read != '\r')
+  {
+    if (*read == '\t')
+    {
+      *write++ = '\0';
+      if (number_of_fields >= max_fields)
+      {
+        return -1;
+      }
+      fields[number_of_fields++] = write;
+      read++;
+    }
+    else if (*read == '\\' && read[1] != '\0')
+    {
+      read++;
+      switch (*read)
+      {
+        case 't':
+          *write++ = '\t';
+          break;
+        case 'n':
+          *write++ = '\n';
+          break;
+        case 'r':
+          *write++ = '\r';
+          break;
+        default:
+          *write++ = *read;
+          break;
+      }
+      read++;
+    }
+    else
+    {
+      *write++ = *read++;
+    }
+  }
+  *write = '\0';
+
+  return number_of_fields;
+}
+
+//parses a time of the split plan
+int parse_plan_time(const char *field, long *hundreths)
+{
+  if (strcmp(field, "EOF") == 0)
+  {
+    *hundreths = LONG_MAX;
+    return SPLT_TRUE;
+  }
+
+  char *end = NULL;
+  errno = 0;
+  long value = strtol(field, &end, 10);
+  if ((errno != 0) || (end == field) || (*end != '\0') || (value < 0))
+  {
+    return SPLT_FALSE;
+  }
+  *hundreths = value;
+
+  return SPLT_TRUE;
+}
+
+//creates the segment of a plan line; the tags are the ones of the plan
+//if any, else the tags of the input file; returns -1 on error
+int execute_plan_segment(main_data *data, char **fields, int number_of_fields)
+{
+  options *opt = data->opt;
+  splt_state *state = data->state;
+  const char *input = fields[1];
+  const char *output = fields[4];
+
+  //output directory and filename without the extension
+  char *output_dir = strdup(output);
+  if (!output_dir)
+  {
+    return print_run_error(_("cannot allocate memory !"), data);
+  }
+  char *output_name = strrchr(output_dir, SPLT_DIRCHAR);
+  if (output_name)
+  {
+    *output_name = '\0';
+    output_name++;
+  }
+  else
+  {
+    output_name = output_dir;
+  }
+  char *extension = strrchr(output_name, '.');
+  if (extension && extension != output_name)
+  {
+    *extension = '\0';
+  }
+  const char *path_of_split = (output_name == output_dir) ? "." : output_dir;
+  if (path_of_split[0] == '\0')
+  {
+    path_of_split = SPLT_DIRSTR;
+  }
+
+  if (!opt->P_option && (create_directories_cached(data, path_of_split) == -1))
+  {
+    char message[1024] = { '\0' };
+    snprintf(message, 1024, _("cannot create directory '%s' (%s)"),
+        path_of_split, strerror(errno));
+    free(output_dir);
+    return print_run_error(message, data);
   }
 
-  //possible search string
-  int we_have_search_string = SPLT_FALSE;
-  if (cur_pos != NULL)
+  int err = mp3splt_set_path_of_split(state, path_of_split);
+  if (err >= 0)
   {
-    if ((cur_pos = strchr(cur_pos, '{')))
-    {
-      //if we don't have }, ambigous
-      if (!(end_pos = strchr(cur_pos,'}')))
-      {
-        ambigous = SPLT_TRUE;
-      }
-      else
-      {
-        if (end_pos-cur_pos < 2048)
-        {
-          snprintf(opt->freedb_arg_search_string, end_pos-cur_pos, "%s", cur_pos+1);
-          opt->freedb_arg_search_string[end_pos-cur_pos-1] = '\0';
-          we_have_search_string = SPLT_TRUE;
-        }
-      }
-    }
+    err = mp3splt_set_filename_to_split(state, input);
+  }
 
-    if (ambigous)
+  long begin = 0;
+  long end = 0;
+  parse_plan_time(fields[2], &begin);
+  parse_plan_time(fields[3], &end);
+  if (err >= 0)
+  {
+    err = mp3splt_append_splitpoint(state, begin, output_name,
+        SPLT_SPLITPOINT);
+  }
+  if (err >= 0)
+  {
+    err = mp3splt_append_splitpoint(state, end, NULL, SPLT_SPLITPOINT);
+  }
+
+  free(output_dir);
+  output_dir = NULL;
+  if (process_confirmation_error(err, data) == -1)
+  {
+    return -1;
+  }
+
+  if (number_of_fields >= 13)
+  {
+    mp3splt_set_int_option(state, SPLT_OPT_TAGS, SPLT_CURRENT_TAGS);
+    err = mp3splt_append_tags(state, fields[5], fields[6], fields[7],
+        fields[8], fields[9], fields[10], atoi(fields[11]),
+        (unsigned char) atoi(fields[12]));
+    if (process_confirmation_error(err, data) == -1)
     {
-      return ambigous;
+      return -1;
     }
   }
+  else
+  {
+    mp3splt_set_int_option(state, SPLT_OPT_TAGS,
+        opt->n_option ? SPLT_NO_TAGS : SPLT_TAGS_ORIGINAL_FILE);
+  }
 
-  //possible get result integer from the search results
-  if (cur_pos != NULL)
+  free_split_files(data);
+  data->interrupted_file[0] = '\0';
+  io_limiter_start(data);
+  cache_hints_start(data, input);
+
+  trace_split_start(data, input);
+  err = mp3splt_split(state);
+  if (check_callback_error(data) == -1)
   {
-    if ((cur_pos = strchr(cur_pos, '(')))
+    return -1;
+  }
+  if (data->split_cancelled && (err == SPLT_SPLIT_CANCELLED))
+  {
+    return exit_cancelled(data, SPLT_FALSE);
+  }
+  if (process_confirmation_error(err, data) == -1)
+  {
+    return -1;
+  }
+
+  cache_hints_finish(data);
+
+  if (opt->m_option && !opt->P_option)
+  {
+    if (append_m3u_entries(data) == -1)
     {
-      if (!we_have_search_string)
-      {
-        return ambigous;
-      }
-  
-      //if we don't have ), ambigous
-      if (!(end_pos = strchr(cur_pos,')')))
-      {
-        ambigous = SPLT_TRUE;
-      }
-      else
-      {
-        char chosen_int[256] = { '\0' };
-        if (end_pos-cur_pos < 256)
-        {
-          snprintf(chosen_int, end_pos-cur_pos, "%s", cur_pos+1);
-          opt->freedb_arg_result_option = atoi(chosen_int);
-        }
-      }
+      return -1;
     }
+    free_split_files(data);
   }
 
-  return ambigous;
+  err = SPLT_OK;
+  mp3splt_erase_all_tags(state, &err);
+  if (process_confirmation_error(err, data) == -1)
+  {
+    return -1;
+  }
+  err = SPLT_OK;
+  mp3splt_erase_all_splitpoints(state, &err);
+  return process_confirmation_error(err, data);
 }
 
-//makes the freedb search
-void do_freedb_search(main_data *data)
+//splits the segments of a split plan (--execute-plan): the splitpoints
+//and the output filenames come from the plan so we don't analyse anything;
+//returns -1 on error
+int execute_plan(main_data *data)
 {
-  int err = SPLT_OK;
   options *opt = data->opt;
-  splt_state *state = data->state;
+  FILE *plan = NULL;
 
-  //we find out what search and get type we have
-  char search_type[30] = "";
-  char get_type[30] = "";
-  if (opt->freedb_search_type == SPLT_FREEDB_SEARCH_TYPE_CDDB_CGI)
+  if (strcmp(opt->execute_plan_arg, "-") == 0)
   {
-    snprintf(search_type,30,"%s","cddb_cgi");
+    plan = stdin;
   }
   else
   {
-    snprintf(search_type,30,"%s","web_search");
-  }
-  if (opt->freedb_get_type == SPLT_FREEDB_GET_FILE_TYPE_CDDB_CGI)
-  {
-    snprintf(get_type,30,"%s","cddb_cgi");
+    plan = fopen(opt->execute_plan_arg, "r");
   }
-  else
+  if (!plan)
   {
-    snprintf(get_type,30,"%s","cddb_protocol");
+    char message[1024] = { '\0' };
+    snprintf(message, 1024, _("cannot open the split plan '%s' (%s)"),
+        opt->execute_plan_arg, strerror(errno));
+    return print_run_error(message, data);
   }
 
-  //print out infos about the servers
-  fprintf(console_out,_(" Freedb search type: %s , Site: %s , Port: %d\n"),
-      search_type,opt->freedb_search_server,opt->freedb_search_port);
-  fflush(console_out);
-  fprintf(console_out,_(" Freedb get type: %s , Site: %s , Port: %d\n"),
-      get_type,opt->freedb_get_server,opt->freedb_get_port);
-  fflush(console_out);
+  char *line = my_malloc(sizeof(char) * MP3SPLT_PLAN_LINE_SIZE, data);
+  char *fields[13];
+  int line_number = 0;
+  int number_of_segments = 0;
+  int result = line ? 0 : -1;
 
-  char *freedb_search_string = NULL;
-  char freedb_input[2048] = { '\0' };
-  //if we haven't chosen to search from the arguments, interactive search
-  if (opt->freedb_arg_search_string[0] == '\0')
+  mp3splt_set_int_option(data->state, SPLT_OPT_OUTPUT_FILENAMES,
+      SPLT_OUTPUT_CUSTOM);
+  mp3splt_set_int_option(data->state, SPLT_OPT_SPLIT_MODE,
+      SPLT_OPTION_NORMAL_MODE);
+  mp3splt_set_int_option(data->state, SPLT_OPT_CREATE_DIRS_FROM_FILENAMES,
+      SPLT_FALSE);
+
+  while ((result != -1) && (fgets(line, MP3SPLT_PLAN_LINE_SIZE, plan) != NULL))
   {
-    //freedb search
-    print_message(_("CDDB QUERY. Insert album and"
-          " artist informations to find cd."));
+    line_number++;
 
-    short first_time = SPLT_TRUE;
-    //here we search freedb
-    do {
-      if (!first_time)
-      {
-        print_message(_("\nPlease search something ..."));
-      }
+    size_t length = strlen(line);
+    if ((length == MP3SPLT_PLAN_LINE_SIZE - 1) && (line[length - 1] != '\n'))
+    {
+      char message[1024] = { '\0' };
+      snprintf(message, 1024, _("split plan line %d is too long"), line_number);
+      result = print_run_error(message, data);
+      break;
+    }
 
-      memset(freedb_input, '\0', sizeof(freedb_input));
+    if ((line[0] == '#') || (line[0] == '\n') || (line[0] == '\r') ||
+        (line[0] == '\0'))
+    {
+      continue;
+    }
 
-      fprintf(console_out, "\n\t____________________________________________________________]");
-      fprintf(console_out, _("\r Search: ["));
+    long hundreths = 0;
+    int number_of_fields = split_plan_line(line, fields, 13);
+    if (((number_of_fields != 5) && (number_of_fields != 13)) ||
+        (strcmp(fields[0], "segment") != 0) ||
+        !parse_plan_time(fields[2], &hundreths) ||
+        !parse_plan_time(fields[3], &hundreths) ||
+        (fields[1][0] == '\0') || (fields[4][0] == '\0'))
+    {
+      char message[1024] = { '\0' };
+      snprintf(message, 1024, _("bad split plan line %d"), line_number);
+      result = print_run_error(message, data);
+      break;
+    }
 
-      fgets(freedb_input, 2046, stdin);
+    if (data->cancel_requested)
+    {
+      result = exit_cancelled(data, SPLT_FALSE);
+      break;
+    }
 
-      first_time = SPLT_FALSE;
+    if (find_plugins_once(data) == -1)
+    {
+      result = -1;
+      break;
+    }
 
-      freedb_input[strlen(freedb_input)-1] = '\0';
+    if (opt->P_option)
+    {
+      fprintf(data->console_out,_(" Pretending to split file '%s' ...\n"), fields[1]);
+    }
+    else
+    {
+      fprintf(data->console_out,_(" Processing file '%s' ...\n"), fields[1]);
+    }
+    fflush(data->console_out);
 
-    } while (strlen(freedb_input)==0);
+    result = execute_plan_segment(data, fields, number_of_fields);
+    print_io_statistics(data);
+    number_of_segments++;
+  }
 
-    freedb_search_string = freedb_input;
+  int read_error = ferror(plan);
+  if (plan != stdin)
+  {
+    fclose(plan);
   }
-  else
+  if (result != -1)
   {
-    freedb_search_string = opt->freedb_arg_search_string;
+    flush_m3u_files(data);
   }
+  free(line);
+  line = NULL;
 
-  fprintf(console_out, _("\n  Search string: %s\n"),freedb_search_string);
-  fprintf(console_out, _("\nSearching from %s on port %d using %s ...\n"),
-      opt->freedb_search_server,opt->freedb_search_port, search_type);
-  fflush(console_out);
+  if (result == -1)
+  {
+    return -1;
+  }
+  if (read_error)
+  {
+    return print_run_error(_("cannot read the split plan"), data);
+  }
+  if (number_of_segments == 0)
+  {
+    return print_run_error(_("no segment in the split plan"), data);
+  }
 
-  //the freedb results
-  const splt_freedb_results *f_results = NULL;
-  //we search the freedb
-  f_results = mp3splt_get_freedb_search(state, freedb_search_string,
-      &err, opt->freedb_search_type,
-      opt->freedb_search_server,
-      opt->freedb_search_port);
-  process_confirmation_error(err, data);
+  return 0;
+}
 
-  //if we don't have an auto-select the result X from the arguments:
-  // (query{artist}(resultX)
-  //, then interactive user ask
-  int selected_cd = 0;
-  if (opt->freedb_arg_result_option < 0)
+//finds the audio bytes of a mp3 file, without the ID3v2 tag at the start
+//and the ID3v1 tag at the end; returns -1 if the file cannot be read
+int get_mp3_audio_range(FILE *in, long *begin, long *end)
+{
+  unsigned char header[10];
+  *begin = 0;
+  if ((fseek(in, 0, SEEK_END) != 0) || ((*end = ftell(in)) < 0))
   {
-    //print the searched informations
-    print_message(_("List of found cd:"));
+    return -1;
+  }
 
-    int cd_number = 0;
-    short end = SPLT_FALSE;
-    do {
-      fprintf(console_out,"%3d) %s\n",
-          f_results->results[cd_number].id,
-          f_results->results[cd_number].name);
+  if ((fseek(in, 0, SEEK_SET) == 0) && (fread(header, 1, 10, in) == 10) &&
+      (memcmp(header, "ID3", 3) == 0))
+  {
+    *begin = 10 + get_id3v2_size(header + 6, SPLT_TRUE);
+    if (header[5] & 0x10)
+    {
+      *begin += 10;
+    }
+  }
 
-      int i = 0;
-      for(i = 0; i < f_results->results[cd_number].revision_number; i++)
-      {
-        fprintf(console_out, "  |\\=>");
-        fprintf(console_out, "%3d) ", f_results->results[cd_number].id+i+1);
-        fprintf(console_out, _("Revision: %d\n"), i+2);
+  if ((*end - 128 >= *begin) && (fseek(in, -128, SEEK_END) == 0) &&
+      (fread(header, 1, 3, in) == 3) && (memcmp(header, "TAG", 3) == 0))
+  {
+    *end -= 128;
+  }
 
-        //break at 22
-        if (((f_results->results[cd_number].id+i+2)%22)==0)
-        {
-          //duplicate, see below
-          char junk[18];
-          fprintf(console_out, _("-- 'q' to select cd, Enter for more:"));
-          fflush(console_out);
+  if (*begin > *end)
+  {
+    *begin = *end;
+  }
 
-          fgets(junk, 16, stdin);
-          if (junk[0]=='q')
-          {
-            end = SPLT_TRUE;
-            goto end;
-          }
-        }
-      }
+  return ferror(in) ? -1 : 0;
+}
 
-      //we read result from the char, q tu select cd or
-      //enter to show more results
-      if (((f_results->results[cd_number].id+1)%22)==0)
-      {
-        //duplicate, see ^^
-        char junk[18];
-        fprintf(console_out, _("-- 'q' to select cd, Enter for more: "));
-        fflush(console_out);
+//converts hundredths of seconds to the nearest frame of 1/75 seconds of
+//the cue files and of the cddb disc ids
+long hundredths_to_cue_frames(long hundredths)
+{
+  return (hundredths * 75 + 50) / 100;
+}
 
-        fgets(junk, 16, stdin);
-        if (junk[0]=='q')
+//rewrites a cue file with several FILE entries (one per input file, in
+//order) for --concat: the INDEX times of each FILE are moved by the
+//duration of the files before it; the new cue file is data->concat_cue,
+//left NULL if the cue file has only one FILE entry; returns -1 on error
+int write_concatenated_cue(main_data *data, const char *cue_file)
+{
+  FILE *in = fopen(cue_file, "r");
+  if (!in)
+  {
+    char message[1024] = { '\0' };
+    snprintf(message, 1024, _("cannot open cue file '%s': %s"),
+        cue_file, strerror(errno));
+    return print_run_error(message, data);
+  }
+
+  char line[MP3SPLT_CONCAT_LINE_SIZE] = { '\0' };
+  int number_of_files = 0;
+  while (fgets(line, MP3SPLT_CONCAT_LINE_SIZE, in) != NULL)
+  {
+    const char *keyword = line + strspn(line, " \t");
+    if (strncmp(keyword, "FILE", 4) == 0)
+    {
+      number_of_files++;
+    }
+  }
+
+  if (number_of_files <= 1)
+  {
+    fclose(in);
+    return 0;
+  }
+
+  if (number_of_files != data->number_of_filenames)
+  {
+    char message[1024] = { '\0' };
+    snprintf(message, 1024, _("the cue file '%s' has %d FILE entries"
+          " but %d input files are given with --concat"),
+        cue_file, number_of_files, data->number_of_filenames);
+    fclose(in);
+    return print_run_error(message, data);
+  }
+
+  char *temporary = get_temporary_filename(cue_file);
+  if (!temporary)
+  {
+    fclose(in);
+    return print_run_error(_("cannot allocate memory !"), data);
+  }
+  FILE *out = fopen(temporary, "w");
+  if (!out)
+  {
+    char message[1024] = { '\0' };
+    snprintf(message, 1024, _("cannot write '%s': %s"),
+        temporary, strerror(errno));
+    free(temporary);
+    fclose(in);
+    return print_run_error(message, data);
+  }
+  data->concat_cue = temporary;
+
+  //times of the cue files are in frames of 1/75 seconds; the durations
+  //of the files are added in hundredths of seconds and rounded once to
+  //frames, so that the rounding errors do not add up
+  long offset_hundredths = 0;
+  long offset = 0;
+  int file_index = -1;
+  rewind(in);
+  while (fgets(line, MP3SPLT_CONCAT_LINE_SIZE, in) != NULL)
+  {
+    int indent = strspn(line, " \t");
+    const char *keyword = line + indent;
+    int index = 0, minutes = 0, seconds = 0, frames = 0;
+
+    if (strncmp(keyword, "FILE", 4) == 0)
+    {
+      file_index++;
+      if (file_index > 0)
+      {
+        long duration = get_mp3_duration(data, data->filenames[file_index - 1]);
+        if (duration < 0)
         {
-          end = SPLT_TRUE;
-          goto end;
+          char message[1024] = { '\0' };
+          snprintf(message, 1024, _("cannot read '%s': %s"),
+              data->filenames[file_index - 1], strerror(errno));
+          fclose(in);
+          fclose(out);
+          return print_run_error(message, data);
         }
+        offset_hundredths += duration;
+        offset = hundredths_to_cue_frames(offset_hundredths);
+        continue;
       }
+    }
+    else if ((file_index > 0) &&
+        (sscanf(keyword, "INDEX %d %d:%d:%d", &index, &minutes, &seconds,
+                &frames) == 4))
+    {
+      long time = ((long) minutes * 60 + seconds) * 75 + frames + offset;
+      fprintf(out, "%.*sINDEX %02d %02ld:%02ld:%02ld\n", indent, line,
+          index, time / (60 * 75), (time / 75) % 60, time % 75);
+      continue;
+    }
 
-end:
-      if (end)
-      {
-        end = SPLT_FALSE;
-        break;
-      }
+    fputs(line, out);
+  }
 
-      cd_number++;
-    } while (cd_number < f_results->number);
+  int read_error = ferror(in);
+  fclose(in);
+  if ((fclose(out) != 0) || read_error)
+  {
+    return print_run_error(_("cannot write the cue file for --concat"), data);
+  }
 
-    //select the CD
-    //input of the selected cd
-    char sel_cd_input[1024];
-    int tot = 0;
-    do {
-      selected_cd = 0;
-      fprintf(console_out, _("Select cd #: "));
-      fflush(console_out);
-      fgets(sel_cd_input, 254, stdin);
-      sel_cd_input[strlen(sel_cd_input)-1]='\0';
-      tot = 0;
+  return 0;
+}
 
-      if (sel_cd_input[tot] == '\0') 
+//writes the audio of the input files one after the other to 'fd'; only
+//the ID3v2 tag of the first file is kept and the ID3v1 tags are removed;
+//runs in the child process of --concat
+int write_concatenated_inputs(char **filenames, int number_of_files, int fd)
+{
+  unsigned char buffer[65536];
+  int i = 0;
+
+  for (i = 0; i < number_of_files; i++)
+  {
+    long begin = 0, end = 0;
+    FILE *in = fopen(filenames[i], "rb");
+    if (!in || (get_mp3_audio_range(in, &begin, &end) == -1) ||
+        (fseek(in, (i == 0) ? 0 : begin, SEEK_SET) != 0))
+    {
+      char message[1024] = { '\0' };
+      snprintf(message, 1024, _("cannot read '%s': %s"),
+          filenames[i], strerror(errno));
+      print_error(message);
+      if (in)
       {
-        selected_cd = -1;
+        fclose(in);
       }
+      return -1;
+    }
 
-      while(sel_cd_input[tot] != '\0')
+    long remaining = end - ((i == 0) ? 0 : begin);
+    while (remaining > 0)
+    {
+      size_t wanted = (remaining < 65536) ? remaining : 65536;
+      size_t read_bytes = fread(buffer, 1, wanted, in);
+      if (read_bytes == 0)
       {
-        if (isdigit(sel_cd_input[tot++])==0)
-        {
-          fprintf(console_out, _("Please "));
-          fflush(console_out);
+        break;
+      }
+      remaining -= read_bytes;
 
-          selected_cd = -1;
-          break;
+      size_t written = 0;
+      while (written < read_bytes)
+      {
+        ssize_t result = write(fd, buffer + written, read_bytes - written);
+        if (result < 0)
+        {
+          //the split stopped reading: not an error
+          int write_errno = errno;
+          fclose(in);
+          return (write_errno == EPIPE) ? 0 : -1;
         }
+        written += result;
       }
+    }
 
-      if (selected_cd != -1) 
+    int read_error = ferror(in);
+    fclose(in);
+    if (read_error)
+    {
+      char message[1024] = { '\0' };
+      snprintf(message, 1024, _("cannot read '%s'"), filenames[i]);
+      print_error(message);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+//--concat: the input files are written one after the other to a pipe by
+//a child process and split from the standard input, so that the
+//splitpoints and segments cross the file boundaries without a
+//concatenated copy on the disk; returns -1 on error
+int start_concat(main_data *data)
+{
+#ifdef __WIN32__
+  return print_run_error(_("--concat is not supported on this system"), data);
+#else
+  options *opt = data->opt;
+  int i = 0;
+
+  for (i = 0; i < data->number_of_filenames; i++)
+  {
+    const char *filename = data->filenames[i];
+    if ((strcmp(filename, "-") == 0) || (strcmp(filename, "m-") == 0) ||
+        (strcmp(filename, "o-") == 0))
+    {
+      return print_run_error(_("cannot use the standard input with --concat"),
+          data);
+    }
+  }
+
+  if (opt->c_option && (strncmp(opt->cddb_arg, "discid", 6) != 0) &&
+      (strstr(opt->cddb_arg, ".cue") || strstr(opt->cddb_arg, ".CUE")))
+  {
+    if (write_concatenated_cue(data, opt->cddb_arg) == -1)
+    {
+      return -1;
+    }
+    if (data->concat_cue)
+    {
+      char *cddb_arg = strdup(data->concat_cue);
+      if (!cddb_arg)
       {
-        selected_cd = atoi(sel_cd_input);
+        return print_run_error(_("cannot allocate memory !"), data);
       }
-
-    } while ((selected_cd >= f_results->number) 
-        || (selected_cd < 0));
+      free(opt->cddb_arg);
+      opt->cddb_arg = cddb_arg;
+    }
   }
-  else
+
+  if (!opt->q_option)
   {
-    selected_cd = opt->freedb_arg_result_option;
-    if (selected_cd >= f_results->number)
+    fprintf(data->console_out, _(" Splitting %d files as one stream:\n"),
+        data->number_of_filenames);
+    for (i = 0; i < data->number_of_filenames; i++)
     {
-      selected_cd = 0;
+      fprintf(data->console_out, "  %s\n", data->filenames[i]);
     }
+    fprintf(data->console_out, "\n");
+    fflush(data->console_out);
   }
 
-  fprintf(console_out, _("\nGetting file from %s on port %d using %s ...\n"),
-      opt->freedb_get_server,opt->freedb_get_port, get_type);
-  fflush(console_out);
+  int fds[2];
+  if (pipe(fds) != 0)
+  {
+    char message[1024] = { '\0' };
+    snprintf(message, 1024, _("cannot create a pipe for --concat: %s"),
+        strerror(errno));
+    return print_run_error(message, data);
+  }
 
-  //here we have the selected cd in selected_cd
-  mp3splt_write_freedb_file_result(state, selected_cd,
-      MP3SPLT_CDDBFILE, &err, opt->freedb_get_type,
-      opt->freedb_get_server, opt->freedb_get_port);
-  process_confirmation_error(err, data);
-}
+  fflush(NULL);
+  data->concat_pid = fork();
+  if (data->concat_pid < 0)
+  {
+    char message[1024] = { '\0' };
+    snprintf(message, 1024, _("cannot start the --concat process: %s"),
+        strerror(errno));
+    close(fds[0]);
+    close(fds[1]);
+    data->concat_pid = 0;
+    return print_run_error(message, data);
+  }
 
-//prints a library message
-void put_library_message(const char *message, splt_message_type mess_type)
-{
-  if (mess_type == SPLT_MESSAGE_INFO)
+  if (data->concat_pid == 0)
   {
-    fprintf(console_out,"%s",message);
-    fflush(console_out);
+    //the parent handles the cancel requests: the writer stops when the
+    //pipe is closed
+    signal(SIGINT, SIG_IGN);
+#ifdef SIGTERM
+    signal(SIGTERM, SIG_DFL);
+#endif
+    signal(SIGPIPE, SIG_IGN);
+    close(fds[0]);
+    int result = write_concatenated_inputs(data->filenames,
+        data->number_of_filenames, fds[1]);
+    close(fds[1]);
+    _exit((result == 0) ? 0 : 1);
   }
-  else if (mess_type == SPLT_MESSAGE_DEBUG)
+
+  close(fds[1]);
+  if (dup2(fds[0], STDIN_FILENO) < 0)
+  {
+    close(fds[0]);
+    return print_run_error(_("cannot read the --concat pipe"), data);
+  }
+  close(fds[0]);
+
+  //the input files are now a single stream on the standard input
+  for (i = 0; i < data->number_of_filenames; i++)
   {
-    fprintf(stderr, "%s", message);
-    fflush(stderr);
+    free(data->filenames[i]);
+    data->filenames[i] = NULL;
   }
+  data->number_of_filenames = 0;
+  return append_filename(data, "-");
+#endif
 }
 
-//prints the split file
-void put_split_file(const char *file, int progress_data)
+//waits for the --concat process; the split may not read the whole
+//stream, so the pipe is closed first
+void finish_concat(main_data *data)
 {
-  //we put necessary spaces
-  char temp[1024] = "";
-  int this_spaces = strlen(file)+16;
-  int counter = strlen(file)+16;
-  while (counter <= progress_data)
+#ifndef __WIN32__
+  if (data->concat_pid <= 0)
   {
-    temp[counter-this_spaces] = ' ';
-    counter++;
+    return;
   }
-  temp[counter] = '\0';
 
-  fprintf(console_out,_("   File \"%s\" created%s\n"),file,temp);
-  fflush(console_out);
+  int status = 0;
+  close(STDIN_FILENO);
+  if ((waitpid(data->concat_pid, &status, 0) == data->concat_pid) &&
+      (!WIFEXITED(status) || (WEXITSTATUS(status) != 0)))
+  {
+    print_warning(_("the input files could not all be read with --concat"));
+  }
+  data->concat_pid = 0;
+#endif
 }
 
-//prints the progress bar
-void put_progress_bar(splt_progress *p_bar)
+//reads the track offsets of a cue file in frames (1/75 s); returns the
+//number of tracks, or -1 on error
+int read_cue_track_offsets(main_data *data, const char *cue_file, long *offsets)
 {
-  char progress_text[2048] = " ";
-
-  switch (p_bar->progress_type)
+  char message[1024] = { '\0' };
+  FILE *cue = fopen(cue_file, "r");
+  if (!cue)
   {
-    case SPLT_PROGRESS_PREPARE:
-      snprintf(progress_text,2047,
-          _(" preparing \"%s\" (%d of %d)"),
-          p_bar->filename_shorted,
-          p_bar->current_split,
-          p_bar->max_splits);
-      break;
-    case SPLT_PROGRESS_CREATE:
-      snprintf(progress_text,2047,
-          _(" creating \"%s\" (%d of %d)"),
-          p_bar->filename_shorted,
-          p_bar->current_split,
-          p_bar->max_splits);
-      break;
-    case SPLT_PROGRESS_SEARCH_SYNC:
-      snprintf(progress_text,2047,
-          _(" searching for sync errors..."));
-      break;
-    case SPLT_PROGRESS_SCAN_SILENCE:
-      snprintf(progress_text,2047,
-          _("S: %02d, Level: %.2f dB; scanning for silence..."),
-          p_bar->silence_found_tracks, p_bar->silence_db_level);
-      break;
-    default:
-      snprintf(progress_text,2047, " ");
-      break;
+    snprintf(message, 1024, _("cannot open '%s': %s"), cue_file, strerror(errno));
+    return print_run_error(message, data);
   }
 
-  char printed_value[2048] = "";
-  //we update the progress
-  if (p_bar->percent_progress <= 0.01)
+  char line[MP3SPLT_CONCAT_LINE_SIZE] = { '\0' };
+  int number_of_tracks = 0;
+  int number_of_files = 0;
+  while (fgets(line, MP3SPLT_CONCAT_LINE_SIZE, cue))
   {
-    snprintf(printed_value,2047," [ - %%] %s", progress_text);
+    char *command = line;
+    while (isspace((unsigned char) *command))
+    {
+      command++;
+    }
+
+    int minutes = 0, seconds = 0, frames = 0;
+    if (strncmp(command, "FILE ", 5) == 0)
+    {
+      number_of_files++;
+    }
+    else if (strncmp(command, "TRACK ", 6) == 0)
+    {
+      if (number_of_tracks >= MP3SPLT_CDDB_MAX_TRACKS)
+      {
+        break;
+      }
+      offsets[number_of_tracks++] = -1;
+    }
+    else if ((number_of_tracks > 0) &&
+        (sscanf(command, "INDEX 01 %d:%d:%d", &minutes, &seconds, &frames) == 3))
+    {
+      offsets[number_of_tracks - 1] = (minutes * 60 + seconds) * 75 + frames;
+    }
   }
-  else
+  fclose(cue);
+
+  int i = 0;
+  for (i = 0; i < number_of_tracks; i++)
   {
-    snprintf(printed_value,2047," [ %.2f %%] %s",
-        p_bar->percent_progress * 100, progress_text);
+    if (offsets[i] < 0)
+    {
+      number_of_tracks = 0;
+    }
   }
-
-  //we put necessary spaces
-  char temp[2048] = "";
-  int this_spaces = strlen(printed_value);
-  int counter = strlen(printed_value);
-  while (counter <= p_bar->user_data)
+  if ((number_of_tracks == 0) || (number_of_files > 1))
   {
-    temp[counter-this_spaces] = ' ';
-    counter++;
+    snprintf(message, 1024, _("cannot compute the disc id from '%s': it needs"
+          " one FILE and an INDEX 01 for each track"), cue_file);
+    return print_run_error(message, data);
   }
-  temp[counter] = '\0';
-
-  fprintf(console_progress,"%s%s\r",printed_value,temp);
-  fflush(console_progress);
 
-  p_bar->user_data = strlen(printed_value)+1;
+  return number_of_tracks;
 }
 
-//handler for the SIGINT signal
-void sigint_handler(int sig)
+//computes the cddb disc id, the track offsets ('query' gets the
+//'discid ntracks offsets... seconds' arguments of 'cddb query') from the
+//cue file or the track durations of -c discid{...}; returns -1 on error
+int compute_cddb_disc_id(main_data *data, const char *filename,
+    char *query, int query_size)
 {
-  mp3splt_stop_split(state, NULL);
-  exit(1);
-}
+  const char *source = data->opt->freedb_arg_search_string;
+  long offsets[MP3SPLT_CDDB_MAX_TRACKS + 1];
+  int number_of_tracks = 0;
+  char message[1024] = { '\0' };
 
-//returns the options
-options *new_options(main_data *data)
-{
-  options *opt = my_malloc(sizeof(options), data);
+  const char *extension = strrchr(source, '.');
+  if (extension && (strcasecmp(extension, ".cue") == 0))
+  {
+    number_of_tracks = read_cue_track_offsets(data, source, offsets);
+    if (number_of_tracks == -1)
+    {
+      return -1;
+    }
+    //the end of the last track is the end of the input file
+    long duration = get_mp3_duration(data, filename);
+    if (duration <= 0)
+    {
+      snprintf(message, 1024, _("cannot compute the length of '%s' for the"
+            " disc id: give the track durations instead of the cue file"), filename);
+      return print_run_error(message, data);
+    }
+    offsets[number_of_tracks] = hundredths_to_cue_frames(duration);
+    if (offsets[number_of_tracks] <= offsets[number_of_tracks - 1])
+    {
+      //two paths may not fit in 'message'
+      int malloc_size = strlen(filename) + strlen(source) + 256;
+      char *shorter = my_malloc(sizeof(char) * malloc_size, data);
+      if (!shorter)
+      {
+        return -1;
+      }
+      snprintf(shorter, malloc_size,
+          _("'%s' is shorter than the tracks of '%s'"), filename, source);
+      print_run_error(shorter, data);
+      free(shorter);
+      return -1;
+    }
+  }
+  else
+  {
+    //durations separated by commas, in the time format of the splitpoints
+    char *durations = strdup(source);
+    if (!durations)
+    {
+      return print_run_error(_("cannot allocate memory !"), data);
+    }
+    //the durations are added in hundredths of seconds and each offset is
+    //rounded once to frames
+    long offset = 0;
+    char *duration = strtok(durations, ",");
+    while (duration && (number_of_tracks < MP3SPLT_CDDB_MAX_TRACKS))
+    {
+      while (isspace((unsigned char) *duration))
+      {
+        duration++;
+      }
+      long hundredths = c_hundreths(duration);
+      if ((hundredths <= 0) || (hundredths == LONG_MAX))
+      {
+        snprintf(message, 1024, _("bad track duration for the disc id: '%s'"),
+            duration);
+        free(durations);
+        return print_run_error(message, data);
+      }
+      offsets[number_of_tracks++] = hundredths_to_cue_frames(offset);
+      offset += hundredths;
+      duration = strtok(NULL, ",");
+    }
+    free(durations);
+    offsets[number_of_tracks] = hundredths_to_cue_frames(offset);
 
-  opt->T_option = SPLT_FALSE;
-  opt->T_option_value = 0;
-  opt->w_option = SPLT_FALSE; opt->l_option = SPLT_FALSE;
-  opt->e_option = SPLT_FALSE; opt->f_option = SPLT_FALSE;
-  opt->c_option = SPLT_FALSE; opt->t_option = SPLT_FALSE;
-  opt->s_option = SPLT_FALSE; opt->a_option = SPLT_FALSE;
-  opt->p_option = SPLT_FALSE; opt->o_option = SPLT_FALSE;
-  opt->d_option = SPLT_FALSE; opt->k_option = SPLT_FALSE;
-  opt->g_option = SPLT_FALSE; opt->n_option = SPLT_FALSE;
-  opt->q_option = SPLT_FALSE; opt->i_option = SPLT_FALSE;
-  opt->N_option = SPLT_FALSE; opt->O_option = SPLT_FALSE;
-  opt->E_option = SPLT_FALSE;
-  opt->P_option = SPLT_FALSE;
-  opt->x_option = SPLT_FALSE;
-  opt->X_option = SPLT_FALSE;
-  opt->qq_option = SPLT_FALSE;
-  opt->A_option = SPLT_FALSE;
-  opt->m_option = SPLT_FALSE;
-  opt->S_option = SPLT_FALSE;
-  opt->S_option_value = 0;
-  opt->cddb_arg = NULL; opt->dir_arg = NULL;
-  opt->export_cue_arg = NULL;
-  opt->audacity_labels_arg = NULL;
-  opt->param_args = NULL;
-  opt->m3u_arg = NULL;
-  opt->output_format = NULL;
+    if (number_of_tracks == 0)
+    {
+      return print_run_error(_("the disc id needs a cue file or the track"
+            " durations: discid{file.cue} or discid{4.05,3.20,...}"), data);
+    }
+  }
 
-  opt->custom_tags = NULL;
+  //the first track starts after the 2 seconds lead-in
+  unsigned long digits_sum = 0;
+  int i = 0;
+  for (i = 0; i <= number_of_tracks; i++)
+  {
+    offsets[i] += MP3SPLT_CDDB_LEAD_IN;
+  }
+  for (i = 0; i < number_of_tracks; i++)
+  {
+    long seconds = offsets[i] / 75;
+    while (seconds > 0)
+    {
+      digits_sum += seconds % 10;
+      seconds /= 10;
+    }
+  }
+  long total_seconds = offsets[number_of_tracks] / 75 - offsets[0] / 75;
+  unsigned long disc_id = ((digits_sum % 0xff) << 24) |
+    ((unsigned long) total_seconds << 8) | number_of_tracks;
 
-  //we put the default values for freedb search
-  //by default, CDDB_CGI (cddb.cgi) port 80 on freedb2.org
-  opt->freedb_search_type = SPLT_FREEDB_SEARCH_TYPE_CDDB_CGI;
-  snprintf(opt->freedb_search_server,255, "%s", SPLT_FREEDB2_CGI_SITE);
-  opt->freedb_search_port = SPLT_FREEDB_CDDB_CGI_PORT;
-  //we put the default values for the freedb cddb file get
-  //by default, CDDB_CGI (cddb.cgi) port 80 on freedb2.org
-  opt->freedb_get_type = SPLT_FREEDB_GET_FILE_TYPE_CDDB_CGI;
-  snprintf(opt->freedb_get_server,255, "%s", SPLT_FREEDB2_CGI_SITE);
-  opt->freedb_get_port = SPLT_FREEDB_CDDB_CGI_PORT;
+  int length = snprintf(query, query_size, "%08lx %d", disc_id, number_of_tracks);
+  for (i = 0; (i < number_of_tracks) && (length < query_size); i++)
+  {
+    length += snprintf(query + length, query_size - length, " %ld", offsets[i]);
+  }
+  if (length < query_size)
+  {
+    snprintf(query + length, query_size - length, " %ld",
+        offsets[number_of_tracks] / 75);
+  }
 
-  opt->freedb_arg_search_string[0] = '\0';
-  opt->freedb_arg_result_option = -1;
+  fprintf(data->console_out, _(" Disc id: %08lx (%d tracks, %ld seconds)\n"),
+      disc_id, number_of_tracks, total_seconds);
+  fflush(data->console_out);
 
-  return opt;
+  return 0;
 }
 
-void print_version(FILE *std)
+#ifndef __WIN32__
+//connects to the cddb server; returns the socket, or -1 on error
+int connect_cddb_server(main_data *data, cddb_connection *connection)
 {
-  char version[128] = { '\0' };
-  mp3splt_get_version(version);
-  fprintf(std, PACKAGE_NAME" "VERSION" ("MP3SPLT_DATE") -"
-      " %s libmp3splt %s\n",_("using"),version);
-  fflush(std);
-}
+  char message[1024] = { '\0' };
+  char port[16] = { '\0' };
+  snprintf(port, 16, "%d", connection->port);
+
+  struct addrinfo hints, *addresses = NULL, *address = NULL;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  int error = getaddrinfo(connection->host, port, &hints, &addresses);
+  if (error != 0)
+  {
+    snprintf(message, 1024, _("cannot find the cddb server '%s' (%s)"),
+        connection->host, gai_strerror(error));
+    return print_run_error(message, data);
+  }
+
+  int fd = -1;
+  for (address = addresses; address && (fd < 0); address = address->ai_next)
+  {
+    fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    if ((fd >= 0) && (connect(fd, address->ai_addr, address->ai_addrlen) != 0))
+    {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(addresses);
+  if (fd < 0)
+  {
+    snprintf(message, 1024, _("cannot connect to the cddb server '%s:%d' (%s)"),
+        connection->host, connection->port, strerror(errno));
+    return print_run_error(message, data);
+  }
 
-void print_authors(FILE *std)
-{
-  fprintf(std, "\t"MP3SPLT_AUTHOR1" "MP3SPLT_EMAIL1"\n\t"MP3SPLT_AUTHOR2" "MP3SPLT_EMAIL2"\n");
-  fflush(std);
-}
+  struct timeval timeout;
+  timeout.tv_sec = MP3SPLT_CDDB_TIMEOUT;
+  timeout.tv_usec = 0;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
 
-void print_no_warranty(FILE *std)
-{
-  fprintf(std, _("THIS SOFTWARE COMES WITH ABSOLUTELY NO WARRANTY!"
-        " USE AT YOUR OWN RISK!\n"));
-  fflush(std);
+  return fd;
 }
 
-//output package, version and authors
-void print_version_authors(FILE *std)
+//reads a line from the server without its end of line; returns
+//SPLT_FALSE at the end of the connection
+int read_cddb_line(int fd, char *line, int size)
 {
-  print_version(std);
-  print_authors(std);
-  print_no_warranty(std);
+  int length = 0;
+  char c = '\0';
+  ssize_t result = 0;
+  while ((result = recv(fd, &c, 1, 0)) == 1)
+  {
+    if (c == '\n')
+    {
+      break;
+    }
+    if ((c != '\r') && (length < size - 1))
+    {
+      line[length++] = c;
+    }
+  }
+  line[length] = '\0';
+
+  return (result == 1) || (length > 0);
 }
 
-void get_silence_level(long time, float level, void *user_data)
+//sends a cddb command (a cddb_cgi request or a cddb_protocol line) and
+//reads the response: the status line in 'status' and, for the responses
+//followed by lines (21x), the first line in 'first' and all of them in
+//'out'; returns the status code, or -1 on error
+int send_cddb_command(main_data *data, cddb_connection *connection,
+    const char *command, char *status, char *first, FILE *out)
 {
-  silence_level *sl = user_data;
-  if (level == INT_MIN)
+  char message[1024] = { '\0' };
+  char request[MP3SPLT_CDDB_LINE_SIZE] = { '\0' };
+  char line[MP3SPLT_CDDB_LINE_SIZE] = { '\0' };
+
+  if (connection->http)
   {
-    sl->print_silence_level = SPLT_FALSE;
+    connection->fd = connect_cddb_server(data, connection);
+    if (connection->fd < 0)
+    {
+      return -1;
+    }
+    int length = snprintf(request, MP3SPLT_CDDB_LINE_SIZE, "GET /%s?cmd=",
+        connection->path);
+    const char *c = command;
+    for (; *c && (length < MP3SPLT_CDDB_LINE_SIZE - 1); c++)
+    {
+      request[length++] = (*c == ' ') ? '+' : *c;
+    }
+    snprintf(request + length, MP3SPLT_CDDB_LINE_SIZE - length,
+        "&hello=mp3splt+localhost+mp3splt+"VERSION"&proto=6 HTTP/1.0\r\n"
+        "Host: %s\r\nUser-Agent: mp3splt/"VERSION"\r\n\r\n", connection->host);
   }
-  else if (level == INT_MAX)
+  else
   {
-    sl->print_silence_level = SPLT_TRUE;
+    snprintf(request, MP3SPLT_CDDB_LINE_SIZE, "%s\r\n", command);
   }
-  else
+
+  size_t sent = 0;
+  size_t length = strlen(request);
+  while (sent < length)
   {
-    sl->level_sum += level;
-    sl->number_of_levels++;
+    ssize_t result = send(connection->fd, request + sent, length - sent, 0);
+    if (result <= 0)
+    {
+      snprintf(message, 1024, _("cannot send to the cddb server '%s' (%s)"),
+          connection->host, strerror(errno));
+      return print_run_error(message, data);
+    }
+    sent += result;
   }
-}
 
-void append_filename(main_data *data, const char *str)
-{
-  if (data)
+  //the http headers
+  if (connection->http)
   {
-    if (!data->filenames)
+    int http_status = 0;
+    if (!read_cddb_line(connection->fd, line, MP3SPLT_CDDB_LINE_SIZE) ||
+        (sscanf(line, "HTTP/%*s %d", &http_status) != 1) || (http_status != 200))
     {
-      data->filenames = my_malloc(sizeof(char *), data);
+      snprintf(message, 1024, _("bad answer from the cddb server '%s': %s"),
+          connection->host, line);
+      return print_run_error(message, data);
     }
-    else
+    while (read_cddb_line(connection->fd, line, MP3SPLT_CDDB_LINE_SIZE) &&
+        (line[0] != '\0'))
     {
-      data->filenames = my_realloc(data->filenames, sizeof(char *) *
-          (data->number_of_filenames + 1), data);
     }
-    data->filenames[data->number_of_filenames] = NULL;
-    if (str != NULL)
+  }
+
+  status[0] = '\0';
+  read_cddb_line(connection->fd, status, MP3SPLT_CDDB_LINE_SIZE);
+  int code = atoi(status);
+  if ((code >= 210) && (code < 220))
+  {
+    int first_line = SPLT_TRUE;
+    while (read_cddb_line(connection->fd, line, MP3SPLT_CDDB_LINE_SIZE) &&
+        (strcmp(line, ".") != 0))
     {
-      int malloc_size = strlen(str) + 1;
-      data->filenames[data->number_of_filenames] = my_malloc(sizeof(char) * 
-          malloc_size, data);
-      snprintf(data->filenames[data->number_of_filenames],malloc_size, "%s",str);
-      data->number_of_filenames++;
+      if (first && first_line)
+      {
+        snprintf(first, MP3SPLT_CDDB_LINE_SIZE, "%s", line);
+      }
+      first_line = SPLT_FALSE;
+      if (out)
+      {
+        fprintf(out, "%s\n", line);
+      }
     }
   }
+
+  if (connection->http)
+  {
+    close(connection->fd);
+    connection->fd = -1;
+  }
+
+  return code;
 }
+#endif
 
-//returns -1 if not enough memory
-void append_splitpoint(main_data *data, long value)
+//-c discid{file.cue} or discid{durations}: computes the disc id and
+//gets the xmcd file of this disc id from the get server of
+//discid[get=...], with one 'cddb query' and one 'cddb read' instead of
+//a text search and a choice. With the local type, the disc id is looked
+//up in the local index; returns -1 on error
+int do_disc_id_lookup(main_data *data, const char *filename)
 {
-  if (data)
+  options *opt = data->opt;
+  char message[1024] = { '\0' };
+  char query[MP3SPLT_CDDB_LINE_SIZE] = { '\0' };
+  if (compute_cddb_disc_id(data, filename, query, MP3SPLT_CDDB_LINE_SIZE) == -1)
+  {
+    return -1;
+  }
+
+  if (opt->freedb_get_type == MP3SPLT_LOCAL_CDDB_TYPE)
   {
-    if (!data->splitpoints)
+    char disc_id[9] = { '\0' };
+    snprintf(disc_id, 9, "%s", query);
+    fprintf(data->console_out, _(" Looking up the disc id in %s ...\n"),
+        opt->freedb_get_server);
+    fflush(data->console_out);
+    if (search_local_cddb(data, opt->freedb_get_server, disc_id) == -1)
     {
-      data->splitpoints = my_malloc(sizeof(long), data);
+      return -1;
     }
-    else
+    if (data->local_cddb->results.number > 1)
     {
-      data->splitpoints = my_realloc(data->splitpoints,
-          sizeof(long) * (data->number_of_splitpoints + 1), data);
+      snprintf(message, 1024, _("%d cds have this disc id, using the first one"),
+          data->local_cddb->results.number);
+      print_warning(message);
     }
-    data->splitpoints[data->number_of_splitpoints] = value;
-    data->number_of_splitpoints++;
+    if (get_local_cddb_file(data, 0, data->cddb_file) == -1)
+    {
+      return -1;
+    }
+    fprintf(data->console_out, _(" Found %s\n"), data->local_cddb->results.results[0].name);
+    fflush(data->console_out);
+    return 0;
+  }
+
+#ifdef __WIN32__
+  return print_run_error(_("the disc id lookup only supports the local type"
+        " on this system"), data);
+#else
+  cddb_connection connection;
+  memset(&connection, 0, sizeof(connection));
+  connection.http = (opt->freedb_get_type == SPLT_FREEDB_GET_FILE_TYPE_CDDB_CGI);
+  connection.port = opt->freedb_get_port;
+  connection.fd = -1;
+  //host/path of cddb_cgi
+  const char *path = strchr(opt->freedb_get_server, '/');
+  int host_length = path ? (int) (path - opt->freedb_get_server)
+    : (int) strlen(opt->freedb_get_server);
+  snprintf(connection.host, 256, "%.*s", host_length, opt->freedb_get_server);
+  snprintf(connection.path, 256, "%s", path ? path + 1 : "");
+
+  fprintf(data->console_out, _(" Looking up the disc id on %s port %d ...\n"),
+      connection.host, connection.port);
+  fflush(data->console_out);
+
+  char status[MP3SPLT_CDDB_LINE_SIZE] = { '\0' };
+  char first[MP3SPLT_CDDB_LINE_SIZE] = { '\0' };
+  char command[MP3SPLT_CDDB_LINE_SIZE] = { '\0' };
+  if (!connection.http)
+  {
+    connection.fd = connect_cddb_server(data, &connection);
+    if (connection.fd < 0)
+    {
+      return -1;
+    }
+    //the greeting, then the handshake
+    read_cddb_line(connection.fd, status, MP3SPLT_CDDB_LINE_SIZE);
+    if ((atoi(status) != 200) && (atoi(status) != 201))
+    {
+      snprintf(message, 1024, _("bad answer from the cddb server '%s': %s"),
+          connection.host, status);
+      close(connection.fd);
+      return print_run_error(message, data);
+    }
+    if ((send_cddb_command(data, &connection,
+            "cddb hello mp3splt localhost mp3splt "VERSION, status,
+            NULL, NULL) == -1) ||
+        (send_cddb_command(data, &connection, "proto 6", status,
+                           NULL, NULL) == -1))
+    {
+      close(connection.fd);
+      return -1;
+    }
+  }
+
+  snprintf(command, MP3SPLT_CDDB_LINE_SIZE, "cddb query %s", query);
+  int code = send_cddb_command(data, &connection, command, status, first, NULL);
+  if (code == -1)
+  {
+    if (connection.fd >= 0)
+    {
+      close(connection.fd);
+    }
+    return -1;
+  }
+  //200: category, disc id, title in the status line; 210 and 211: one
+  //cd per line
+  const char *found = (code == 200) ? status + 4 : first;
+  char category[256] = { '\0' };
+  char found_id[256] = { '\0' };
+  if (((code != 200) && (code != 210) && (code != 211)) ||
+      (sscanf(found, "%255s %255s", category, found_id) != 2))
+  {
+    if (connection.fd >= 0)
+    {
+      close(connection.fd);
+    }
+    snprintf(message, 1024, _("no cd found for this disc id (%s)"), status);
+    return print_run_error(message, data);
+  }
+  if (code == 211)
+  {
+    print_warning(_("no exact match for this disc id, using the first"
+          " inexact match"));
+  }
+  fprintf(data->console_out, _(" Found %s\n"), found);
+  fflush(data->console_out);
+
+  char *temporary = NULL;
+  FILE *out = open_atomic_file(data->cddb_file, "w", &temporary);
+  if (!out)
+  {
+    snprintf(message, 1024, _("cannot write '%s' (%s)"), data->cddb_file,
+        strerror(errno));
+    if (connection.fd >= 0)
+    {
+      close(connection.fd);
+    }
+    return print_run_error(message, data);
+  }
+  snprintf(command, MP3SPLT_CDDB_LINE_SIZE, "cddb read %s %s", category, found_id);
+  code = send_cddb_command(data, &connection, command, status, NULL, out);
+  if (!connection.http)
+  {
+    if ((code != -1) &&
+        (send_cddb_command(data, &connection, "quit", status, NULL, NULL) == -1))
+    {
+      code = -1;
+    }
+    close(connection.fd);
+  }
+  if (code == -1)
+  {
+    discard_atomic_file(out, temporary);
+    return -1;
+  }
+  if (code != 210)
+  {
+    discard_atomic_file(out, temporary);
+    snprintf(message, 1024, _("cannot read the cd from the cddb server (%s)"),
+        status);
+    return print_run_error(message, data);
+  }
+  if (close_atomic_file(out, temporary, data->cddb_file) == -1)
+  {
+    snprintf(message, 1024, _("cannot write '%s' (%s)"), data->cddb_file,
+        strerror(errno));
+    return print_run_error(message, data);
   }
+
+  return 0;
+#endif
 }
 
 #ifdef __WIN32__
@@ -1691,16 +10828,20 @@ char **win32_get_utf8_args(main_data *data)
       argv_utf8 = NULL;
     }
 
-    print_error_exit(_("CommandLineToArgvW failed (oh !)"), data);
+    print_error(_("CommandLineToArgvW failed (oh !)"));
+    return NULL;
   }
-  else
+  else if (argv_utf8)
   {
+    memset(argv_utf8, 0, sizeof(char *) * data->argc);
     for (i=0; i<nArgs; i++)
     {
       argv_utf8[i] = mp3splt_win32_utf16_to_utf8((wchar_t *)argv_utf16[i]);
       if (argv_utf8[i] == NULL)
       {
-        print_error_exit(_("failed to allocate argv_utf8 memory"), data);
+        //freed with the other arguments by free_main_struct
+        print_error(_("failed to allocate argv_utf8 memory"));
+        break;
       }
     }
 
@@ -1712,30 +10853,126 @@ char **win32_get_utf8_args(main_data *data)
 }
 #endif
 
+//returns NULL on error
 main_data *create_main_struct(int argc, char **orig_argv)
 {
   main_data *data = NULL;
   data = my_malloc(sizeof(main_data), data);
+  if (!data)
+  {
+    return NULL;
+  }
+  memset(data, 0, sizeof(main_data));
 
   data->state = NULL;
+  data->dir_cache = NULL;
+  data->io = NULL;
+  data->cache = NULL;
+  data->concat_pid = 0;
+  data->concat_cue = NULL;
+  data->adjust_window = NULL;
+  data->callback_error[0] = '\0';
+  data->exit_status = 0;
+  data->console_out = stdout;
+  data->console_err = stderr;
+  data->console_progress = stderr;
+  data->standard_sinks = SPLT_FALSE;
+  data->console_null = NULL;
+  data->cancel_requested = 0;
+  data->duplicates = NULL;
+  data->number_of_duplicates = 0;
+  data->original_argv = NULL;
+  data->number_of_original_args = 0;
+  data->watch_arguments = NULL;
+  data->number_of_watch_arguments = 0;
+  data->sp_cache = NULL;
+  //the startup is traced before the options are parsed
+  data->trace = calloc(1, sizeof(trace_buffer));
+  data->local_cddb = NULL;
   //alloc options
   data->opt = new_options(data);
   //alloc silence level
-  data->sl = my_malloc(sizeof(silence_level), data);
+  data->sl = calloc(1, sizeof(silence_level));
+  //alloc the cache of the created directories
+  data->dir_cache = calloc(1, sizeof(directory_cache));
+  //alloc the I/O limiter
+  data->io = calloc(1, sizeof(io_limiter));
+  //alloc the page cache hints
+  data->cache = calloc(1, sizeof(cache_hints));
+  if (data->cache)
+  {
+    data->cache->fd = -1;
+  }
+  //alloc the cache of the splitpoints from -c or -A
+  data->sp_cache = calloc(1, sizeof(splitpoints_cache));
+  //the files in the working directory
+  data->silence_log_file = strdup(MP3SPLT_SILENCE_LOGFILE);
+  data->cancel_log_file = strdup(MP3SPLT_CANCEL_LOGFILE);
+  data->cddb_file = strdup(MP3SPLT_CDDBFILE);
+  if (!data->trace || !data->opt || !data->sl || !data->dir_cache ||
+      !data->io || !data->cache || !data->sp_cache ||
+      !data->silence_log_file || !data->cancel_log_file || !data->cddb_file)
+  {
+    print_error(_("cannot allocate memory !"));
+    free_main_struct(&data);
+    return NULL;
+  }
 
   data->filenames = NULL;
   data->number_of_filenames = 0;
   data->splitpoints = NULL;
   data->number_of_splitpoints = 0;
+  data->splitpoints_capacity = 0;
+  data->split_files = NULL;
+  data->number_of_split_files = 0;
+  data->current_file_index = 0;
+  data->split_cancelled = SPLT_FALSE;
+  data->interrupted_file[0] = '\0';
+  data->show_progress = SPLT_FALSE;
+  data->plugins_found = SPLT_FALSE;
+  data->plan = NULL;
+  data->plan_temporary = NULL;
+  data->m3u_files = NULL;
+  data->number_of_m3u_files = 0;
+  data->silence_log_temporary = NULL;
+  data->manifest = NULL;
+  data->number_of_manifest_entries = 0;
+  data->first_manifest_entry = 0;
+  data->manifest_capacity = 0;
 
   data->sl->level_sum = 0;
   data->sl->number_of_levels = 0;
   data->sl->print_silence_level = SPLT_TRUE;
+  data->sl->keep_levels = SPLT_FALSE;
+  data->sl->blocks = NULL;
+  data->sl->number_of_blocks = 0;
+  data->sl->blocks_capacity = 0;
+  data->sl->keep_peaks = SPLT_FALSE;
+  data->sl->peaks = NULL;
+  data->sl->number_of_peaks = 0;
+  data->sl->peaks_capacity = 0;
+  data->sl->sample_rate = MP3SPLT_WAVEFORM_SAMPLE_RATE;
+  data->sl->samples_per_pixel = MP3SPLT_WAVEFORM_SAMPLES_PER_PIXEL;
+  data->sl->requested_samples_per_pixel = 0;
 
   data->argc = argc;
 #ifdef __WIN32__
   data->argv = NULL;
   data->argv = win32_get_utf8_args(data);
+  if (!data->argv)
+  {
+    free_main_struct(&data);
+    return NULL;
+  }
+  int i = 0;
+  for (i = 0; i < argc; i++)
+  {
+    if (!data->argv[i])
+    {
+      free_main_struct(&data);
+      return NULL;
+    }
+  }
 #else
   data->argv = orig_argv;
 #endif
@@ -1743,7 +10980,8 @@ main_data *create_main_struct(int argc, char **orig_argv)
   return data;
 }
 
-void show_files_and_ask_for_confirmation(main_data *data)
+//returns -1 if the split is aborted
+int show_files_and_ask_for_confirmation(main_data *data)
 {
   int j = 0;
 
@@ -1752,78 +10990,501 @@ void show_files_and_ask_for_confirmation(main_data *data)
 
   for (j = 0;j < data->number_of_filenames; j++)
   {
-    fprintf(console_out, "  %s\n", data->filenames[j]);
+    fprintf(data->console_out, "  %s\n", data->filenames[j]);
 
     if (((j+1) % 22 == 0) && (j+1 < data->number_of_filenames))
     {
-      fprintf(console_out, _("\n-- 'Enter' for more, 's' to split, 'c' to cancel:"));
-      fflush(console_out);
+      fprintf(data->console_out, _("\n-- 'Enter' for more, 's' to split, 'c' to cancel:"));
+      fflush(data->console_out);
 
       fgets(junk, 16, stdin);
 
       if (junk[1] == '\n')
       {
-        if (junk[0] == 'c')
+        if (junk[0] == 'c')
+        {
+          return print_run_message(_("\n split aborted."), data);
+        }
+        if (junk[0] == 's')
+        {
+          goto split;
+        }
+      }
+
+      print_message("\n");
+    }
+  }
+
+  int answer_is_correct = SPLT_FALSE;
+  do {
+    fprintf(data->console_out, _("\n-- 's' to split, 'c' to cancel:"));
+    fflush(data->console_out);
+
+    fgets(junk, 16, stdin);
+
+    if (junk[1] == '\n')
+    {
+      if (junk[0] == 'c')
+      {
+        return print_run_message(_("\n split aborted."), data);
+      }
+      if (junk[0] == 's')
+      {
+        answer_is_correct = SPLT_TRUE;
+      }
+    }
+
+  } while (!answer_is_correct);
+
+  fprintf(data->console_out, "\n");
+  fflush(data->console_out);
+
+split:
+  return 0;
+}
+
+//sets the option 'option' of the command line, with its argument in
+//'optarg'; returns -1 when the run must stop
+int parse_option(main_data *data, int option)
+{
+  splt_state *state = data->state;
+  options *opt = data->opt;
+
+  switch (option)
+  {
+    case 'x':
+      mp3splt_set_int_option(state, SPLT_OPT_XING, SPLT_FALSE);
+      break;
+    case 'h':
+      return show_small_help(data);
+    //deprecated: use -T
+    case '1':
+      mp3splt_set_int_option(state, SPLT_OPT_FORCE_TAGS_VERSION, 1);
+      opt->T_option_value = 1;
+      opt->T_option = SPLT_TRUE;
+      break;
+    //deprecated: use -T
+    case '2':
+      mp3splt_set_int_option(state, SPLT_OPT_FORCE_TAGS_VERSION, 2);
+      opt->T_option_value = 2;
+      opt->T_option = SPLT_TRUE;
+      break;
+    case 'T':
+      opt->T_option_value = atoi(optarg);
+      mp3splt_set_int_option(state, SPLT_OPT_FORCE_TAGS_VERSION,
+          opt->T_option_value);
+      opt->T_option = SPLT_TRUE;
+      break;
+    case 'D':
+      mp3splt_set_int_option(state, SPLT_OPT_DEBUG_MODE, SPLT_TRUE);
+      break;
+    case 'v':
+      print_version(data->console_out); 
+      print_authors(data->console_out);
+      return stop_run(data, 0);
+    case 'f':
+      mp3splt_set_int_option(state, SPLT_OPT_FRAME_MODE, SPLT_TRUE);
+      opt->f_option = SPLT_TRUE;
+      break;
+    case 'k':
+      mp3splt_set_int_option(state, SPLT_OPT_INPUT_NOT_SEEKABLE, SPLT_TRUE);
+      opt->k_option = SPLT_TRUE;
+      break;
+    case 'w':
+      mp3splt_set_int_option(state, SPLT_OPT_SPLIT_MODE, SPLT_OPTION_WRAP_MODE);
+      opt->w_option = SPLT_TRUE;
+      break;
+    case 'l':
+      opt->l_option = SPLT_TRUE;
+      data->console_out = data->console_err;
+      break;
+    case 'e':
+      mp3splt_set_int_option(state, SPLT_OPT_SPLIT_MODE, SPLT_OPTION_ERROR_MODE);
+      opt->e_option = SPLT_TRUE;
+      break;
+    case 'q':
+      opt->q_option = SPLT_TRUE;
+      mp3splt_set_int_option(state, SPLT_OPT_QUIET_MODE, SPLT_TRUE);
+      break;
+    case 'n':
+      opt->n_option = SPLT_TRUE;
+      break;
+    case 'a':
+      mp3splt_set_int_option(state, SPLT_OPT_AUTO_ADJUST, SPLT_TRUE);
+      opt->a_option = SPLT_TRUE;
+      break;
+    case 's':
+      mp3splt_set_int_option(state, SPLT_OPT_SPLIT_MODE, SPLT_OPTION_SILENCE_MODE);
+      opt->s_option = SPLT_TRUE;
+      break;
+    case 'i':
+      mp3splt_set_int_option(state, SPLT_OPT_SPLIT_MODE, SPLT_OPTION_SILENCE_MODE);
+      opt->i_option = SPLT_TRUE;
+      break;
+    case 'c':
+      mp3splt_set_int_option(state, SPLT_OPT_TAGS, SPLT_CURRENT_TAGS);
+      opt->c_option = SPLT_TRUE;
+      opt->cddb_arg = strdup(optarg);
+      break;
+    case 'P':
+      opt->P_option = SPLT_TRUE;
+      mp3splt_set_int_option(state, SPLT_OPT_PRETEND_TO_SPLIT, SPLT_TRUE);
+      break;
+    case 'E':
+      opt->export_cue_arg = strdup(optarg);
+      opt->E_option = SPLT_TRUE;
+      break;
+    case 'A':
+      opt->A_option = SPLT_TRUE;
+      opt->audacity_labels_arg = strdup(optarg);
+      break;
+    case 'm':
+      opt->m_option = SPLT_TRUE;
+      opt->m3u_arg = strdup(optarg);
+      break;
+    case 'S':
+      opt->S_option = SPLT_TRUE;
+      opt->S_option_value = atoi(optarg);
+      mp3splt_set_int_option(state, SPLT_OPT_LENGTH_SPLIT_FILE_NUMBER, opt->S_option_value);
+      mp3splt_set_int_option(state, SPLT_OPT_SPLIT_MODE, SPLT_OPTION_LENGTH_MODE);
+      break;
+    case 'd':
+      opt->dir_arg = strdup(optarg);
+      opt->d_option = SPLT_TRUE;
+      break;
+    case 'N':
+      opt->N_option = SPLT_TRUE;
+      break;
+    case 'o':
+      mp3splt_set_int_option(state, SPLT_OPT_OUTPUT_FILENAMES, SPLT_OUTPUT_FORMAT);
+      if (optarg)
+      {
+        opt->output_format = strdup(optarg);
+        if (!opt->output_format)
+        {
+          return print_run_error(_("cannot allocate memory !"),data);
+        }
+      }
+
+      //if the split result must be written to stdout
+      if (strcmp(optarg,"-") == 0)
+      {
+        data->console_out = data->console_err;
+      }
+      opt->o_option = SPLT_TRUE;
+      break;
+    case 'O':
+      opt->O_option = SPLT_TRUE;
+      long overlap_time = c_hundreths(optarg);
+      if ((overlap_time == -1) || (overlap_time == LONG_MAX))
+      {
+        return print_run_error(_("bad time expression for the overlap.\n"
+              "\tMust be min.sec, read man page for details."), data);
+      }
+      mp3splt_set_long_option(state, SPLT_OPT_OVERLAP_TIME, overlap_time);
+      break;
+    case 'X':
+      opt->X_option = SPLT_TRUE;
+      break;
+    case 't':
+      mp3splt_set_int_option(state, SPLT_OPT_SPLIT_MODE, SPLT_OPTION_TIME_MODE);
+      float converted_time = c_hundreths(optarg);
+
+      if (converted_time != -1)
+      {
+        float split_time = converted_time / 100.0;
+        mp3splt_set_float_option(state, SPLT_OPT_SPLIT_TIME, split_time);
+      }
+      else
+      {
+        return print_run_error(_("bad time expression for the time split.\n"
+              "\tMust be min.sec, read man page for details."), data);
+      }
+      opt->t_option = SPLT_TRUE;
+      break;
+    case 'p':
+      opt->p_option = SPLT_TRUE;
+      opt->param_args = strdup(optarg);
+      break;
+    case 'g':
+      if (opt->custom_tags)
+      {
+        free(opt->custom_tags);
+        opt->custom_tags = NULL;
+      }
+      mp3splt_set_int_option(state, SPLT_OPT_TAGS, SPLT_CURRENT_TAGS);
+      if (optarg)
+      {
+        if (optarg[0] == 'r' && strlen(optarg) > 1)
+        {
+          opt->custom_tags = strdup(optarg+1);
+          mp3splt_set_int_option(state, SPLT_OPT_REPLACE_TAGS_IN_TAGS, SPLT_TRUE);
+        }
+        else
+        {
+          opt->custom_tags = strdup(optarg);
+        }
+      }
+      else
+      {
+        opt->custom_tags = NULL;
+      }
+      opt->g_option = SPLT_TRUE;
+      break;
+    case 'Q':
+      opt->q_option = SPLT_TRUE;
+      mp3splt_set_int_option(state, SPLT_OPT_QUIET_MODE, SPLT_TRUE);
+      opt->qq_option = SPLT_TRUE;
+      if (data->standard_sinks)
+      {
+        data->console_progress = stdout;
+        fclose(stdout);
+      }
+      else if (!data->console_null)
+      {
+        //the sinks of the caller are not closed
+        data->console_null = fopen(MP3SPLT_NULL_DEVICE, "w");
+        if (data->console_null)
+        {
+          data->console_out = data->console_null;
+          data->console_progress = data->console_null;
+        }
+      }
+      break;
+    case OPTION_SPLITPOINTS:
+      if (opt->splitpoints_file_arg)
+      {
+        free(opt->splitpoints_file_arg);
+      }
+      opt->splitpoints_file_arg = strdup(optarg);
+      break;
+    case OPTION_PLAN:
+      if (opt->plan_arg)
+      {
+        free(opt->plan_arg);
+      }
+      opt->plan_arg = strdup(optarg);
+      break;
+    case OPTION_EXECUTE_PLAN:
+      if (opt->execute_plan_arg)
+      {
+        free(opt->execute_plan_arg);
+      }
+      opt->execute_plan_arg = strdup(optarg);
+      break;
+    case OPTION_MANIFEST:
+      if (opt->manifest_arg)
+      {
+        free(opt->manifest_arg);
+      }
+      opt->manifest_arg = strdup(optarg);
+      break;
+    case OPTION_LOUDNESS:
+      opt->loudness_option = SPLT_TRUE;
+      break;
+    case OPTION_WAVEFORM:
+      if ((strcmp(optarg, "dat") != 0) && (strcmp(optarg, "json") != 0))
+      {
+        return print_run_error(_("the waveform format must be 'dat' or 'json'"), data);
+      }
+      if (opt->waveform_arg)
+      {
+        free(opt->waveform_arg);
+      }
+      opt->waveform_arg = strdup(optarg);
+      break;
+    case OPTION_WAVEFORM_RESOLUTION:
+      {
+        char *end = NULL;
+        long samples_per_pixel = strtol(optarg, &end, 10);
+        if ((end == optarg) || (*end != '\0') || (samples_per_pixel <= 0))
         {
-          print_message_exit(_("\n split aborted."), data);
+          return print_run_error(_("bad waveform resolution: it must be a"
+                " positive number of samples per pixel"), data);
         }
-        if (junk[0] == 's')
+        data->sl->requested_samples_per_pixel = samples_per_pixel;
+      }
+      break;
+    case OPTION_RETAG:
+      opt->retag_option = SPLT_TRUE;
+      break;
+    case OPTION_DROP_CACHE:
+      opt->drop_cache_option = SPLT_TRUE;
+      break;
+    case OPTION_FOLLOW:
+      opt->follow_option = SPLT_TRUE;
+      break;
+    case OPTION_BUILD_CDDB_INDEX:
+      if (opt->cddb_index_arg)
+      {
+        free(opt->cddb_index_arg);
+      }
+      opt->cddb_index_arg = strdup(optarg);
+      break;
+    case OPTION_TRACE:
+      if (opt->trace_arg)
+      {
+        free(opt->trace_arg);
+      }
+      opt->trace_arg = strdup(optarg);
+      break;
+    case OPTION_WATCH:
+      opt->watch_option = SPLT_TRUE;
+      if (keep_watch_option(data) == -1)
+      {
+        return -1;
+      }
+      break;
+    case OPTION_WATCH_JOBS:
+      {
+        char *end = NULL;
+        long watch_jobs = strtol(optarg, &end, 10);
+        if ((end == optarg) || (*end != '\0') || (watch_jobs < 1) ||
+            (watch_jobs > 256))
         {
-          goto split;
+          return print_run_error(_("bad argument for --watch-jobs: it must be a"
+                " number of splits from 1 to 256"), data);
+        }
+        opt->watch_jobs = (int) watch_jobs;
+        if (keep_watch_option(data) == -1)
+        {
+          return -1;
         }
       }
-
-      print_message("\n");
-    }
-  }
-
-  int answer_is_correct = SPLT_FALSE;
-  do {
-    fprintf(console_out, _("\n-- 's' to split, 'c' to cancel:"));
-    fflush(console_out);
-
-    fgets(junk, 16, stdin);
-
-    if (junk[1] == '\n')
-    {
-      if (junk[0] == 'c')
+      break;
+    case OPTION_ADJUST_JOBS:
       {
-        print_message_exit(_("\n split aborted."), data);
+        char *end = NULL;
+        long adjust_jobs = strtol(optarg, &end, 10);
+        if ((end == optarg) || (*end != '\0') || (adjust_jobs < 0) ||
+            (adjust_jobs > 256))
+        {
+          return print_run_error(_("bad argument for --adjust-jobs: it must be a"
+                " number of processes from 0 to 256"), data);
+        }
+        opt->adjust_jobs = (int) adjust_jobs;
       }
-      if (junk[0] == 's')
+      break;
+    case OPTION_DONE_DIR:
+      if (opt->done_dir_arg)
       {
-        answer_is_correct = SPLT_TRUE;
+        free(opt->done_dir_arg);
       }
-    }
-
-  } while (!answer_is_correct);
-
-  fprintf(console_out, "\n");
-  fflush(console_out);
+      opt->done_dir_arg = strdup(optarg);
+      if (keep_watch_option(data) == -1)
+      {
+        return -1;
+      }
+      break;
+    case OPTION_ERROR_DIR:
+      if (opt->error_dir_arg)
+      {
+        free(opt->error_dir_arg);
+      }
+      opt->error_dir_arg = strdup(optarg);
+      if (keep_watch_option(data) == -1)
+      {
+        return -1;
+      }
+      break;
+    case OPTION_DEDUPE:
+      if ((strcmp(optarg, "link") != 0) && (strcmp(optarg, "copy") != 0))
+      {
+        return print_run_error(_("the --dedupe argument must be 'link' or 'copy'"), data);
+      }
+      if (opt->dedupe_arg)
+      {
+        free(opt->dedupe_arg);
+      }
+      opt->dedupe_arg = strdup(optarg);
+      break;
+    case OPTION_ORDER:
+      if ((strcmp(optarg, "size") != 0) && (strcmp(optarg, "location") != 0))
+      {
+        return print_run_error(_("the input order must be 'size' or 'location'"), data);
+      }
+      if (opt->order_arg)
+      {
+        free(opt->order_arg);
+      }
+      opt->order_arg = strdup(optarg);
+      break;
+    case OPTION_CONCAT:
+      opt->concat_option = SPLT_TRUE;
+      break;
+    case OPTION_PREFETCH:
+      {
+        char *end = NULL;
+        long prefetch = strtol(optarg, &end, 10);
+        if ((end == optarg) || (*end != '\0') || (prefetch < 0) ||
+            (prefetch > INT_MAX))
+        {
+          return print_run_error(_("bad argument for --prefetch: it must be a"
+                " number of files"), data);
+        }
+        opt->prefetch = (int) prefetch;
+      }
+      break;
+    case OPTION_IO_LIMIT:
+      opt->io_limit = parse_io_rate(optarg);
+      if (opt->io_limit <= 0)
+      {
+        return print_run_error(_("bad rate for --io-limit (example: 50M)"), data);
+      }
+      opt->io_limit_option = SPLT_TRUE;
+      break;
+    case OPTION_IO_PRIORITY:
+      if (parse_io_priority(opt, optarg) == -1)
+      {
+        return print_run_error(_("bad argument for --io-priority"
+              " (must be 'idle', 'be' or 'be:0' to 'be:7')"), data);
+      }
+      opt->io_priority_option = SPLT_TRUE;
+      break;
+    default:
+      return print_run_error(_("read man page for documentation"
+            " or type 'mp3splt -h'."), data);
+  }
 
-split:
-  ;
+  return 0;
 }
 
-//main program starts here
-int main(int argc, char **orig_argv)
+//parses the options of the command line; returns the index of the first
+//argument that is not an option, or -1 when the run must stop
+int parse_options(main_data *data)
 {
-  setlocale(LC_ALL, "");
-
-#ifdef ENABLE_NLS
-  textdomain(MP3SPLT_GETTEXT_DOMAIN);
+  int option;
+  int result = 0;
+  lock_getopt();
+#ifdef __GLIBC__
+  optind = 0;
+#else
+  optind = 1;
 #endif
+  while ((result != -1) &&
+      ((option = getopt_long(data->argc, data->argv,
+          "m:O:Dvifkwleqnasc:d:o:t:p:g:hQN12T:XxPE:A:S:",
+          long_options, NULL)) != -1))
+  {
+    result = parse_option(data, option);
+  }
 
-  console_out = stdout;
-  console_err = stderr;
-  console_progress = stderr;
+  int first_argument = optind;
+  unlock_getopt();
 
+  return (result == -1) ? -1 : first_argument;
+}
+
+//runs the command line of the main struct 'data'; returns -1 when the run
+//stops before its end, with the exit status in 'data'
+int run_options(main_data *data)
+{
   //possible error
   int err = SPLT_OK;
-
-  main_data *data = create_main_struct(argc, orig_argv);
+  int argc = data->argc;
 
 #ifdef ENABLE_NLS
+  double locale_start = trace_begin(data);
 
 # ifdef __WIN32__
   char mp3splt_uninstall_file[2048] = { '\0' };
@@ -1884,18 +11545,24 @@ int main(int argc, char **orig_argv)
 # endif
 
   bind_textdomain_codeset(MP3SPLT_GETTEXT_DOMAIN, "UTF-8");
+  trace_end(data, "bind locale", NULL, locale_start, -1);
 #endif
 
+  double state_start = trace_begin(data);
   data->state = mp3splt_new_state(&err);
-  process_confirmation_error(err, data);
- 
+  trace_end(data, "new state", NULL, state_start, -1);
+  if (process_confirmation_error(err, data) == -1)
+  {
+#ifdef __WIN32__
+    free(executable);
+#endif
+    return -1;
+  }
+
   splt_state *state = data->state;
   silence_level *sl = data->sl;
   options *opt = data->opt;
 
-  //close nicely on Ctrl+C (for example)
-  signal(SIGINT, sigint_handler);
-
   //callback for the library messages
   mp3splt_set_message_function(state, put_library_message);
   mp3splt_set_silence_level_function(state, get_silence_level, data->sl);
@@ -1907,215 +11574,45 @@ int main(int argc, char **orig_argv)
   mp3splt_set_int_option(state, SPLT_OPT_TAGS, SPLT_TAGS_ORIGINAL_FILE);
 
   //parse command line options
-  int option;
-  while ((option = getopt(data->argc, data->argv,
-          "m:O:Dvifkwleqnasc:d:o:t:p:g:hQN12T:XxPE:A:S:")) != -1)
+  int first_argument = parse_options(data);
+  if (first_argument == -1)
   {
-    switch (option)
-    {
-      case 'x':
-        mp3splt_set_int_option(state, SPLT_OPT_XING, SPLT_FALSE);
-        break;
-      case 'h':
-        show_small_help_exit(data);
-        break;
-      //deprecated: use -T
-      case '1':
-        mp3splt_set_int_option(state, SPLT_OPT_FORCE_TAGS_VERSION, 1);
-        opt->T_option_value = 1;
-        opt->T_option = SPLT_TRUE;
-        break;
-      //deprecated: use -T
-      case '2':
-        mp3splt_set_int_option(state, SPLT_OPT_FORCE_TAGS_VERSION, 2);
-        opt->T_option_value = 2;
-        opt->T_option = SPLT_TRUE;
-        break;
-      case 'T':
-        opt->T_option_value = atoi(optarg);
-        mp3splt_set_int_option(state, SPLT_OPT_FORCE_TAGS_VERSION,
-            opt->T_option_value);
-        opt->T_option = SPLT_TRUE;
-        break;
-      case 'D':
-        mp3splt_set_int_option(state, SPLT_OPT_DEBUG_MODE, SPLT_TRUE);
-        break;
-      case 'v':
-        print_version(console_out); 
-        print_authors(console_out);
-        free_main_struct(&data);
-        exit(0);
-        break;
-      case 'f':
-        mp3splt_set_int_option(state, SPLT_OPT_FRAME_MODE, SPLT_TRUE);
-        opt->f_option = SPLT_TRUE;
-        break;
-      case 'k':
-        mp3splt_set_int_option(state, SPLT_OPT_INPUT_NOT_SEEKABLE, SPLT_TRUE);
-        opt->k_option = SPLT_TRUE;
-        break;
-      case 'w':
-        mp3splt_set_int_option(state, SPLT_OPT_SPLIT_MODE, SPLT_OPTION_WRAP_MODE);
-        opt->w_option = SPLT_TRUE;
-        break;
-      case 'l':
-        opt->l_option = SPLT_TRUE;
-        console_out = console_err;
-        break;
-      case 'e':
-        mp3splt_set_int_option(state, SPLT_OPT_SPLIT_MODE, SPLT_OPTION_ERROR_MODE);
-        opt->e_option = SPLT_TRUE;
-        break;
-      case 'q':
-        opt->q_option = SPLT_TRUE;
-        mp3splt_set_int_option(state, SPLT_OPT_QUIET_MODE, SPLT_TRUE);
-        break;
-      case 'n':
-        opt->n_option = SPLT_TRUE;
-        break;
-      case 'a':
-        mp3splt_set_int_option(state, SPLT_OPT_AUTO_ADJUST, SPLT_TRUE);
-        opt->a_option = SPLT_TRUE;
-        break;
-      case 's':
-        mp3splt_set_int_option(state, SPLT_OPT_SPLIT_MODE, SPLT_OPTION_SILENCE_MODE);
-        opt->s_option = SPLT_TRUE;
-        break;
-      case 'i':
-        mp3splt_set_int_option(state, SPLT_OPT_SPLIT_MODE, SPLT_OPTION_SILENCE_MODE);
-        opt->i_option = SPLT_TRUE;
-        break;
-      case 'c':
-        mp3splt_set_int_option(state, SPLT_OPT_TAGS, SPLT_CURRENT_TAGS);
-        opt->c_option = SPLT_TRUE;
-        opt->cddb_arg = strdup(optarg);
-        break;
-      case 'P':
-        opt->P_option = SPLT_TRUE;
-        mp3splt_set_int_option(state, SPLT_OPT_PRETEND_TO_SPLIT, SPLT_TRUE);
-        break;
-      case 'E':
-        opt->export_cue_arg = strdup(optarg);
-        opt->E_option = SPLT_TRUE;
-        break;
-      case 'A':
-        opt->A_option = SPLT_TRUE;
-        opt->audacity_labels_arg = strdup(optarg);
-        break;
-      case 'm':
-        opt->m_option = SPLT_TRUE;
-        opt->m3u_arg = strdup(optarg);
-        mp3splt_set_m3u_filename(state, opt->m3u_arg);
-        break;
-      case 'S':
-        opt->S_option = SPLT_TRUE;
-        opt->S_option_value = atoi(optarg);
-        mp3splt_set_int_option(state, SPLT_OPT_LENGTH_SPLIT_FILE_NUMBER, opt->S_option_value);
-        mp3splt_set_int_option(state, SPLT_OPT_SPLIT_MODE, SPLT_OPTION_LENGTH_MODE);
-        break;
-      case 'd':
-        opt->dir_arg = strdup(optarg);
-        opt->d_option = SPLT_TRUE;
-        break;
-      case 'N':
-        opt->N_option = SPLT_TRUE;
-        break;
-      case 'o':
-        mp3splt_set_int_option(state, SPLT_OPT_OUTPUT_FILENAMES, SPLT_OUTPUT_FORMAT);
-        if (optarg)
-        {
-          opt->output_format = strdup(optarg);
-          if (!opt->output_format)
-          {
-            print_error_exit(_("cannot allocate memory !"),data);
-          }
-        }
+#ifdef __WIN32__
+    free(executable);
+#endif
+    return -1;
+  }
 
-        //if the split result must be written to stdout
-        if (strcmp(optarg,"-") == 0)
-        {
-          console_out = stderr;
-        }
-        opt->o_option = SPLT_TRUE;
-        break;
-      case 'O':
-        opt->O_option = SPLT_TRUE;
-        mp3splt_set_long_option(state, SPLT_OPT_OVERLAP_TIME,
-            c_hundreths(optarg));
-        break;
-      case 'X':
-        opt->X_option = SPLT_TRUE;
-        break;
-      case 't':
-        mp3splt_set_int_option(state, SPLT_OPT_SPLIT_MODE, SPLT_OPTION_TIME_MODE);
-        float converted_time = c_hundreths(optarg);
+  //callback for the progress bar, also used to stop the split on
+  //cancel requests
+  data->show_progress = !opt->q_option && !opt->X_option;
+  mp3splt_set_progress_function(state, put_progress);
 
-        if (converted_time != -1)
-        {
-          float split_time = converted_time / 100.0;
-          mp3splt_set_float_option(state, SPLT_OPT_SPLIT_TIME, split_time);
-        }
-        else
-        {
-          print_error_exit(_("bad time expression for the time split.\n"
-                "\tMust be min.sec, read man page for details."), data);
-        }
-        opt->t_option = SPLT_TRUE;
-        break;
-      case 'p':
-        opt->p_option = SPLT_TRUE;
-        opt->param_args = strdup(optarg);
-        break;
-      case 'g':
-        if (opt->custom_tags)
-        {
-          free(opt->custom_tags);
-          opt->custom_tags = NULL;
-        }
-        mp3splt_set_int_option(state, SPLT_OPT_TAGS, SPLT_CURRENT_TAGS);
-        if (optarg)
-        {
-          if (optarg[0] == 'r' && strlen(optarg) > 1)
-          {
-            opt->custom_tags = strdup(optarg+1);
-            mp3splt_set_int_option(state, SPLT_OPT_REPLACE_TAGS_IN_TAGS, SPLT_TRUE);
-          }
-          else
-          {
-            opt->custom_tags = strdup(optarg);
-          }
-        }
-        else
-        {
-          opt->custom_tags = NULL;
-        }
-        opt->g_option = SPLT_TRUE;
-        break;
-      case 'Q':
-        opt->q_option = SPLT_TRUE;
-        mp3splt_set_int_option(state, SPLT_OPT_QUIET_MODE, SPLT_TRUE);
-        opt->qq_option = SPLT_TRUE;
-        console_progress = stdout;
-        fclose(stdout);
-        break;
-      default:
-        print_error_exit(_("read man page for documentation"
-              " or type 'mp3splt -h'."), data);
-        break;
-    }
+  //if quiet, does not write authors and other
+  if (!opt->q_option && !opt->X_option)
+  {
+    print_version_authors(data->console_err);
   }
 
-  //callback for the progress bar
-  if (!opt->q_option && !opt->X_option)
+  //lower the I/O priority before reading anything
+  if (opt->io_priority_option)
   {
-    mp3splt_set_progress_function(state, put_progress_bar);
+    set_io_priority(data);
   }
 
-  //if quiet, does not write authors and other
-  if (!opt->q_option && !opt->X_option)
+#ifndef __linux__
+  if (opt->io_limit_option)
+  {
+    print_warning(_("--io-limit is not supported on this system"));
+  }
+#endif
+
+#ifndef HAVE_POSIX_FADVISE
+  if (opt->prefetch > 0 || opt->drop_cache_option)
   {
-    print_version_authors(console_err);
+    print_warning(_("--prefetch and --drop-cache are not supported on this system"));
   }
+#endif
 
   //if -n option, set no tags whatever happends
   if (opt->n_option)
@@ -2127,26 +11624,28 @@ int main(int argc, char **orig_argv)
 
   //add special directory search for plugins on Windows
 #ifdef __WIN32__
+  int executable_dir_is_install_dir = SPLT_FALSE;
   if (executable != NULL)
   {
     if (executable[0] != '\0')
     {
       mp3splt_append_plugins_scan_dir(state, executable);
+      executable_dir_is_install_dir =
+        (strcmp(executable, mp3splt_uninstall_file) == 0);
     }
     free(executable);
     executable = NULL;
   }
 
-  //also add the installation directory that we take from the registry
-  if (mp3splt_uninstall_file[0] != '\0')
+  //also add the installation directory that we take from the registry,
+  //if we don't already scan it
+  if ((mp3splt_uninstall_file[0] != '\0') && !executable_dir_is_install_dir)
   {
     mp3splt_append_plugins_scan_dir(state, mp3splt_uninstall_file);
   }
 #endif
 
-  //after getting the options (especially the debug option), find plugins
-  err = mp3splt_find_plugins(state);
-  process_confirmation_error(err, data);
+  //the plugins are found later, the first time we need them
 
   //if we have parameter options
   if (opt->p_option)
@@ -2156,7 +11655,7 @@ int main(int argc, char **orig_argv)
     int parsed_p_options = parse_arg(opt->param_args,&th,&gap,&nt,&off,&rm,&min);
     if (parsed_p_options < 1)
     {
-      print_error_exit(_("bad argument for -p option. No valid value"
+      return print_run_error(_("bad argument for -p option. No valid value"
             " was recognized !"), data);
     }
 
@@ -2197,18 +11696,74 @@ int main(int argc, char **orig_argv)
   {
     //enable to create directories from the output filenames
     mp3splt_set_int_option(state, SPLT_OPT_CREATE_DIRS_FROM_FILENAMES, SPLT_TRUE);
-    mp3splt_set_oformat(state, opt->output_format,&output_format_error);
-    process_confirmation_error(output_format_error, data);
+    //the @x variable is ours: check the format with the variable expanded
+    if (output_format_has_hash_variable(opt->output_format))
+    {
+      char *checked_format = expand_hash_variables(opt->output_format, "", data);
+      if (!checked_format)
+      {
+        return -1;
+      }
+      mp3splt_set_oformat(state, checked_format, &output_format_error);
+      free(checked_format);
+      checked_format = NULL;
+    }
+    else
+    {
+      mp3splt_set_oformat(state, opt->output_format,&output_format_error);
+    }
+    if (process_confirmation_error(output_format_error, data) == -1)
+    {
+      return -1;
+    }
   }
 
-  if (optind > 1)
+  if (!opt->trace_arg)
+  {
+    free_trace(data);
+  }
+  //the command line of the splits of --watch
+  if (opt->watch_option)
+  {
+    data->original_argv = my_malloc(sizeof(char *) * data->argc, data);
+    if (!data->original_argv)
+    {
+      return -1;
+    }
+    memcpy(data->original_argv, data->argv, sizeof(char *) * data->argc);
+    data->number_of_original_args = data->argc;
+  }
+  if (first_argument > 1)
   {
-    data->argv = rmopt(data->argv, optind, data->argc);
-    data->argc -= optind-1;
+    data->argv = rmopt(data->argv, first_argument, data->argc);
+    data->argc -= first_argument-1;
   }
 
   //check arguments
-  check_args(argc, data);
+  if (check_args(argc, data) == -1)
+  {
+    return -1;
+  }
+
+  data->sl->keep_levels = opt->loudness_option;
+  data->sl->keep_peaks = (opt->waveform_arg != NULL);
+
+  //the splitpoints and the output files come from the split plan
+  if (opt->execute_plan_arg)
+  {
+    if (execute_plan(data) == -1)
+    {
+      return -1;
+    }
+    write_manifest(data);
+    return 0;
+  }
+
+  //index the freedb dumps for the local search
+  if (opt->cddb_index_arg)
+  {
+    return build_cddb_index(data);
+  }
 
   //enable/disable logging the silence splitpoints in a file
   mp3splt_set_int_option(state, SPLT_OPT_ENABLE_SILENCE_LOG, ! opt->N_option);
@@ -2216,8 +11771,17 @@ int main(int argc, char **orig_argv)
   //silence splitpoints log filename
   if (! opt->N_option)
   {
-    mp3splt_set_silence_log_filename(state, "mp3splt.log");
-    process_confirmation_error(err, data);
+    data->silence_log_temporary =
+      get_temporary_filename(data->silence_log_file);
+    if (!data->silence_log_temporary)
+    {
+      return print_run_error(_("cannot allocate memory !"), data);
+    }
+    mp3splt_set_silence_log_filename(state, data->silence_log_temporary);
+    if (process_confirmation_error(err, data) == -1)
+    {
+      return -1;
+    }
   }
 
   int i = 0;
@@ -2225,6 +11789,7 @@ int main(int argc, char **orig_argv)
   data->number_of_filenames = 0;
   data->splitpoints = NULL;
   data->number_of_splitpoints = 0;
+  data->splitpoints_capacity = 0;
 
   int we_had_directory_as_argument = SPLT_FALSE;
 
@@ -2236,14 +11801,35 @@ int main(int argc, char **orig_argv)
     long hundreths = c_hundreths(argument);
     if (hundreths != -1)
     {
-      append_splitpoint(data, hundreths);
+      if (append_splitpoint(data, hundreths) == -1)
+      {
+        return -1;
+      }
     }
     else
     {
-      if (mp3splt_u_check_if_directory(argument))
+      //the watched directories
+      if (opt->watch_option && mp3splt_u_check_if_directory(argument))
+      {
+        if (keep_watch_argument(data, argument) == -1)
+        {
+          return -1;
+        }
+        if (append_filename(data, argument) == -1)
+        {
+          return -1;
+        }
+      }
+      else if (mp3splt_u_check_if_directory(argument))
       {
         we_had_directory_as_argument = SPLT_TRUE;
 
+        //we need the plugins to know the supported extensions
+        if (find_plugins_once(data) == -1)
+        {
+          return -1;
+        }
+
         int num_of_files_found = 0;
         char **found_files =
           mp3splt_find_filenames(state, argument, &num_of_files_found, &err);
@@ -2252,7 +11838,10 @@ int main(int argc, char **orig_argv)
         {
           char *current_fname = found_files[k];
           
-          append_filename(data, current_fname);
+          if (append_filename(data, current_fname) == -1)
+          {
+            return -1;
+          }
 
           if (found_files[k])
           {
@@ -2266,13 +11855,87 @@ int main(int argc, char **orig_argv)
           found_files = NULL;
         }
         num_of_files_found = 0;
-        process_confirmation_error(err, data);
+        if (process_confirmation_error(err, data) == -1)
+        {
+          return -1;
+        }
       }
       else
       {
-        append_filename(data, argument);
+        if (append_filename(data, argument) == -1)
+        {
+          return -1;
+        }
+      }
+    }
+  }
+
+  //splitpoints from a file or from stdin
+  if (opt->splitpoints_file_arg)
+  {
+    if (strcmp(opt->splitpoints_file_arg, "-") == 0)
+    {
+      for (i = 0; i < data->number_of_filenames; i++)
+      {
+        char *filename = data->filenames[i];
+        if ((strcmp(filename, "-") == 0) || (strcmp(filename, "m-") == 0) ||
+            (strcmp(filename, "o-") == 0))
+        {
+          return print_run_error(_("cannot read both the splitpoints and the"
+                " input file from STDIN"), data);
+        }
+      }
+    }
+
+    double load_start = trace_begin(data);
+    if (read_splitpoints_file(data, opt->splitpoints_file_arg) == -1)
+    {
+      return -1;
+    }
+    trace_end(data, "load splitpoints", opt->splitpoints_file_arg, load_start,
+        get_trace_file_size(opt->splitpoints_file_arg));
+  }
+
+  //only set the tags of the input files
+  if (opt->retag_option)
+  {
+    if (data->number_of_filenames <= 0)
+    {
+      return print_run_error(_("no input filename(s)."), data);
+    }
+    if (data->number_of_splitpoints > 0)
+    {
+      return print_run_error(_("the --retag option takes no splitpoints"), data);
+    }
+    if (!opt->q_option && we_had_directory_as_argument)
+    {
+      if (show_files_and_ask_for_confirmation(data) == -1)
+      {
+        return -1;
       }
     }
+    return retag_files(data);
+  }
+
+  //split a growing file as it is written
+  if (opt->follow_option)
+  {
+    if (data->number_of_splitpoints > 0)
+    {
+      return print_run_error(_("the --follow option takes no splitpoints"), data);
+    }
+    if (follow_split(data) == -1)
+    {
+      return -1;
+    }
+    write_manifest(data);
+    return 0;
+  }
+
+  //split the files dropped in the watched directories
+  if (opt->watch_option)
+  {
+    return watch_directories(data);
   }
 
   //if we have a normal split, we need to parse the splitpoints
@@ -2283,7 +11946,10 @@ int main(int argc, char **orig_argv)
   {
     if (data->number_of_splitpoints < 2)
     {
-      process_confirmation_error(SPLT_ERROR_SPLITPOINTS, data);
+      if (process_confirmation_error(SPLT_ERROR_SPLITPOINTS, data) == -1)
+      {
+        return -1;
+      }
     }
     normal_split = SPLT_TRUE;
   }
@@ -2292,13 +11958,13 @@ int main(int argc, char **orig_argv)
 
   if (data->number_of_filenames <= 0)
   {
-    print_error_exit(_("no input filename(s)."), data);
+    return print_run_error(_("no input filename(s)."), data);
   }
 
   if (data->number_of_filenames > 1)
   {
-    fprintf(console_out,"\n");
-    fflush(console_out);
+    fprintf(data->console_out,"\n");
+    fflush(data->console_out);
   }
 
   if (opt->output_format && (strcmp(opt->output_format, "-") == 0))
@@ -2313,59 +11979,136 @@ int main(int argc, char **orig_argv)
     }
   }
 
+  if (opt->order_arg)
+  {
+    if (order_input_files(data) == -1)
+    {
+      return -1;
+    }
+  }
+
+  if (opt->dedupe_arg)
+  {
+    if (find_duplicate_inputs(data) == -1)
+    {
+      return -1;
+    }
+  }
+
   if (!opt->q_option && we_had_directory_as_argument)
   {
-    show_files_and_ask_for_confirmation(data);
+    if (show_files_and_ask_for_confirmation(data) == -1)
+    {
+      return -1;
+    }
+  }
+
+  if (opt->concat_option)
+  {
+    if (start_concat(data) == -1)
+    {
+      return -1;
+    }
   }
 
   //split all the filenames
   for (j = 0;j < data->number_of_filenames; j++)
   {
     char *current_filename = data->filenames[j];
+    double input_start = trace_begin(data);
+
+    data->current_file_index = j;
+    free_split_files(data);
+    data->interrupted_file[0] = '\0';
+      if (data->cancel_requested)
+    {
+      return exit_cancelled(data, SPLT_FALSE);
+    }
+
+    if (find_plugins_once(data) == -1)
+    {
+      return -1;
+    }
 
     sl->level_sum = 0;
     sl->number_of_levels = 0;
+    if (sl->blocks)
+    {
+      memset(sl->blocks, 0, sizeof(loudness_block) * sl->number_of_blocks);
+    }
+    sl->number_of_blocks = 0;
+    if (sl->keep_peaks)
+    {
+      start_waveform(data, current_filename);
+    }
+    data->first_manifest_entry = data->number_of_manifest_entries;
     err = SPLT_OK;
 
+    io_limiter_start(data);
+    cache_hints_start(data, current_filename);
+    if (opt->prefetch > 0)
+    {
+      prefetch_next_inputs(data, j);
+    }
+
     if (opt->P_option)
     {
-      fprintf(console_out,_(" Pretending to split file '%s' ...\n"),current_filename);
+      fprintf(data->console_out,_(" Pretending to split file '%s' ...\n"),current_filename);
     }
     else
     {
-      fprintf(console_out,_(" Processing file '%s' ...\n"),current_filename);
+      fprintf(data->console_out,_(" Processing file '%s' ...\n"),current_filename);
     }
-    fflush(console_out);
+    fflush(data->console_out);
 
     if ((strcmp(current_filename, "-") == 0 || strcmp(current_filename, "o-") == 0) &&
         we_have_incompatible_stdin_option(opt))
     {
-      print_error_exit(_("cannot use -k option (or STDIN) with"
+      return print_run_error(_("cannot use -k option (or STDIN) with"
             " one of the following options: -S -s -w -l -e -i -a -p"), data);
     }
 
+    if (check_segment_times_input(data, current_filename) == -1)
+    {
+      return -1;
+    }
+
     //we put the filename
     err = mp3splt_set_filename_to_split(state, current_filename);
-    process_confirmation_error(err, data);
+    if (process_confirmation_error(err, data) == -1)
+    {
+      return -1;
+    }
 
+    //the files of an identical input file are reused
+    if (data->duplicates && (data->duplicates[j].original >= 0))
+    {
+      if (reuse_duplicate_outputs(data, j) == -1)
+      {
+        return -1;
+      }
+    }
     //if we list wrap files
-    if (opt->l_option)
+    else if (opt->l_option)
     {
       //if no error when putting the filename to split
       const splt_wrap *wrap_files;
       wrap_files = mp3splt_get_wrap_files(state,&err);
-      process_confirmation_error(err, data);
+      if (process_confirmation_error(err, data) == -1)
+      {
+        return -1;
+      }
 
       //if no error when getting the wrap files
       int wrap_files_number = wrap_files->wrap_files_num;
       int i = 0;
-      fprintf(stdout,"\n");
+      fprintf(data->console_out,"\n");
       for (i = 0;i < wrap_files_number;i++)
       {
-        fprintf(stdout,"%s\n",wrap_files->wrap_files[i]);
+        fprintf(data->console_out,"%s\n",wrap_files->wrap_files[i]);
       }
-      fprintf(stdout,"\n");
-      fflush(stdout);
+      fprintf(data->console_out,"\n");
+      fflush(data->console_out);
     }
     else
     {
@@ -2374,8 +12117,36 @@ int main(int argc, char **orig_argv)
       if (opt->i_option)
       {
         err = SPLT_OK;
+        trace_split_start(data, current_filename);
         mp3splt_count_silence_points(state, &err);
-        process_confirmation_error(err, data);
+        trace_end_silence_scan(data);
+        if (check_callback_error(data) == -1)
+        {
+          return -1;
+        }
+        if (data->split_cancelled)
+        {
+          return exit_cancelled(data, SPLT_FALSE);
+        }
+        if (process_confirmation_error(err, data) == -1)
+        {
+          return -1;
+        }
+
+        if (opt->loudness_option)
+        {
+          if (print_estimated_levels(data, current_filename) == -1)
+          {
+            return -1;
+          }
+        }
+        if (opt->waveform_arg)
+        {
+          if (write_waveform(data, current_filename) == -1)
+          {
+            return -1;
+          }
+        }
       }
       else
       //if we don't list wrapped files and we don't count silence files
@@ -2383,14 +12154,70 @@ int main(int argc, char **orig_argv)
         //if we have cddb option
         if (opt->c_option)
         {
+          //exact lookup of the disc id
+          if (strncmp(opt->cddb_arg, "discid", 6) == 0)
+          {
+            //only look up the disc id for the first time
+            if (j == 0)
+            {
+              int ambigous = parse_query_arg(opt, opt->cddb_arg);
+              if (ambigous)
+              {
+                print_warning(_("disc id query format ambigous !"));
+              }
+              double lookup_start = trace_begin(data);
+              if (do_disc_id_lookup(data, current_filename) == -1)
+              {
+                return -1;
+              }
+              trace_end(data, "freedb disc id", opt->freedb_get_server,
+                  lookup_start, get_trace_file_size(data->cddb_file));
+            }
+
+            int cached = put_cached_splitpoints(data);
+            if (cached == -1)
+            {
+              return -1;
+            }
+            if (!cached)
+            {
+              mp3splt_put_cddb_splitpoints_from_file(state, data->cddb_file, &err);
+              if (process_confirmation_error(err, data) == -1)
+              {
+                return -1;
+              }
+              if (cache_splitpoints(data) == -1)
+              {
+                return -1;
+              }
+            }
+          }
           //we get the filename
-          if ((strstr(opt->cddb_arg, ".cue")!=NULL)||
+          else if ((strstr(opt->cddb_arg, ".cue")!=NULL)||
               (strstr(opt->cddb_arg, ".CUE")!=NULL))
           {
             //we have the cue filename in cddb_arg
             //here we get cue splitpoints
-            mp3splt_put_cue_splitpoints_from_file(state, opt->cddb_arg, &err);
-            process_confirmation_error(err, data);
+            int cached = put_cached_splitpoints(data);
+            if (cached == -1)
+            {
+              return -1;
+            }
+            if (!cached)
+            {
+              double load_start = trace_begin(data);
+              mp3splt_put_cue_splitpoints_from_file(state, opt->cddb_arg, &err);
+              trace_end(data, "load splitpoints", opt->cddb_arg, load_start,
+                  get_trace_file_size(opt->cddb_arg));
+              if (process_confirmation_error(err, data) == -1)
+              {
+                return -1;
+              }
+              if (cache_splitpoints(data) == -1)
+              {
+                return -1;
+              }
+            }
           }
           else
           {
@@ -2405,26 +12232,83 @@ int main(int argc, char **orig_argv)
                 {
                   print_warning(_("freedb query format ambigous !"));
                 }
-                do_freedb_search(data);
+                if (do_freedb_search(data) == -1)
+                {
+                  return -1;
+                }
               }
 
               //we get the splitpoints from the file
-              mp3splt_put_cddb_splitpoints_from_file(state, MP3SPLT_CDDBFILE, &err);
-              process_confirmation_error(err, data);
+              int cached = put_cached_splitpoints(data);
+              if (cached == -1)
+              {
+                return -1;
+              }
+              if (!cached)
+              {
+                double load_start = trace_begin(data);
+                mp3splt_put_cddb_splitpoints_from_file(state, data->cddb_file, &err);
+                trace_end(data, "load splitpoints", data->cddb_file, load_start,
+                    get_trace_file_size(data->cddb_file));
+                if (process_confirmation_error(err, data) == -1)
+                {
+                  return -1;
+                }
+                if (cache_splitpoints(data) == -1)
+                {
+                  return -1;
+                }
+              }
             }
             else
               //here we have cddb file
             {
-              mp3splt_put_cddb_splitpoints_from_file(state, opt->cddb_arg, &err);
-              process_confirmation_error(err, data);
+              int cached = put_cached_splitpoints(data);
+              if (cached == -1)
+              {
+                return -1;
+              }
+              if (!cached)
+              {
+                double load_start = trace_begin(data);
+                mp3splt_put_cddb_splitpoints_from_file(state, opt->cddb_arg, &err);
+                trace_end(data, "load splitpoints", opt->cddb_arg, load_start,
+                    get_trace_file_size(opt->cddb_arg));
+                if (process_confirmation_error(err, data) == -1)
+                {
+                  return -1;
+                }
+                if (cache_splitpoints(data) == -1)
+                {
+                  return -1;
+                }
+              }
             }
           }
         }
         else if (opt->audacity_labels_arg)
         {
-          mp3splt_put_audacity_labels_splitpoints_from_file(state,
-              opt->audacity_labels_arg, &err);
-          process_confirmation_error(err, data);
+          int cached = put_cached_splitpoints(data);
+          if (cached == -1)
+          {
+            return -1;
+          }
+          if (!cached)
+          {
+            double load_start = trace_begin(data);
+            mp3splt_put_audacity_labels_splitpoints_from_file(state,
+                opt->audacity_labels_arg, &err);
+            trace_end(data, "load splitpoints", opt->audacity_labels_arg,
+                load_start, get_trace_file_size(opt->audacity_labels_arg));
+            if (process_confirmation_error(err, data) == -1)
+            {
+              return -1;
+            }
+            if (cache_splitpoints(data) == -1)
+            {
+              return -1;
+            }
+          }
         } else if (normal_split)
         {
           //we set the splitpoints to the library
@@ -2432,7 +12316,10 @@ int main(int argc, char **orig_argv)
           {
             long point = data->splitpoints[i];
             err = mp3splt_append_splitpoint(state, point, NULL, SPLT_SPLITPOINT);
-            process_confirmation_error(err, data);
+            if (process_confirmation_error(err, data) == -1)
+            {
+              return -1;
+            }
           }
         }
 
@@ -2440,13 +12327,25 @@ int main(int argc, char **orig_argv)
         if (opt->d_option)
         {
           err = mp3splt_set_path_of_split(state, opt->dir_arg);
-          process_confirmation_error(err, data);
+          if (process_confirmation_error(err, data) == -1)
+          {
+            return -1;
+          }
+        }
+
+        //output format with the @x variable and the output directories
+        if (set_output_format_for_file(data, current_filename) == -1)
+        {
+          return -1;
         }
 
         if (opt->g_option && (opt->custom_tags != NULL))
         {
           int ambiguous = mp3splt_put_tags_from_string(state, opt->custom_tags, &err);
-          process_confirmation_error(err, data);
+          if (process_confirmation_error(err, data) == -1)
+          {
+            return -1;
+          }
           if (ambiguous)
           {
             print_warning(_("tags format ambiguous !"));
@@ -2461,9 +12360,51 @@ int main(int argc, char **orig_argv)
           mp3splt_set_int_option(state, SPLT_OPT_OUTPUT_FILENAMES, SPLT_OUTPUT_CUSTOM);
         }
 
+        //-a: the silences are only searched around the splitpoints
+        if (opt->a_option)
+        {
+          int adjusted = adjust_splitpoints(data, current_filename);
+          if (adjusted == -1)
+          {
+            return -1;
+          }
+          mp3splt_set_int_option(state, SPLT_OPT_AUTO_ADJUST, !adjusted);
+        }
+
         //we do the effective split
+        trace_split_start(data, current_filename);
         err = mp3splt_split(state);
-        process_confirmation_error(err, data);
+        trace_end_silence_scan(data);
+        if (check_callback_error(data) == -1)
+        {
+          return -1;
+        }
+        if (data->split_cancelled && (err == SPLT_SPLIT_CANCELLED))
+        {
+          return exit_cancelled(data, SPLT_FALSE);
+        }
+        if (process_confirmation_error(err, data) == -1)
+        {
+          return -1;
+        }
+
+        //the watch mode moves the file to --error-dir
+        if (watch_job_process && !opt->P_option &&
+            (data->number_of_split_files == 0))
+        {
+          char message[1024] = { '\0' };
+          snprintf(message, 1024, _("no file has been created from '%s'"),
+              current_filename);
+          return print_run_error(message, data);
+        }
+
+        if (opt->plan_arg)
+        {
+          if (write_plan_for_file(data, current_filename) == -1)
+          {
+            return -1;
+          }
+        }
 
         //for cddb, set output filenames to its old value before the split
         if (opt->c_option && !opt->o_option)
@@ -2485,15 +12426,55 @@ int main(int argc, char **orig_argv)
               print_message(message);
             }
           }
+
+          if (opt->loudness_option)
+          {
+            if (print_estimated_levels(data, current_filename) == -1)
+            {
+              return -1;
+            }
+          }
+          if (opt->waveform_arg)
+          {
+            if (write_waveform(data, current_filename) == -1)
+            {
+              return -1;
+            }
+          }
         }
       }
     }
 
+    print_io_statistics(data);
+    cache_hints_finish(data);
+    if (data->duplicates)
+    {
+      if (keep_duplicate_outputs(data, j) == -1)
+      {
+        return -1;
+      }
+    }
+
     if (opt->E_option)
     {
-      err = SPLT_OK;
-      mp3splt_export_to_cue(state, opt->export_cue_arg, SPLT_TRUE, &err);
-      process_confirmation_error(err, data);
+      if (export_cue_file(data) == -1)
+      {
+        return -1;
+      }
+    }
+
+    //the artifacts of the input file are written at once
+    if (finish_silence_log(data) == -1)
+    {
+      return -1;
+    }
+    if (opt->m_option && !opt->P_option)
+    {
+      if (append_m3u_entries(data) == -1)
+      {
+        return -1;
+      }
+      flush_m3u_files(data);
     }
 
     if (opt->c_option && err >= 0 && !opt->q_option)
@@ -2511,24 +12492,175 @@ int main(int argc, char **orig_argv)
             " +-----------------------------------------------------------------------------+\n"));
     }
 
+    trace_end(data, "input file", current_filename, input_start,
+        get_trace_file_size(current_filename));
+
     //next file
     if (data->number_of_filenames > 1)
     {
-      fprintf(console_out,"\n");
-      fflush(console_out);
+      fprintf(data->console_out,"\n");
+      fflush(data->console_out);
     }
 
     //erase the previous splitpoints
     err = SPLT_OK;
     mp3splt_erase_all_tags(state, &err);
-    process_confirmation_error(err, data);
+    if (process_confirmation_error(err, data) == -1)
+    {
+      return -1;
+    }
     err = SPLT_OK;
     mp3splt_erase_all_splitpoints(state,&err);
-    process_confirmation_error(err, data);
+    if (process_confirmation_error(err, data) == -1)
+    {
+      return -1;
+    }
   }
 
-  free_main_struct(&data);
+  finish_concat(data);
+  write_manifest(data);
+  finish_plan(data);
+
+  return 0;
+}
+
+//programs linking this file (compiled with -DMP3SPLT_EMBEDDED) run
+//mp3splt with new_run, execute_run and free_run, or with run_mp3splt.
+//The state of a run is in its main struct, so that several runs can go
+//on at once, one per thread, with these limits:
+//- the options that change the process are refused: --concat (which
+//  replaces the standard input) and --watch (which starts processes);
+//  -a is adjusted by the library, without processes
+//- the runs parse their options one at a time (getopt has global state)
+//- the signal handlers are installed by the caller, which stops a run
+//  with cancel_run
+//- the silence log, the cancel summary and the freedb file are written
+//  in the working directory: runs from the same directory must each have
+//  theirs (see set_run_directory)
+
+//creates the run of the command line 'argv', with the messages written to
+//'out_sink' and the errors and progress to 'err_sink'; 'argv' may be
+//reordered, like with getopt; returns NULL if we cannot allocate
+main_data *new_run(int argc, char **argv, FILE *out_sink, FILE *err_sink)
+{
+  main_data *data = create_main_struct(argc, argv);
+  if (!data)
+  {
+    return NULL;
+  }
+
+  data->console_out = out_sink;
+  data->console_err = err_sink;
+  data->console_progress = err_sink;
+
+  return data;
+}
+
+//returns 'name' in 'directory'
+char *get_run_file(const char *directory, const char *name)
+{
+  size_t size = strlen(directory) + strlen(name) + 2;
+  char *file = malloc(size);
+  if (file)
+  {
+    snprintf(file, size, "%s%c%s", directory, SPLT_DIRCHAR, name);
+  }
+
+  return file;
+}
+
+//writes the silence log, the cancel summary and the freedb file of the
+//run in 'directory' instead of the working directory; returns -1 if we
+//cannot allocate
+int set_run_directory(main_data *data, const char *directory)
+{
+  char *silence_log_file = get_run_file(directory, MP3SPLT_SILENCE_LOGFILE);
+  char *cancel_log_file = get_run_file(directory, MP3SPLT_CANCEL_LOGFILE);
+  char *cddb_file = get_run_file(directory, MP3SPLT_CDDBFILE);
+  if (!silence_log_file || !cancel_log_file || !cddb_file)
+  {
+    free(silence_log_file);
+    free(cancel_log_file);
+    free(cddb_file);
+    return -1;
+  }
+
+  free(data->silence_log_file);
+  free(data->cancel_log_file);
+  free(data->cddb_file);
+  data->silence_log_file = silence_log_file;
+  data->cancel_log_file = cancel_log_file;
+  data->cddb_file = cddb_file;
 
   return 0;
 }
 
+//executes the run in the current thread, once; returns the exit status
+int execute_run(main_data *data)
+{
+  callbacks_data = data;
+  run_options(data);
+  callbacks_data = NULL;
+
+  return data->exit_status;
+}
+
+void free_run(main_data *data)
+{
+  free_main_struct(&data);
+}
+
+//runs mp3splt on the command line 'argv' with the output streams
+//'out_sink' and 'err_sink'; returns the exit status
+int run_mp3splt(int argc, char **argv, FILE *out_sink, FILE *err_sink)
+{
+  main_data *data = new_run(argc, argv, out_sink, err_sink);
+  if (!data)
+  {
+    return 1;
+  }
+
+  int status = execute_run(data);
+  free_run(data);
+
+  return status;
+}
+
+//runs the command line of the program: -Q closes the standard output and
+//the run is cancelled by SIGINT and SIGTERM
+int run_command_line(int argc, char **argv)
+{
+  main_data *data = new_run(argc, argv, stdout, stderr);
+  if (!data)
+  {
+    return 1;
+  }
+
+  data->standard_sinks = SPLT_TRUE;
+  signal_run = data;
+  int status = execute_run(data);
+  signal_run = NULL;
+  free_run(data);
+
+  return status;
+}
+
+#ifndef MP3SPLT_EMBEDDED
+int main(int argc, char **orig_argv)
+{
+  setlocale(LC_ALL, "");
+
+#ifdef ENABLE_NLS
+  textdomain(MP3SPLT_GETTEXT_DOMAIN);
+#endif
+
+  //close nicely on Ctrl+C (for example) or when killed by a scheduler
+  signal(SIGINT, sigint_handler);
+#ifdef SIGTERM
+  signal(SIGTERM, sigint_handler);
+#endif
+
+  return run_command_line(argc, orig_argv);
+}
+#endif
+